@@ -0,0 +1,800 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "cldump.h"
+
+/*
+ * Aggregation
+ *
+ * --aggregate "SUM(AMOUNT), COUNT(*) GROUP BY BRANCH" computes COUNT,
+ * SUM, MIN and MAX over the selected records (--where included), grouped
+ * by any number of fields, without formatting the records at all. The
+ * values are decoded as in cl_where.c, so sums of LONG, SHORT, BYTE and
+ * DECIMAL fields are exact, only REAL fields are summed as doubles.
+ * Uninitialized REALs are left out like SQL NULLs.
+ *
+ * Groups are kept in a hash table keyed on the values of the group
+ * fields, strings without their trailing spaces. Each scan thread (see
+ * clarion_scan_records()) fills a table of its own, the tables are then
+ * merged into the first one. Groups come out in the order of their first
+ * record, as CSV rows with the group fields first, honouring -f, -H and
+ * --crlf.
+ */
+
+#define CL_AGG_COUNT             0
+#define CL_AGG_SUM               1
+#define CL_AGG_MIN               2
+#define CL_AGG_MAX               3
+
+typedef struct {
+  int fn;
+  ClarionFieldDesc *clfd; /* NULL for COUNT(*) */
+  int offset;
+} ClarionAggItem;
+
+struct ClarionAggregate {
+  int nitems;
+  ClarionAggItem *item;
+  int nkeys;
+  ClarionAggItem *key; /* group fields, fn unused */
+  size_t keymax; /* longest key */
+  size_t rawlen; /* group fields as stored */
+};
+
+typedef struct {
+  uint64_t count; /* non-NULL values, or records for COUNT(*) */
+  ClarionValue v; /* sum, min or max so far */
+  uint8_t *buf; /* string MIN and MAX */
+} ClarionAggSlot;
+
+typedef struct {
+  uint64_t hash;
+  uint32_t first; /* first record of the group */
+  uint32_t keylen;
+  uint8_t *key;
+  uint8_t *raw; /* group fields of the first record */
+  ClarionAggSlot slot[];
+} ClarionAggGroup;
+
+typedef struct {
+  ClarionAggregate *agg;
+  ClarionArena arena; /* groups and keys */
+  ClarionAggGroup **table;
+  uint32_t size; /* power of 2 */
+  uint32_t used;
+  uint8_t *keybuf;
+} ClarionAggTable;
+
+
+/* Parses "FN(FIELD)" or "COUNT(*)" at p, len bytes long */
+static int
+clarion_aggregate_item (ClarionHandle *cl, ClarionAggItem *item, const char *p, size_t len)
+{
+  static const char *fns[] = { "COUNT", "SUM", "MIN", "MAX" };
+  const char *arg;
+  size_t arglen;
+  int field;
+  int i;
+
+  while ((len > 0) && isspace((unsigned char)p[len - 1]))
+    len--;
+
+  for (i = 0; i < 4; i++)
+    {
+      if ((len > strlen(fns[i])) && (strncasecmp(p, fns[i], strlen(fns[i])) == 0))
+	break;
+    }
+
+  arg = p + ((i < 4) ? strlen(fns[i]) : 0);
+
+  while ((arg < p + len) && isspace((unsigned char)*arg))
+    arg++;
+
+  if ((i == 4) || (*arg != '(') || (p[len - 1] != ')'))
+    {
+      fprintf(stderr, "Syntax error in --aggregate at: %.*s\n", (int)len, p);
+      return -1;
+    }
+
+  for (arg++; isspace((unsigned char)*arg); arg++)
+    ;
+
+  for (arglen = p + len - 1 - arg; (arglen > 0) && isspace((unsigned char)arg[arglen - 1]); arglen--)
+    ;
+
+  item->fn = i;
+  item->clfd = NULL;
+  item->offset = 0;
+
+  if ((i == CL_AGG_COUNT) && (arglen == 1) && (*arg == '*'))
+    return 0;
+
+  field = clarion_find_field(cl, arg, arglen);
+
+  if (field < 0)
+    {
+      fprintf(stderr, "Unknown column %.*s\n", (int)arglen, arg);
+      return -1;
+    }
+
+  item->clfd = &cl->clm.clfd[field];
+  item->offset = clarion_field_offset(cl, field);
+  cl->colread[field] = 1;
+
+  if ((i == CL_AGG_SUM) && ((item->clfd->fldtype == CL_FIELD_STRING)
+			    || (item->clfd->fldtype == CL_FIELD_STRING_PIC_TOK)))
+    {
+      fprintf(stderr, "Cannot SUM string column %.*s\n", (int)arglen, arg);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Comma-separated items at p, len bytes long, into *items */
+static int
+clarion_aggregate_list (ClarionHandle *cl, const char *p, size_t len, int keys, ClarionAggItem **items, int *count)
+{
+  ClarionAggItem *item;
+  const char *end = p + len;
+  const char *s;
+  size_t n;
+  int field;
+  int i;
+
+  for (i = 1, s = p; s < end; s++)
+    i += (*s == ',');
+
+  *items = (ClarionAggItem *) clarion_arena_calloc(&cl->arena, i, sizeof(ClarionAggItem));
+
+  if (*items == NULL)
+    return -1;
+
+  for (*count = 0; p < end; p += n + 1)
+    {
+      while ((p < end) && isspace((unsigned char)*p))
+	p++;
+
+      for (n = 0; (p + n < end) && (p[n] != ','); n++)
+	;
+
+      item = &(*items)[*count];
+
+      if (!keys)
+	{
+	  if (clarion_aggregate_item(cl, item, p, n) < 0)
+	    return -1;
+	}
+      else
+	{
+	  while ((n > 0) && isspace((unsigned char)p[n - 1]))
+	    n--;
+
+	  field = clarion_find_field(cl, p, n);
+
+	  if (field < 0)
+	    {
+	      fprintf(stderr, "Unknown column %.*s\n", (int)n, p);
+	      return -1;
+	    }
+
+	  item->clfd = &cl->clm.clfd[field];
+	  item->offset = clarion_field_offset(cl, field);
+	  cl->colread[field] = 1;
+
+	  /* Skip over the spaces trimmed above */
+	  while ((p + n < end) && (p[n] != ','))
+	    n++;
+	}
+
+      (*count)++;
+    }
+
+  if (*count == 0)
+    {
+      fprintf(stderr, "Nothing to aggregate\n");
+      return -1;
+    }
+
+  return 0;
+}
+
+ClarionAggregate *
+clarion_aggregate_parse (ClarionHandle *cl, const char *spec)
+{
+  ClarionAggregate *agg;
+  ClarionFieldDesc *clfd;
+  const char *group = NULL;
+  const char *p;
+  int numflds = cl->clm.clh->numflds;
+  int i;
+
+  agg = (ClarionAggregate *) clarion_arena_calloc(&cl->arena, 1, sizeof(ClarionAggregate));
+
+  /* Only the fields aggregated, grouped by or filtered on are needed */
+  free(cl->colread);
+  cl->colread = (uint8_t *) CL_CALLOC((numflds > 0) ? numflds : 1, 1);
+
+  if ((agg == NULL) || (cl->colread == NULL))
+    return NULL;
+
+  /* GROUP BY, as two words, ends the list of aggregates */
+  for (p = spec; *p != '\0'; p++)
+    {
+      if ((strncasecmp(p, "GROUP", 5) != 0) || ((p > spec) && !isspace((unsigned char)p[-1]))
+	  || !isspace((unsigned char)p[5]))
+	continue;
+
+      for (group = p + 5; isspace((unsigned char)*group); group++)
+	;
+
+      if ((strncasecmp(group, "BY", 2) == 0) && isspace((unsigned char)group[2]))
+	{
+	  group += 2;
+	  break;
+	}
+
+      group = NULL;
+    }
+
+  if (clarion_aggregate_list(cl, spec, p - spec, 0, &agg->item, &agg->nitems) < 0)
+    return NULL;
+
+  if ((group != NULL) && (clarion_aggregate_list(cl, group, strlen(group), 1, &agg->key, &agg->nkeys) < 0))
+    return NULL;
+
+  for (i = 0; i < agg->nkeys; i++)
+    {
+      clfd = agg->key[i].clfd;
+
+      if ((clfd->fldtype == CL_FIELD_STRING) || (clfd->fldtype == CL_FIELD_STRING_PIC_TOK))
+	agg->keymax += sizeof(uint16_t) + clfd->length;
+      else
+	agg->keymax += sizeof(__int128) + sizeof(double);
+
+      agg->rawlen += clfd->length;
+    }
+
+  return agg;
+}
+
+
+static ClarionAggGroup *
+clarion_aggregate_new_group (ClarionAggTable *t, uint64_t hash, const uint8_t *key, uint32_t keylen)
+{
+  ClarionAggregate *agg = t->agg;
+  ClarionAggGroup *g;
+  ClarionAggItem *item;
+  int i;
+
+  g = (ClarionAggGroup *) clarion_arena_calloc(&t->arena, 1, sizeof(ClarionAggGroup) + agg->nitems * sizeof(ClarionAggSlot));
+
+  if (g == NULL)
+    return NULL;
+
+  g->hash = hash;
+  g->keylen = keylen;
+  g->key = (uint8_t *) clarion_arena_alloc(&t->arena, keylen + agg->rawlen + 1);
+
+  if (g->key == NULL)
+    return NULL;
+
+  memcpy(g->key, key, keylen);
+  g->raw = g->key + keylen;
+
+  for (i = 0; i < agg->nitems; i++)
+    {
+      item = &agg->item[i];
+      g->slot[i].v.type = CL_VALUE_NULL;
+
+      if ((item->clfd == NULL) || (item->fn == CL_AGG_COUNT)
+	  || ((item->clfd->fldtype != CL_FIELD_STRING) && (item->clfd->fldtype != CL_FIELD_STRING_PIC_TOK)))
+	continue;
+
+      g->slot[i].buf = (uint8_t *) clarion_arena_alloc(&t->arena, item->clfd->length + 1);
+
+      if (g->slot[i].buf == NULL)
+	return NULL;
+    }
+
+  return g;
+}
+
+/* Doubles the table once half full */
+static int
+clarion_aggregate_grow (ClarionAggTable *t)
+{
+  ClarionAggGroup **table;
+  uint32_t size = t->size ? t->size * 2 : 1024;
+  uint32_t i;
+  uint32_t j;
+
+  table = (ClarionAggGroup **) CL_CALLOC(size, sizeof(ClarionAggGroup *));
+
+  if (table == NULL)
+    return -1;
+
+  for (i = 0; i < t->size; i++)
+    {
+      if (t->table[i] == NULL)
+	continue;
+
+      for (j = t->table[i]->hash & (size - 1); table[j] != NULL; j = (j + 1) & (size - 1))
+	;
+
+      table[j] = t->table[i];
+    }
+
+  free(t->table);
+  t->table = table;
+  t->size = size;
+
+  return 0;
+}
+
+/* Finds the group with the given key, returns the slot it goes in if there's none */
+static ClarionAggGroup **
+clarion_aggregate_lookup (ClarionAggTable *t, uint64_t hash, const uint8_t *key, uint32_t keylen)
+{
+  ClarionAggGroup *g;
+  uint32_t i;
+
+  if ((t->used + 1) * 2 > t->size)
+    {
+      if (clarion_aggregate_grow(t) < 0)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+    }
+
+  for (i = hash & (t->size - 1); (g = t->table[i]) != NULL; i = (i + 1) & (t->size - 1))
+    {
+      if ((g->hash == hash) && (g->keylen == keylen) && (memcmp(g->key, key, keylen) == 0))
+	break;
+    }
+
+  return &t->table[i];
+}
+
+/* Folds v into the slot */
+static void
+clarion_aggregate_update (ClarionAggSlot *s, int fn, ClarionFieldDesc *clfd, const ClarionValue *v)
+{
+  int ret;
+
+  if (v->type == CL_VALUE_NULL)
+    return;
+
+  s->count++;
+
+  if (fn == CL_AGG_COUNT)
+    return;
+
+  if (s->v.type == CL_VALUE_NULL)
+    {
+      s->v = *v;
+      ret = (fn == CL_AGG_MIN) ? -1 : 1;
+    }
+  else if (fn == CL_AGG_SUM)
+    {
+      if (v->type == CL_VALUE_REAL)
+	s->v.real += v->real;
+      else
+	s->v.num += v->num;
+
+      return;
+    }
+  else
+    ret = clarion_value_cmp(v, &s->v);
+
+  if (((fn == CL_AGG_MIN) && (ret < 0)) || ((fn == CL_AGG_MAX) && (ret > 0)))
+    {
+      s->v = *v;
+
+      /* Strings point into the record, keep a copy padded like the field */
+      if (v->type == CL_VALUE_STRING)
+	{
+	  memcpy(s->buf, v->str, v->len);
+	  memset(s->buf + v->len, ' ', clfd->length - v->len);
+	  s->v.str = s->buf;
+	}
+    }
+}
+
+static void
+clarion_aggregate_record (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+			  uint8_t *data, ClarionOutput *out, void *ctx)
+{
+  ClarionAggTable *t = (ClarionAggTable *)ctx;
+  ClarionAggregate *agg = t->agg;
+  ClarionAggGroup **slot;
+  ClarionAggGroup *g;
+  ClarionAggItem *item;
+  ClarionValue v;
+  uint8_t *key = t->keybuf;
+  uint16_t len;
+  uint64_t hash;
+  uint8_t *raw;
+  int i;
+
+  /* Strings by their bytes, numbers by their value */
+  for (i = 0; i < agg->nkeys; i++)
+    {
+      clarion_field_value(agg->key[i].clfd, data + agg->key[i].offset, &v);
+
+      switch (v.type)
+	{
+	  case CL_VALUE_STRING:
+	    len = v.len;
+	    memcpy(key, &len, sizeof(uint16_t));
+	    memcpy(key + sizeof(uint16_t), v.str, v.len);
+	    key += sizeof(uint16_t) + v.len;
+	    break;
+	  case CL_VALUE_NUMBER:
+	    memcpy(key, &v.num, sizeof(__int128));
+	    key += sizeof(__int128);
+	    break;
+	  case CL_VALUE_REAL:
+	    memcpy(key, &v.real, sizeof(double));
+	    key += sizeof(double);
+	    break;
+	  default:
+	    *key++ = 0;
+	    break;
+	}
+    }
+
+  hash = clarion_fnv(CL_FNV_OFFSET, t->keybuf, key - t->keybuf);
+  slot = clarion_aggregate_lookup(t, hash, t->keybuf, key - t->keybuf);
+  g = *slot;
+
+  if (g == NULL)
+    {
+      g = clarion_aggregate_new_group(t, hash, t->keybuf, key - t->keybuf);
+
+      if (g == NULL)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+
+      g->first = recno;
+
+      for (i = 0, raw = g->raw; i < agg->nkeys; i++)
+	{
+	  memcpy(raw, data + agg->key[i].offset, agg->key[i].clfd->length);
+	  raw += agg->key[i].clfd->length;
+	}
+
+      *slot = g;
+      t->used++;
+    }
+
+  for (i = 0; i < agg->nitems; i++)
+    {
+      item = &agg->item[i];
+
+      if (item->clfd == NULL)
+	{
+	  g->slot[i].count++;
+	  continue;
+	}
+
+      clarion_field_value(item->clfd, data + item->offset, &v);
+      clarion_aggregate_update(&g->slot[i], item->fn, item->clfd, &v);
+    }
+}
+
+/* Merges the groups of src into dst, they stay in the arena of src */
+static void
+clarion_aggregate_merge (ClarionAggTable *dst, ClarionAggTable *src)
+{
+  ClarionAggregate *agg = dst->agg;
+  ClarionAggGroup **slot;
+  ClarionAggGroup *g;
+  ClarionAggGroup *h;
+  ClarionAggSlot *s;
+  uint32_t i;
+  int j;
+
+  for (i = 0; i < src->size; i++)
+    {
+      h = src->table[i];
+
+      if (h == NULL)
+	continue;
+
+      slot = clarion_aggregate_lookup(dst, h->hash, h->key, h->keylen);
+      g = *slot;
+
+      if (g == NULL)
+	{
+	  *slot = h;
+	  dst->used++;
+	  continue;
+	}
+
+      if (h->first < g->first)
+	{
+	  g->first = h->first;
+	  memcpy(g->raw, h->raw, agg->rawlen);
+	}
+
+      for (j = 0; j < agg->nitems; j++)
+	{
+	  s = &h->slot[j];
+
+	  /* A sum is merged as a value, the counts add up */
+	  if ((agg->item[j].fn == CL_AGG_COUNT) || (s->v.type == CL_VALUE_NULL))
+	    g->slot[j].count += s->count;
+	  else
+	    {
+	      clarion_aggregate_update(&g->slot[j], agg->item[j].fn, agg->item[j].clfd, &s->v);
+	      g->slot[j].count += s->count - 1;
+	    }
+	}
+    }
+}
+
+static int
+clarion_cmp_group (const void *a, const void *b)
+{
+  uint32_t x = (*(ClarionAggGroup * const *)a)->first;
+  uint32_t y = (*(ClarionAggGroup * const *)b)->first;
+
+  return (x > y) - (x < y);
+}
+
+/* Writes a number scaled by 10^scale */
+static void
+clarion_aggregate_number (ClarionOutput *out, __int128 num, int scale)
+{
+  char buf[48];
+  char *p = buf + sizeof(buf);
+  unsigned __int128 v;
+  int n = 0;
+
+  v = (num < 0) ? -(unsigned __int128)num : (unsigned __int128)num;
+
+  do {
+    if ((scale > 0) && (n == scale))
+      *--p = '.';
+
+    *--p = '0' + (int)(v % 10);
+    v /= 10;
+    n++;
+  } while ((v != 0) || (n <= scale));
+
+  if (num < 0)
+    *--p = '-';
+
+  clarion_out_write(out, p, buf + sizeof(buf) - p);
+}
+
+static void
+clarion_aggregate_value (ClarionHandle *cl, ClarionOutput *out, ClarionAggItem *item, ClarionAggSlot *s)
+{
+  if (item->fn == CL_AGG_COUNT)
+    {
+      clarion_out_int(out, s->count);
+      return;
+    }
+
+  switch (s->v.type)
+    {
+      case CL_VALUE_NUMBER:
+	clarion_aggregate_number(out, s->v.num, s->v.scale);
+	break;
+      case CL_VALUE_REAL:
+	clarion_out_printf(out, "%*f", item->clfd->decdec, s->v.real);
+	break;
+      case CL_VALUE_STRING:
+	clarion_dump_field_string_csv(cl, s->buf, item->clfd, out);
+	break;
+      default:
+	break;
+    }
+}
+
+static void
+clarion_aggregate_header (ClarionHandle *cl, ClarionAggregate *agg, ClarionOutput *out)
+{
+  static const char *fns[] = { "COUNT", "SUM", "MIN", "MAX" };
+  char buf[17];
+  const char *name;
+  unsigned int flags;
+  int i;
+
+  for (i = 0; i < agg->nkeys + agg->nitems; i++)
+    {
+      if (i > 0)
+	clarion_out_putc(out, cl->fsep);
+
+      if (i < agg->nkeys)
+	name = clarion_field_name(agg->key[i].clfd, buf);
+      else if (agg->item[i - agg->nkeys].clfd != NULL)
+	name = clarion_field_name(agg->item[i - agg->nkeys].clfd, buf);
+      else
+	name = "*";
+
+      if (i >= agg->nkeys)
+	clarion_out_printf(out, "%s(", fns[agg->item[i - agg->nkeys].fn]);
+
+      clarion_scan((uint8_t *)name, strlen(name), cl->fsep, &flags);
+      clarion_csv_write(out, (uint8_t *)name, strlen(name), flags);
+
+      if (i >= agg->nkeys)
+	clarion_out_putc(out, ')');
+    }
+
+  clarion_csv_eol(cl, out);
+}
+
+void
+clarion_aggregate_dump (ClarionHandle *cl, ClarionAggregate *agg)
+{
+  ClarionAggTable *tables;
+  ClarionAggGroup **groups;
+  ClarionAggGroup *g;
+  ClarionOutput out;
+  void **ctx;
+  uint8_t *raw;
+  uint32_t n;
+  uint32_t i;
+  int ntables;
+  int j;
+
+  tables = (ClarionAggTable *) CL_CALLOC(cl->jobs, sizeof(ClarionAggTable));
+  ctx = (void **) CL_CALLOC(cl->jobs, sizeof(void *));
+
+  if ((tables == NULL) || (ctx == NULL))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (j = 0; j < cl->jobs; j++)
+    {
+      tables[j].agg = agg;
+      tables[j].keybuf = (uint8_t *) CL_MALLOC(agg->keymax + 1);
+
+      if ((tables[j].keybuf == NULL) || (clarion_aggregate_grow(&tables[j]) < 0))
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+
+      ctx[j] = &tables[j];
+    }
+
+  ntables = clarion_scan_records(cl, clarion_aggregate_record, ctx, cl->jobs);
+
+  for (j = 1; j < ntables; j++)
+    clarion_aggregate_merge(&tables[0], &tables[j]);
+
+  /* Without GROUP BY, there is a row even if no record was selected */
+  if ((agg->nkeys == 0) && (tables[0].used == 0))
+    {
+      g = clarion_aggregate_new_group(&tables[0], CL_FNV_OFFSET, tables[0].keybuf, 0);
+
+      if (g == NULL)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+
+      *clarion_aggregate_lookup(&tables[0], g->hash, g->key, 0) = g;
+      tables[0].used++;
+    }
+
+  /* Whatever went through stdio so far comes first */
+  fflush(stdout);
+
+  groups = (ClarionAggGroup **) CL_MALLOC(((size_t)tables[0].used + 1) * sizeof(ClarionAggGroup *));
+
+  if ((groups == NULL) || (clarion_out_init(&out, STDOUT_FILENO, 256 * 1024) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (i = 0, n = 0; i < tables[0].size; i++)
+    {
+      if (tables[0].table[i] != NULL)
+	groups[n++] = tables[0].table[i];
+    }
+
+  qsort(groups, n, sizeof(ClarionAggGroup *), clarion_cmp_group);
+
+  CL_SET_PHASE(CL_PHASE_OUTPUT);
+
+  if (cl->opts & CL_OPT_CSV_HEADER)
+    clarion_aggregate_header(cl, agg, &out);
+
+  for (i = 0; i < n; i++)
+    {
+      g = groups[i];
+
+      for (j = 0, raw = g->raw; j < agg->nkeys; j++)
+	{
+	  if (j > 0)
+	    clarion_out_putc(&out, cl->fsep);
+
+	  switch (agg->key[j].clfd->fldtype)
+	    {
+	      case CL_FIELD_LONG:
+		clarion_dump_field_long(raw, agg->key[j].clfd, &out, NULL);
+		break;
+	      case CL_FIELD_REAL:
+		clarion_dump_field_real(raw, agg->key[j].clfd, &out, NULL);
+		break;
+	      case CL_FIELD_STRING:
+	      case CL_FIELD_STRING_PIC_TOK:
+		clarion_dump_field_string_csv(cl, raw, agg->key[j].clfd, &out);
+		break;
+	      case CL_FIELD_BYTE:
+		clarion_dump_field_byte(raw, agg->key[j].clfd, &out, NULL);
+		break;
+	      case CL_FIELD_SHORT:
+		clarion_dump_field_short(raw, agg->key[j].clfd, &out, NULL);
+		break;
+	      case CL_FIELD_DECIMAL:
+		clarion_dump_field_decimal(raw, agg->key[j].clfd, &out, NULL);
+		break;
+	      default:
+		break;
+	    }
+
+	  raw += agg->key[j].clfd->length;
+	}
+
+      for (j = 0; j < agg->nitems; j++)
+	{
+	  if ((j > 0) || (agg->nkeys > 0))
+	    clarion_out_putc(&out, cl->fsep);
+
+	  clarion_aggregate_value(cl, &out, &agg->item[j], &g->slot[j]);
+	}
+
+      clarion_csv_eol(cl, &out);
+    }
+
+  clarion_out_free(&out);
+
+  free(groups);
+
+  for (j = 0; j < cl->jobs; j++)
+    {
+      clarion_arena_free(&tables[j].arena);
+      free(tables[j].table);
+      free(tables[j].keybuf);
+    }
+
+  free(tables);
+  free(ctx);
+}
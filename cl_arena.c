@@ -0,0 +1,148 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cldump.h"
+
+/*
+ * Bump allocators
+ *
+ * The handle owns an arena holding all of the metadata, released at once
+ * by clarion_arena_free(). Each thread also has a scratch arena for the
+ * odd oversized value met while formatting records; it is reset between
+ * batches, and merged into a single chunk when it overflowed so that it
+ * stops allocating once it has seen the largest batch.
+ */
+
+#define CL_ARENA_CHUNK           (16 * 1024)
+#define CL_ARENA_ALIGN           16
+
+static __thread ClarionArena cl_scratch;
+
+static ClarionArenaChunk *
+clarion_arena_chunk (size_t size)
+{
+  ClarionArenaChunk *c;
+
+  c = (ClarionArenaChunk *) CL_MALLOC(sizeof(ClarionArenaChunk) + size);
+
+  if (c == NULL)
+    return NULL;
+
+  c->next = NULL;
+  c->size = size;
+  c->used = 0;
+
+  return c;
+}
+
+void *
+clarion_arena_alloc (ClarionArena *a, size_t size)
+{
+  ClarionArenaChunk *c;
+  void *p;
+
+  size = (size + CL_ARENA_ALIGN - 1) & ~(size_t)(CL_ARENA_ALIGN - 1);
+
+  c = a->head;
+
+  if ((c == NULL) || (c->size - c->used < size))
+    {
+      c = clarion_arena_chunk((size > CL_ARENA_CHUNK) ? size : CL_ARENA_CHUNK);
+
+      if (c == NULL)
+	return NULL;
+
+      c->next = a->head;
+      a->head = c;
+    }
+
+  p = c->data + c->used;
+  c->used += size;
+
+  return p;
+}
+
+void *
+clarion_arena_calloc (ClarionArena *a, size_t nmemb, size_t size)
+{
+  void *p;
+
+  p = clarion_arena_alloc(a, nmemb * size);
+
+  if (p != NULL)
+    memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+void
+clarion_arena_free (ClarionArena *a)
+{
+  ClarionArenaChunk *c;
+  ClarionArenaChunk *next;
+
+  for (c = a->head; c != NULL; c = next)
+    {
+      next = c->next;
+      free(c);
+    }
+
+  a->head = NULL;
+}
+
+/* Drops everything allocated so far, keeping (or merging) the chunks */
+void
+clarion_arena_reset (ClarionArena *a)
+{
+  ClarionArenaChunk *c;
+  size_t total = 0;
+
+  if (a->head == NULL)
+    return;
+
+  if (a->head->next != NULL)
+    {
+      for (c = a->head; c != NULL; c = c->next)
+	total += c->size;
+
+      clarion_arena_free(a);
+
+      a->head = clarion_arena_chunk(total);
+      return;
+    }
+
+  a->head->used = 0;
+}
+
+void *
+clarion_scratch_alloc (size_t size)
+{
+  return clarion_arena_alloc(&cl_scratch, size);
+}
+
+void
+clarion_scratch_reset (void)
+{
+  clarion_arena_reset(&cl_scratch);
+}
@@ -0,0 +1,776 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cldump.h"
+
+/*
+ * Bloom filter catalog
+ *
+ * --bloom-build DIR goes through every record of the .DAT files in DIR,
+ * deleted ones included, and adds the values of the --columns fields
+ * (all of them by default) to a Bloom filter per table and field. The
+ * filters are written to DIR/CATALOG.BLM, with the real path, size and
+ * modification time of each table. --bloom-query VALUE then lists the
+ * tables and fields that may hold VALUE, as CSV, to be checked with
+ * --where; there are no false negatives, and about 1% false positives.
+ *
+ * Values are hashed as in cl_index.c, so VALUE is looked for as a
+ * string in string fields and as a number in numeric ones. The filters
+ * are blocked: a value sets CL_BLOOM_K bits in a single 512-bit block,
+ * one cache line, picked from the high half of its hash. Each filter is
+ * sized from the record count of the header, CL_BLOOM_BITS bits a
+ * record. Tables are spread over up to cl->jobs threads, as with
+ * --inventory, each one reading its table by batches.
+ */
+
+#define CL_BLOOM_MAGIC           "CLDBLOOM"
+#define CL_BLOOM_VERSION         1
+#define CL_BLOOM_CATALOG         "CATALOG.BLM"
+
+#define CL_BLOOM_BITS            10 /* per record */
+#define CL_BLOOM_K               7 /* bits per value */
+#define CL_BLOOM_BLOCK           64 /* bytes */
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t ntables;
+  uint32_t nfilters;
+  uint32_t strsize; /* table and field names */
+} ClarionBloomHeader;
+
+typedef struct {
+  uint64_t datsize;
+  int64_t datmtime; /* ns */
+  uint32_t name; /* offset into the names */
+  uint32_t numrecs;
+  uint32_t first; /* filter */
+  uint32_t count;
+} ClarionBloomTable;
+
+typedef struct {
+  uint64_t offset; /* of the blocks, from the start of the catalog */
+  uint32_t nblocks;
+  uint32_t name; /* offset into the names */
+  uint8_t fldtype;
+  uint8_t pad[7];
+} ClarionBloomFilter;
+
+/* A field of a table being gone through */
+typedef struct {
+  ClarionFieldDesc *clfd; /* while the table is read */
+  int offset;
+  uint8_t fldtype;
+  char name[17];
+  uint32_t nblocks;
+  uint64_t *bits;
+} ClarionBloomColumn;
+
+typedef struct {
+  char *file;
+  int ok;
+  uint64_t datsize;
+  int64_t datmtime;
+  uint32_t numrecs;
+  int ncols;
+  ClarionBloomColumn *col;
+} ClarionBloomBuild;
+
+typedef struct {
+  ClarionHandle *cl;
+  const char *columns;
+  ClarionBloomBuild *tables;
+  int ntables;
+  int next;
+} ClarionBloomJob;
+
+
+static inline uint64_t *
+clarion_bloom_block (uint64_t *bits, uint32_t nblocks, uint64_t hash)
+{
+  return bits + (CL_BLOOM_BLOCK / 8) * (uint32_t)(((hash >> 32) * nblocks) >> 32);
+}
+
+static void
+clarion_bloom_add (uint64_t *bits, uint32_t nblocks, uint64_t hash)
+{
+  uint64_t *b = clarion_bloom_block(bits, nblocks, hash);
+  uint64_t g = hash * 0x9e3779b97f4a7c15ULL;
+  unsigned int bit;
+  int i;
+
+  for (i = 0; i < CL_BLOOM_K; i++, g >>= 9)
+    {
+      bit = g & (CL_BLOOM_BLOCK * 8 - 1);
+      b[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+static int
+clarion_bloom_test (const uint64_t *bits, uint32_t nblocks, uint64_t hash)
+{
+  const uint64_t *b = clarion_bloom_block((uint64_t *)bits, nblocks, hash);
+  uint64_t g = hash * 0x9e3779b97f4a7c15ULL;
+  unsigned int bit;
+  int i;
+
+  for (i = 0; i < CL_BLOOM_K; i++, g >>= 9)
+    {
+      bit = g & (CL_BLOOM_BLOCK * 8 - 1);
+
+      if (!(b[bit / 64] & (1ULL << (bit % 64))))
+	return 0;
+    }
+
+  return 1;
+}
+
+static int64_t
+clarion_bloom_mtime (struct stat *st)
+{
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/* Picks the fields of the comma-separated list, or all of them, that the table has */
+static int
+clarion_bloom_columns (ClarionHandle *cl, ClarionBloomBuild *t, const char *list)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  ClarionBloomColumn *c;
+  const char *p = list;
+  size_t len;
+  uint64_t bits;
+  char buf[17];
+  int field;
+  int i;
+
+  t->col = (ClarionBloomColumn *) CL_CALLOC(cl->clm.clh->numflds + 1, sizeof(ClarionBloomColumn));
+
+  if (t->col == NULL)
+    return -1;
+
+  for (i = 0; i < cl->clm.clh->numflds; i++)
+    {
+      if (clfd[i].fldtype == CL_FIELD_GROUP)
+	continue;
+
+      if (list != NULL)
+	{
+	  for (p = list, field = -1; (*p != '\0') && (field != i); p += len)
+	    {
+	      p += strspn(p, ", ");
+	      len = strcspn(p, ", ");
+
+	      if ((len > 0) && (clarion_find_field(cl, p, len) == i))
+		field = i;
+	    }
+
+	  if (field != i)
+	    continue;
+	}
+
+      c = &t->col[t->ncols++];
+      c->clfd = &clfd[i];
+      c->offset = clarion_field_offset(cl, i);
+      c->fldtype = clfd[i].fldtype;
+      strcpy(c->name, clarion_field_name(&clfd[i], buf));
+
+      bits = (uint64_t)cl->clm.clh->numrecs * CL_BLOOM_BITS;
+      c->nblocks = (bits + CL_BLOOM_BLOCK * 8 - 1) / (CL_BLOOM_BLOCK * 8);
+      if (c->nblocks == 0)
+	c->nblocks = 1;
+
+      c->bits = (uint64_t *) CL_CALLOC(c->nblocks, CL_BLOOM_BLOCK);
+
+      if (c->bits == NULL)
+	return -1;
+    }
+
+  return 0;
+}
+
+/* Opens the table, reads its descriptors and adds all of its records to the filters */
+static void
+clarion_bloom_one (ClarionBloomJob *job, ClarionBloomBuild *t)
+{
+  ClarionHandle cl;
+  ClarionHeader *clh;
+  ClarionBloomColumn *c;
+  ClarionValue v;
+  struct stat st;
+  uint8_t *batch = NULL;
+  uint8_t *rec;
+  uint32_t perbatch;
+  uint32_t first;
+  uint32_t got;
+  uint32_t n;
+  uint32_t i;
+  size_t datalen = 5;
+  int f;
+
+  memset(&cl, 0, sizeof(ClarionHandle));
+  cl.opts = job->cl->opts & ~CL_OPT_DECRYPT_READ;
+  cl.decmode = job->cl->decmode;
+  cl.datfile = t->file;
+
+  cl.data = fopen(t->file, "rb");
+  if (cl.data == NULL)
+    {
+      fprintf(stderr, "Couldn't open file %s !\n", t->file);
+      return;
+    }
+
+  if (fstat(fileno(cl.data), &st) == 0)
+    {
+      t->datsize = st.st_size;
+      t->datmtime = clarion_bloom_mtime(&st);
+    }
+
+  if (clarion_read_header(&cl) != 0)
+    goto invalid;
+
+  clh = cl.clm.clh;
+
+  if (clh->sfatr & CL_RECORDS_ENCRYPTED)
+    {
+      if (cl.decmode == 0)
+	cl.decmode = clarion_find_key(&cl);
+
+      if ((cl.decmode <= 0) || (clarion_decrypt_meta_load(&cl) != 0))
+	{
+	  fprintf(stderr, "%s: couldn't find out the key location, left out\n", t->file);
+	  goto out;
+	}
+
+      cl.opts |= CL_OPT_DECRYPT_READ;
+      clh = cl.clm.clh;
+    }
+  else if ((clh->offset < 85) || (clarion_load_meta(&cl, clh->offset) != 0))
+    goto invalid;
+
+  if ((clarion_read_field_desc(&cl) != 0) || (clh->reclen == 0))
+    goto invalid;
+
+  t->numrecs = clh->numrecs;
+
+  if (clarion_bloom_columns(&cl, t, job->columns) < 0)
+    goto nomem;
+
+  for (f = 0; f < clh->numflds; f++)
+    {
+      if (cl.clm.clfd[f].fldtype != CL_FIELD_GROUP)
+	datalen += cl.clm.clfd[f].length;
+    }
+
+  perbatch = (clh->reclen < 256 * 1024) ? (256 * 1024) / clh->reclen : 1;
+  batch = (uint8_t *) CL_CALLOC(1, (size_t)perbatch * clh->reclen + ((datalen > clh->reclen) ? datalen - clh->reclen : 0) + 1);
+
+  if (batch == NULL)
+    goto nomem;
+
+  CL_SET_PHASE(CL_PHASE_DATA);
+
+  for (first = 0; (t->ncols > 0) && (first < clh->numrecs); first += n)
+    {
+      n = clh->numrecs - first;
+      if (n > perbatch)
+	n = perbatch;
+
+      got = clarion_read_batch(&cl, batch, first, n);
+
+      for (i = 0; i < got; i++)
+	{
+	  rec = batch + (size_t)i * clh->reclen + 5;
+
+	  for (f = 0, c = t->col; f < t->ncols; f++, c++)
+	    {
+	      clarion_field_value(c->clfd, rec + c->offset, &v);
+
+	      if (v.type != CL_VALUE_NULL)
+		clarion_bloom_add(c->bits, c->nblocks, clarion_value_hash(c->clfd, &v));
+	    }
+	}
+
+      CL_STAT(scanned, got);
+
+      if (got < n)
+	break;
+    }
+
+  t->ok = 1;
+  goto out;
+
+ nomem:
+  fprintf(stderr, "Out of memory\n");
+  goto out;
+
+ invalid:
+  fprintf(stderr, "%s: invalid data file, left out\n", t->file);
+
+ out:
+  fclose(cl.data);
+  free(cl.meta);
+  free(batch);
+  clarion_arena_free(&cl.arena);
+}
+
+static void *
+clarion_bloom_worker (void *arg)
+{
+  ClarionBloomJob *job = (ClarionBloomJob *)arg;
+  int i;
+
+  while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->ntables)
+    clarion_bloom_one(job, &job->tables[i]);
+
+  clarion_stats_merge();
+
+  return NULL;
+}
+
+static int
+clarion_cmp_bloom (const void *a, const void *b)
+{
+  return strcmp(((const ClarionBloomBuild *)a)->file, ((const ClarionBloomBuild *)b)->file);
+}
+
+/* Writes the filters of the tables that could be read to path, aside first */
+static int
+clarion_bloom_write (const char *path, ClarionBloomBuild *tables, int ntables)
+{
+  static const uint8_t zero[CL_BLOOM_BLOCK];
+  ClarionBloomHeader hdr;
+  ClarionBloomTable bt;
+  ClarionBloomFilter bf;
+  ClarionBloomBuild *t;
+  uint64_t offset;
+  uint32_t name;
+  char *real;
+  char *tmp;
+  FILE *fp;
+  mode_t mask;
+  int ret;
+  int fd;
+  int i, j;
+
+  memset(&hdr, 0, sizeof(ClarionBloomHeader));
+  memcpy(hdr.magic, CL_BLOOM_MAGIC, 8);
+  hdr.version = CL_BLOOM_VERSION;
+
+  /* Real paths, so the catalog can be queried from anywhere */
+  for (i = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      if (!t->ok)
+	continue;
+
+      real = realpath(t->file, NULL);
+      if (real != NULL)
+	{
+	  free(t->file);
+	  t->file = real;
+	}
+
+      hdr.ntables++;
+      hdr.nfilters += t->ncols;
+      hdr.strsize += strlen(t->file) + 1;
+
+      for (j = 0; j < t->ncols; j++)
+	hdr.strsize += strlen(t->col[j].name) + 1;
+    }
+
+  tmp = (char *) CL_MALLOC(strlen(path) + 8);
+  if (tmp == NULL)
+    return -1;
+
+  sprintf(tmp, "%s.XXXXXX", path);
+
+  fd = mkstemp(tmp);
+  if (fd < 0)
+    {
+      free(tmp);
+      return -1;
+    }
+
+  mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+
+  fp = fdopen(fd, "wb");
+  if (fp == NULL)
+    {
+      close(fd);
+      unlink(tmp);
+      free(tmp);
+      return -1;
+    }
+
+  fwrite(&hdr, sizeof(ClarionBloomHeader), 1, fp);
+
+  /* Tables, then filters, names, and the blocks aligned on a block */
+  name = 0;
+  for (i = 0, j = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      if (!t->ok)
+	continue;
+
+      memset(&bt, 0, sizeof(ClarionBloomTable));
+      bt.datsize = t->datsize;
+      bt.datmtime = t->datmtime;
+      bt.name = name;
+      bt.numrecs = t->numrecs;
+      bt.first = j;
+      bt.count = t->ncols;
+      fwrite(&bt, sizeof(ClarionBloomTable), 1, fp);
+
+      name += strlen(t->file) + 1;
+      for (j = bt.first; j < bt.first + t->ncols; j++)
+	name += strlen(t->col[j - bt.first].name) + 1;
+    }
+
+  offset = sizeof(ClarionBloomHeader) + (uint64_t)hdr.ntables * sizeof(ClarionBloomTable)
+    + (uint64_t)hdr.nfilters * sizeof(ClarionBloomFilter) + hdr.strsize;
+  offset = (offset + CL_BLOOM_BLOCK - 1) & ~(uint64_t)(CL_BLOOM_BLOCK - 1);
+
+  name = 0;
+  for (i = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      if (!t->ok)
+	continue;
+
+      name += strlen(t->file) + 1;
+
+      for (j = 0; j < t->ncols; j++)
+	{
+	  memset(&bf, 0, sizeof(ClarionBloomFilter));
+	  bf.offset = offset;
+	  bf.nblocks = t->col[j].nblocks;
+	  bf.name = name;
+	  bf.fldtype = t->col[j].fldtype;
+	  fwrite(&bf, sizeof(ClarionBloomFilter), 1, fp);
+
+	  name += strlen(t->col[j].name) + 1;
+	  offset += (uint64_t)bf.nblocks * CL_BLOOM_BLOCK;
+	}
+    }
+
+  for (i = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      if (!t->ok)
+	continue;
+
+      fwrite(t->file, 1, strlen(t->file) + 1, fp);
+
+      for (j = 0; j < t->ncols; j++)
+	fwrite(t->col[j].name, 1, strlen(t->col[j].name) + 1, fp);
+    }
+
+  offset = sizeof(ClarionBloomHeader) + (uint64_t)hdr.ntables * sizeof(ClarionBloomTable)
+    + (uint64_t)hdr.nfilters * sizeof(ClarionBloomFilter) + hdr.strsize;
+  fwrite(zero, 1, ((offset + CL_BLOOM_BLOCK - 1) & ~(uint64_t)(CL_BLOOM_BLOCK - 1)) - offset, fp);
+
+  for (i = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      for (j = 0; t->ok && (j < t->ncols); j++)
+	fwrite(t->col[j].bits, CL_BLOOM_BLOCK, t->col[j].nblocks, fp);
+    }
+
+  ret = ferror(fp) ? -1 : 0;
+
+  if ((fclose(fp) != 0) || (ret < 0) || (rename(tmp, path) < 0))
+    {
+      unlink(tmp);
+      ret = -1;
+    }
+
+  free(tmp);
+
+  return ret;
+}
+
+static char *
+clarion_bloom_path (const char *dir)
+{
+  char *path = (char *) CL_MALLOC(strlen(dir) + sizeof(CL_BLOOM_CATALOG) + 1);
+
+  if (path != NULL)
+    sprintf(path, "%s/%s", dir, CL_BLOOM_CATALOG);
+
+  return path;
+}
+
+/*
+ * Builds the catalog of the .DAT files in paths[0], a directory, and of
+ * the other files and directories given, into paths[0]. columns is the
+ * comma-separated list of the fields to add, NULL for all. Returns -1
+ * if any of the tables couldn't be read.
+ */
+int
+clarion_bloom_build (ClarionHandle *cl, char **paths, int npaths, const char *columns)
+{
+  ClarionBloomJob job;
+  pthread_t *tids;
+  struct stat st;
+  char **files = NULL;
+  char *path;
+  int nfiles = 0;
+  int nthreads;
+  int started;
+  int ret = 0;
+  int i, j;
+
+  if ((stat(paths[0], &st) < 0) || !S_ISDIR(st.st_mode))
+    {
+      fprintf(stderr, "%s is not a directory\n", paths[0]);
+      return -1;
+    }
+
+  for (i = 0; i < npaths; i++)
+    {
+      if (clarion_collect_files(paths[i], &files, &nfiles) < 0)
+	ret = -1;
+    }
+
+  memset(&job, 0, sizeof(ClarionBloomJob));
+  job.cl = cl;
+  job.columns = columns;
+  job.ntables = nfiles;
+  job.tables = (ClarionBloomBuild *) calloc((nfiles > 0) ? nfiles : 1, sizeof(ClarionBloomBuild));
+  path = clarion_bloom_path(paths[0]);
+
+  if ((job.tables == NULL) || (path == NULL))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (i = 0; i < nfiles; i++)
+    job.tables[i].file = files[i];
+  free(files);
+
+  nthreads = (cl->jobs < nfiles) ? cl->jobs : nfiles;
+
+  tids = (pthread_t *) malloc(((nthreads > 0) ? nthreads : 1) * sizeof(pthread_t));
+
+  for (started = 1; (tids != NULL) && (started < nthreads); started++)
+    {
+      if (pthread_create(&tids[started], NULL, clarion_bloom_worker, &job) != 0)
+	break;
+    }
+
+  clarion_bloom_worker(&job);
+
+  for (i = 1; (tids != NULL) && (i < started); i++)
+    pthread_join(tids[i], NULL);
+
+  free(tids);
+
+  qsort(job.tables, nfiles, sizeof(ClarionBloomBuild), clarion_cmp_bloom);
+
+  if (clarion_bloom_write(path, job.tables, nfiles) < 0)
+    {
+      fprintf(stderr, "Couldn't write catalog %s\n", path);
+      ret = -1;
+    }
+
+  for (i = 0; i < nfiles; i++)
+    {
+      if (!job.tables[i].ok)
+	ret = -1;
+
+      for (j = 0; j < job.tables[i].ncols; j++)
+	free(job.tables[i].col[j].bits);
+
+      free(job.tables[i].col);
+      free(job.tables[i].file);
+    }
+
+  free(job.tables);
+  free(path);
+
+  return ret;
+}
+
+/* Prints a candidate as file;field */
+static void
+clarion_bloom_candidate (ClarionHandle *cl, ClarionOutput *out, const char *file, const char *field)
+{
+  unsigned int flags;
+
+  clarion_scan((const uint8_t *)file, strlen(file), cl->fsep, &flags);
+  clarion_csv_write(out, (const uint8_t *)file, strlen(file), flags);
+  clarion_out_putc(out, cl->fsep);
+  clarion_out_puts(out, field);
+  clarion_csv_eol(cl, out);
+}
+
+/*
+ * Lists the tables and fields of the catalog at path, or in path if it
+ * is a directory, whose filters may hold value. Tables that changed
+ * since the catalog was built are listed whatever their filters say.
+ * Returns the number of candidates, -1 on error.
+ */
+int
+clarion_bloom_query (ClarionHandle *cl, const char *path, const char *value)
+{
+  ClarionBloomHeader hdr;
+  const ClarionBloomTable *bt;
+  const ClarionBloomFilter *bf;
+  ClarionFieldDesc clfd;
+  ClarionOutput out;
+  ClarionValue v;
+  struct stat st;
+  const char *names;
+  const char *file;
+  uint8_t *map;
+  uint64_t size;
+  char *catalog;
+  char *lit;
+  uint64_t need;
+  uint32_t i, j;
+  int stale;
+  int count = 0;
+  int fd;
+
+  if ((stat(path, &st) == 0) && S_ISDIR(st.st_mode))
+    catalog = clarion_bloom_path(path);
+  else
+    catalog = strdup(path);
+
+  lit = strdup(value);
+
+  if ((catalog == NULL) || (lit == NULL) || (clarion_out_init(&out, STDOUT_FILENO, 64 * 1024) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  fd = open(catalog, O_RDONLY);
+
+  if ((fd < 0) || (fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(ClarionBloomHeader)))
+    goto invalid;
+
+  size = st.st_size;
+  map = (uint8_t *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  fd = -1;
+
+  if (map == MAP_FAILED)
+    goto invalid;
+
+  memcpy(&hdr, map, sizeof(ClarionBloomHeader));
+
+  need = sizeof(ClarionBloomHeader) + (uint64_t)hdr.ntables * sizeof(ClarionBloomTable)
+    + (uint64_t)hdr.nfilters * sizeof(ClarionBloomFilter) + hdr.strsize;
+
+  if ((memcmp(hdr.magic, CL_BLOOM_MAGIC, 8) != 0) || (hdr.version != CL_BLOOM_VERSION)
+      || (need > size) || ((hdr.strsize > 0) && (map[need - 1] != '\0')))
+    {
+      munmap(map, size);
+      goto invalid;
+    }
+
+  bt = (const ClarionBloomTable *)(map + sizeof(ClarionBloomHeader));
+  bf = (const ClarionBloomFilter *)(bt + hdr.ntables);
+  names = (const char *)(bf + hdr.nfilters);
+
+  if (cl->opts & CL_OPT_CSV_HEADER)
+    {
+      clarion_out_printf(&out, "file%cfield", cl->fsep);
+      clarion_csv_eol(cl, &out);
+    }
+
+  /* The value as the filters of each field type hashed it */
+  memset(&clfd, 0, sizeof(ClarionFieldDesc));
+
+  for (i = 0; i < hdr.ntables; i++, bt++)
+    {
+      if ((bt->name >= hdr.strsize) || ((uint64_t)bt->first + bt->count > hdr.nfilters))
+	continue;
+
+      file = names + bt->name;
+
+      stale = (stat(file, &st) < 0) || ((uint64_t)st.st_size != bt->datsize)
+	|| (clarion_bloom_mtime(&st) != bt->datmtime);
+
+      if (stale)
+	fprintf(stderr, "%s changed since the catalog was built, check all of its fields\n", file);
+
+      for (j = bt->first; j < bt->first + bt->count; j++)
+	{
+	  if ((bf[j].name >= hdr.strsize) || (bf[j].nblocks == 0) || (bf[j].offset % CL_BLOOM_BLOCK)
+	      || (bf[j].offset + (uint64_t)bf[j].nblocks * CL_BLOOM_BLOCK > size))
+	    continue;
+
+	  if (!stale)
+	    {
+	      clfd.fldtype = bf[j].fldtype;
+
+	      if (clarion_value_parse(&clfd, lit, &v) < 0)
+		continue;
+
+	      if (!clarion_bloom_test((const uint64_t *)(map + bf[j].offset), bf[j].nblocks,
+				      clarion_value_hash(&clfd, &v)))
+		continue;
+	    }
+
+	  clarion_bloom_candidate(cl, &out, file, names + bf[j].name);
+	  count++;
+	}
+    }
+
+  clarion_out_free(&out);
+  munmap(map, size);
+  free(catalog);
+  free(lit);
+
+  return count;
+
+ invalid:
+  if (fd >= 0)
+    close(fd);
+
+  fprintf(stderr, "%s is not a catalog built by --bloom-build\n", catalog);
+  clarion_out_free(&out);
+  free(catalog);
+  free(lit);
+
+  return -1;
+}
@@ -0,0 +1,831 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cldump.h"
+
+/*
+ * Columnar cache for --cache
+ *
+ * A table is converted once into DIR/<file>-<hash>.cache: the record
+ * headers, one column per field, then the memo entries put together from
+ * their block chains. Numeric fields are kept as found in the record,
+ * fixed width; strings and memo entries are stored as numrecs + 1
+ * offsets followed by the data, strings without their trailing spaces.
+ * The cache is mapped and records are put back together from it by
+ * clarion_read_batch(), with only the fields used by --columns,
+ * --where and --aggregate filled in, so the output formats run unchanged
+ * and only the columns needed are paged in.
+ *
+ * The cache is keyed on the size and modification time of the data and
+ * memo files, on the change date and time and the number of records of
+ * the header and on the decryption key; a stale cache is rebuilt.
+ */
+
+#define CL_CACHE_MAGIC           "CLDCACHE"
+#define CL_CACHE_VERSION         1
+
+#define CL_CACHE_MEMO            (1 << 0) /* memo entries are in */
+#define CL_CACHE_DECRYPTED       (1 << 1) /* records were decrypted with key */
+
+#define CL_CACHE_CHUNK           (32 * 1024) /* bytes of a column kept in memory while building */
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t datsize;
+  int64_t datmtime; /* ns */
+  uint64_t memsize;
+  int64_t memmtime; /* ns */
+  uint32_t numrecs;
+  uint32_t chgdate;
+  uint32_t chgtime;
+  uint32_t count; /* records in the cache, fewer than numrecs for a short data file */
+  uint16_t reclen;
+  uint16_t numflds;
+  uint8_t key[2];
+  uint8_t pad[2];
+} ClarionCacheHeader;
+
+typedef struct {
+  uint64_t offset; /* from the start of the cache, 0 for groups */
+  uint32_t width; /* bytes per record, 0 for offsets and data */
+  uint32_t pad;
+} ClarionCacheColumn;
+
+struct ClarionCache {
+  uint8_t *map;
+  size_t maplen;
+  uint32_t count;
+  ClarionCacheColumn *col; /* record headers, fields, memo */
+};
+
+/*
+ * A column stream being built: it is written to the scratch file by
+ * chunks as it fills up, only the last one is kept in memory.
+ */
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  uint64_t total;
+  uint64_t *chunks; /* offsets in the scratch file */
+  uint32_t nchunks;
+  uint32_t size;
+} ClarionCacheStream;
+
+/* A column being built */
+typedef struct {
+  ClarionCacheStream data;
+  ClarionCacheStream offs; /* count + 1 offsets into data, variable width columns only */
+  int var;
+} ClarionCacheBuild;
+
+/* The scratch file where the column chunks go, and how far it goes */
+typedef struct {
+  int fd;
+  uint64_t end;
+} ClarionCacheScratch;
+
+
+static int
+clarion_cache_string (ClarionFieldDesc *clfd)
+{
+  return (clfd->fldtype == CL_FIELD_STRING) || (clfd->fldtype == CL_FIELD_STRING_PIC_TOK);
+}
+
+static int64_t
+clarion_cache_mtime (struct stat *st)
+{
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/* Fills in what a valid cache of the table must have in its header */
+static int
+clarion_cache_key (ClarionHandle *cl, ClarionCacheHeader *key)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  struct stat st;
+  char *memfile;
+
+  memset(key, 0, sizeof(ClarionCacheHeader));
+  memcpy(key->magic, CL_CACHE_MAGIC, 8);
+  key->version = CL_CACHE_VERSION;
+
+  if (fstat(fileno(cl->data), &st) < 0)
+    return -1;
+
+  key->datsize = st.st_size;
+  key->datmtime = clarion_cache_mtime(&st);
+
+  if (clh->sfatr & CL_MEMO_FILE_EXISTS)
+    {
+      memfile = strdup(cl->datfile);
+      if (memfile == NULL)
+	return -1;
+
+      memcpy(memfile + strlen(memfile) - 3, "MEM", 3);
+
+      if (stat(memfile, &st) == 0)
+	{
+	  key->memsize = st.st_size;
+	  key->memmtime = clarion_cache_mtime(&st);
+	}
+
+      free(memfile);
+    }
+
+  key->numrecs = clh->numrecs;
+  key->chgdate = clh->chgdate;
+  key->chgtime = clh->chgtime;
+  key->reclen = clh->reclen;
+  key->numflds = clh->numflds;
+
+  if (cl->opts & CL_OPT_DECRYPT_READ)
+    {
+      key->flags |= CL_CACHE_DECRYPTED;
+      memcpy(key->key, cl->key, 2);
+    }
+
+  return 0;
+}
+
+static int
+clarion_cache_append (ClarionCacheScratch *sc, ClarionCacheStream *cs, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  uint64_t *tmp;
+  ssize_t ret;
+  size_t room;
+  size_t done;
+
+  while (len > 0)
+    {
+      if (cs->buf == NULL)
+	{
+	  cs->buf = (uint8_t *) CL_MALLOC(CL_CACHE_CHUNK);
+	  if (cs->buf == NULL)
+	    return -1;
+	}
+
+      room = CL_CACHE_CHUNK - cs->len;
+      if (room > len)
+	room = len;
+
+      memcpy(cs->buf + cs->len, p, room);
+      cs->len += room;
+      cs->total += room;
+      p += room;
+      len -= room;
+
+      if (cs->len < CL_CACHE_CHUNK)
+	break;
+
+      /* Full, out to the scratch file */
+      if (cs->nchunks == cs->size)
+	{
+	  tmp = (uint64_t *) CL_REALLOC(cs->chunks, ((cs->size > 0) ? cs->size * 2 : 16) * sizeof(uint64_t));
+	  if (tmp == NULL)
+	    return -1;
+
+	  cs->chunks = tmp;
+	  cs->size = (cs->size > 0) ? cs->size * 2 : 16;
+	}
+
+      for (done = 0; done < CL_CACHE_CHUNK; done += ret)
+	{
+	  ret = pwrite(sc->fd, cs->buf + done, CL_CACHE_CHUNK - done, sc->end + done);
+
+	  if ((ret < 0) && (errno == EINTR))
+	    ret = 0;
+	  else if (ret < 0)
+	    return -1;
+	}
+
+      cs->chunks[cs->nchunks++] = sc->end;
+      sc->end += CL_CACHE_CHUNK;
+      cs->len = 0;
+    }
+
+  return 0;
+}
+
+/* Copies a stream to fp, its chunks back from the scratch file through buf */
+static int
+clarion_cache_copy (FILE *fp, ClarionCacheScratch *sc, ClarionCacheStream *cs, uint8_t *buf)
+{
+  ssize_t ret;
+  size_t done;
+  uint32_t i;
+
+  for (i = 0; i < cs->nchunks; i++)
+    {
+      for (done = 0; done < CL_CACHE_CHUNK; done += ret)
+	{
+	  ret = pread(sc->fd, buf + done, CL_CACHE_CHUNK - done, cs->chunks[i] + done);
+
+	  if ((ret < 0) && (errno == EINTR))
+	    ret = 0;
+	  else if (ret <= 0)
+	    return -1;
+	}
+
+      fwrite(buf, 1, CL_CACHE_CHUNK, fp);
+    }
+
+  if (cs->len > 0)
+    fwrite(cs->buf, 1, cs->len, fp);
+
+  return 0;
+}
+
+/* Writes the columns out, returns -1 on error */
+static int
+clarion_cache_write (FILE *fp, ClarionCacheHeader *hdr, ClarionCacheScratch *sc, ClarionCacheBuild *cb,
+		     int ncols, ClarionCacheColumn *col)
+{
+  static const uint8_t zero[8];
+  uint8_t *buf;
+  uint64_t pos;
+  uint64_t len;
+  int ret = 0;
+  int c;
+
+  buf = (uint8_t *) CL_MALLOC(CL_CACHE_CHUNK);
+  if (buf == NULL)
+    return -1;
+
+  pos = sizeof(ClarionCacheHeader) + ncols * sizeof(ClarionCacheColumn);
+
+  for (c = 0; c < ncols; c++)
+    {
+      if ((col[c].width == 0) && !cb[c].var)
+	continue;
+
+      col[c].offset = pos;
+      len = cb[c].offs.total + cb[c].data.total;
+      pos += (len + 7) & ~7;
+    }
+
+  fwrite(hdr, sizeof(ClarionCacheHeader), 1, fp);
+  fwrite(col, sizeof(ClarionCacheColumn), ncols, fp);
+
+  for (c = 0; (c < ncols) && (ret == 0); c++)
+    {
+      if (col[c].offset == 0)
+	continue;
+
+      len = cb[c].offs.total + cb[c].data.total;
+
+      if ((clarion_cache_copy(fp, sc, &cb[c].offs, buf) < 0) || (clarion_cache_copy(fp, sc, &cb[c].data, buf) < 0))
+	ret = -1;
+
+      fwrite(zero, 1, ((len + 7) & ~7) - len, fp);
+    }
+
+  free(buf);
+
+  return (ferror(fp) || (ret < 0)) ? -1 : 0;
+}
+
+/*
+ * Reads the whole table into columns and writes them to path. The
+ * columns are spilled by chunks to a scratch file next to the cache as
+ * they grow, then copied one after the other into the cache, so the
+ * memory used doesn't depend on the size of the table.
+ */
+static int
+clarion_cache_build (ClarionHandle *cl, const char *path, const ClarionCacheHeader *key)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  int ncols = clh->numflds + 2;
+  ClarionCacheHeader hdr = *key;
+  ClarionCacheScratch sc;
+  ClarionCacheBuild *cb;
+  ClarionCacheBuild *cbm;
+  ClarionCacheColumn *col;
+  ClarionRecordHeader clrh;
+  uint8_t *batch;
+  uint8_t *rec;
+  uint8_t *data;
+  uint8_t *memo;
+  uint64_t off = 0;
+  uint32_t perbatch;
+  uint32_t first;
+  uint32_t got;
+  uint32_t n;
+  uint32_t i;
+  size_t datalen = 5;
+  char *tmp;
+  FILE *fp;
+  mode_t mask;
+  int memopen = 0;
+  int ret = -1;
+  int len;
+  int f;
+  int fd;
+
+  sc.fd = -1;
+  sc.end = 0;
+
+  cb = (ClarionCacheBuild *) CL_CALLOC(ncols, sizeof(ClarionCacheBuild));
+  col = (ClarionCacheColumn *) CL_CALLOC(ncols, sizeof(ClarionCacheColumn));
+  tmp = (char *) CL_MALLOC(strlen(path) + 8);
+
+  for (f = 0; f < clh->numflds; f++)
+    {
+      if (clfd[f].fldtype == CL_FIELD_GROUP)
+	continue;
+
+      datalen += clfd[f].length;
+    }
+
+  perbatch = (clh->reclen < 256 * 1024) ? (256 * 1024) / clh->reclen : 1;
+  batch = (uint8_t *) CL_CALLOC(1, (size_t)perbatch * clh->reclen + ((datalen > clh->reclen) ? datalen - clh->reclen : 0) + 1);
+
+  if ((cb == NULL) || (col == NULL) || (tmp == NULL) || (batch == NULL))
+    goto out;
+
+  /* Gone once closed */
+  sprintf(tmp, "%s.XXXXXX", path);
+
+  sc.fd = mkstemp(tmp);
+  if (sc.fd < 0)
+    goto out;
+
+  unlink(tmp);
+
+  col[0].width = 5;
+
+  for (f = 0; f < clh->numflds; f++)
+    {
+      if (clfd[f].fldtype == CL_FIELD_GROUP)
+	continue;
+
+      if (clarion_cache_string(&clfd[f]))
+	{
+	  cb[1 + f].var = 1;
+
+	  if (clarion_cache_append(&sc, &cb[1 + f].offs, &off, sizeof(uint64_t)) < 0)
+	    goto out;
+	}
+      else
+	col[1 + f].width = clfd[f].length;
+    }
+
+  /* Memo entries go in whatever the options, for the next runs */
+  cbm = &cb[ncols - 1];
+
+  if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (cl->memo == NULL) && (clarion_open_memo(cl) == 0))
+    memopen = 1;
+
+  if (cl->memo != NULL)
+    {
+      hdr.flags |= CL_CACHE_MEMO;
+      cbm->var = 1;
+
+      if (clarion_cache_append(&sc, &cbm->offs, &off, sizeof(uint64_t)) < 0)
+	goto out;
+    }
+
+  hdr.count = 0;
+
+  for (first = 0; first < clh->numrecs; first += n)
+    {
+      n = clh->numrecs - first;
+      if (n > perbatch)
+	n = perbatch;
+
+      got = clarion_read_batch(cl, batch, first, n);
+
+      for (i = 0; i < got; i++, hdr.count++)
+	{
+	  rec = batch + (size_t)i * clh->reclen;
+
+	  if (clarion_cache_append(&sc, &cb[0].data, rec, 5) < 0)
+	    goto out;
+
+	  data = rec + 5;
+
+	  for (f = 0; f < clh->numflds; f++)
+	    {
+	      if (clfd[f].fldtype == CL_FIELD_GROUP)
+		continue;
+
+	      len = clfd[f].length;
+
+	      if (cb[1 + f].var)
+		{
+		  while ((len > 0) && (data[len - 1] == ' '))
+		    len--;
+		}
+
+	      if (clarion_cache_append(&sc, &cb[1 + f].data, data, len) < 0)
+		goto out;
+
+	      if (cb[1 + f].var && (clarion_cache_append(&sc, &cb[1 + f].offs, &cb[1 + f].data.total, sizeof(uint64_t)) < 0))
+		goto out;
+
+	      data += clfd[f].length;
+	    }
+
+	  if (cl->memo == NULL)
+	    continue;
+
+	  clrh.rhd = rec[0];
+	  memcpy(&clrh.rptr, rec + 1, 4);
+	  clrh.rptr = le32toh(clrh.rptr);
+	  clrh.recno = first + i;
+
+	  CL_SET_PHASE(CL_PHASE_MEMO);
+	  len = clarion_read_memo(cl, &clrh, &memo);
+	  CL_SET_PHASE(CL_PHASE_DATA);
+
+	  /* NUL-terminated as they come from clarion_read_memo(), none for no memo */
+	  if ((len >= 0) && (clarion_cache_append(&sc, &cbm->data, memo, len + 1) < 0))
+	    goto out;
+
+	  if (clarion_cache_append(&sc, &cbm->offs, &cbm->data.total, sizeof(uint64_t)) < 0)
+	    goto out;
+	}
+
+      if (got < n)
+	break;
+    }
+
+  /* Written aside and renamed over, a concurrent run sees either cache whole */
+  sprintf(tmp, "%s.XXXXXX", path);
+
+  fd = mkstemp(tmp);
+  if (fd < 0)
+    goto out;
+
+  mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+
+  fp = fdopen(fd, "wb");
+  if (fp == NULL)
+    {
+      close(fd);
+      unlink(tmp);
+      goto out;
+    }
+
+  ret = clarion_cache_write(fp, &hdr, &sc, cb, ncols, col);
+
+  if ((fclose(fp) != 0) || (ret < 0) || (rename(tmp, path) < 0))
+    {
+      unlink(tmp);
+      ret = -1;
+    }
+
+ out:
+  if (memopen)
+    {
+      fclose(cl->memo);
+      cl->memo = NULL;
+      free(cl->memfile);
+      cl->memfile = NULL;
+    }
+
+  if (sc.fd >= 0)
+    close(sc.fd);
+
+  for (f = 0; (cb != NULL) && (f < ncols); f++)
+    {
+      free(cb[f].data.buf);
+      free(cb[f].data.chunks);
+      free(cb[f].offs.buf);
+      free(cb[f].offs.chunks);
+    }
+
+  free(cb);
+  free(col);
+  free(tmp);
+  free(batch);
+
+  return ret;
+}
+
+/*
+ * Checks the offsets of a variable width column: from 0 up, entries no
+ * longer than max, memo entries (max of INT_MAX) with their NUL
+ */
+static int
+clarion_cache_check_offsets (const uint64_t *offs, uint32_t count, uint64_t max, const uint8_t *data)
+{
+  uint32_t i;
+
+  if (offs[0] != 0)
+    return -1;
+
+  for (i = 0; i < count; i++)
+    {
+      if ((offs[i + 1] < offs[i]) || (offs[i + 1] - offs[i] > max))
+	return -1;
+
+      if ((max == INT_MAX) && (offs[i + 1] > offs[i]) && (data[offs[i + 1] - 1] != '\0'))
+	return -1;
+    }
+
+  return 0;
+}
+
+/* Checks that the columns are where they should be and hold count records */
+static int
+clarion_cache_check (ClarionHandle *cl, ClarionCache *cc)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  int ncols = cl->clm.clh->numflds + 2;
+  ClarionCacheColumn *col;
+  const uint64_t *offs;
+  uint64_t need;
+  int c;
+
+  for (c = 0; c < ncols; c++)
+    {
+      col = &cc->col[c];
+
+      if ((c > 0) && (c < ncols - 1) && (clfd[c - 1].fldtype == CL_FIELD_GROUP))
+	continue;
+
+      /* No memo column, memo entries were left out */
+      if ((c == ncols - 1) && (col->offset == 0))
+	continue;
+
+      if ((c > 0) && (c < ncols - 1) && (col->width != (clarion_cache_string(&clfd[c - 1]) ? 0 : clfd[c - 1].length)))
+	return -1;
+
+      if ((col->offset == 0) || (col->offset > cc->maplen))
+	return -1;
+
+      if (col->width != 0)
+	need = (uint64_t)col->width * cc->count;
+      else
+	{
+	  need = ((uint64_t)cc->count + 1) * sizeof(uint64_t);
+
+	  if ((col->offset + need > cc->maplen) || (col->offset & 7))
+	    return -1;
+
+	  need += ((uint64_t *)(cc->map + col->offset))[cc->count];
+	}
+
+      if (col->offset + need > cc->maplen)
+	return -1;
+
+      /* clarion_cache_read() and clarion_cache_memo() trust them */
+      if (col->width == 0)
+	{
+	  offs = (const uint64_t *)(cc->map + col->offset);
+
+	  if (clarion_cache_check_offsets(offs, cc->count, (c < ncols - 1) ? clfd[c - 1].length : INT_MAX,
+					  (const uint8_t *)(offs + cc->count + 1)) < 0)
+	    return -1;
+	}
+    }
+
+  return 0;
+}
+
+/* Maps the cache at path if it matches key, NULL otherwise */
+static ClarionCache *
+clarion_cache_map (ClarionHandle *cl, const char *path, const ClarionCacheHeader *key)
+{
+  int ncols = cl->clm.clh->numflds + 2;
+  ClarionCacheHeader hdr;
+  ClarionCache *cc;
+  struct stat st;
+  uint8_t *map;
+  int memo;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(ClarionCacheHeader) + ncols * sizeof(ClarionCacheColumn)))
+    {
+      close(fd);
+      return NULL;
+    }
+
+  map = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  memcpy(&hdr, map, sizeof(ClarionCacheHeader));
+
+  memo = hdr.flags & CL_CACHE_MEMO;
+  hdr.flags &= ~CL_CACHE_MEMO;
+  hdr.count = 0;
+
+  cc = (ClarionCache *) CL_MALLOC(sizeof(ClarionCache));
+
+  if ((cc == NULL) || (memcmp(&hdr, key, sizeof(ClarionCacheHeader)) != 0)
+      || (!memo && (cl->clm.clh->sfatr & CL_MEMO_FILE_EXISTS) && !(cl->opts & CL_OPT_NO_MEMO)))
+    goto stale;
+
+  cc->map = map;
+  cc->maplen = st.st_size;
+  cc->count = ((ClarionCacheHeader *)map)->count;
+  cc->col = (ClarionCacheColumn *)(map + sizeof(ClarionCacheHeader));
+
+  if ((cc->count > key->numrecs) || (clarion_cache_check(cl, cc) < 0))
+    goto stale;
+
+  return cc;
+
+ stale:
+  free(cc);
+  munmap(map, st.st_size);
+
+  return NULL;
+}
+
+/*
+ * Maps the cache of the table from dir, building it first if there is
+ * none or it is stale. Returns -1 if the data file is to be read after
+ * all.
+ */
+int
+clarion_cache_open (ClarionHandle *cl, const char *dir)
+{
+  ClarionCacheHeader key;
+  const char *base;
+  uint64_t t0;
+  char *real;
+  char *path;
+  uint64_t hash;
+
+  if ((clarion_cache_key(cl, &key) < 0) || (cl->clm.clh->reclen == 0))
+    return -1;
+
+  mkdir(dir, 0777);
+
+  /* Tables of the same name in different directories get their own cache */
+  base = strrchr(cl->datfile, '/');
+  base = (base != NULL) ? base + 1 : cl->datfile;
+
+  real = realpath(cl->datfile, NULL);
+  hash = clarion_fnv(CL_FNV_OFFSET, (real != NULL) ? real : cl->datfile,
+		     strlen((real != NULL) ? real : cl->datfile));
+  free(real);
+
+  path = (char *) CL_MALLOC(strlen(dir) + strlen(base) + 32);
+  if (path == NULL)
+    return -1;
+
+  sprintf(path, "%s/%s-%08x.cache", dir, base, (uint32_t)hash);
+
+  cl->cache = clarion_cache_map(cl, path, &key);
+
+  if (cl->cache == NULL)
+    {
+      t0 = CL_TRACE_BEGIN();
+
+      if (clarion_cache_build(cl, path, &key) == 0)
+	cl->cache = clarion_cache_map(cl, path, &key);
+
+      CL_TRACE_END("cache", "io", t0, "records", cl->clm.clh->numrecs);
+    }
+
+  if (cl->cache == NULL)
+    fprintf(stderr, "Couldn't build cache %s, reading the data file\n", path);
+
+  free(path);
+
+  return (cl->cache != NULL) ? 0 : -1;
+}
+
+/* Puts records [first, first + count) back together in buf, see clarion_read_batch() */
+uint32_t
+clarion_cache_read (ClarionHandle *cl, uint8_t *buf, uint32_t first, uint32_t count)
+{
+  ClarionCache *cc = cl->cache;
+  ClarionHeader *clh = cl->clm.clh;
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  ClarionCacheColumn *col;
+  const uint64_t *offs;
+  const uint8_t *src;
+  uint8_t *dst;
+  uint32_t avail;
+  uint32_t i;
+  size_t pos = 5;
+  size_t len;
+  int f;
+
+  avail = (first < cc->count) ? cc->count - first : 0;
+
+  if (count > avail)
+    {
+      fprintf(stderr, "EOF reached for DAT file\n");
+      count = avail;
+    }
+
+  src = cc->map + cc->col[0].offset + (size_t)first * 5;
+
+  for (i = 0; i < count; i++)
+    memcpy(buf + (size_t)i * clh->reclen, src + (size_t)i * 5, 5);
+
+  /* Column by column, each one is read sequentially */
+  for (f = 0; f < clh->numflds; f++)
+    {
+      if (clfd[f].fldtype == CL_FIELD_GROUP)
+	continue;
+
+      col = &cc->col[1 + f];
+
+      if ((cl->colread != NULL) && !cl->colread[f])
+	;
+      else if (col->width != 0)
+	{
+	  src = cc->map + col->offset + (size_t)first * col->width;
+
+	  for (i = 0; i < count; i++)
+	    memcpy(buf + (size_t)i * clh->reclen + pos, src + (size_t)i * col->width, col->width);
+	}
+      else
+	{
+	  offs = (const uint64_t *)(cc->map + col->offset) + first;
+	  src = cc->map + col->offset + ((size_t)cc->count + 1) * sizeof(uint64_t);
+
+	  for (i = 0; i < count; i++)
+	    {
+	      dst = buf + (size_t)i * clh->reclen + pos;
+	      len = offs[i + 1] - offs[i];
+
+	      memcpy(dst, src + offs[i], len);
+	      memset(dst + len, ' ', clfd[f].length - len);
+	    }
+	}
+
+      pos += clfd[f].length;
+    }
+
+  return count;
+}
+
+/* Memo entry of record recno, see clarion_read_memo() */
+int
+clarion_cache_memo (ClarionHandle *cl, uint32_t recno, uint8_t **memo)
+{
+  ClarionCache *cc = cl->cache;
+  ClarionCacheColumn *col = &cc->col[cl->clm.clh->numflds + 1];
+  const uint64_t *offs;
+
+  if ((col->offset == 0) || (recno >= cc->count))
+    return -1;
+
+  offs = (const uint64_t *)(cc->map + col->offset);
+
+  if (offs[recno + 1] == offs[recno])
+    return -1;
+
+  *memo = cc->map + col->offset + ((size_t)cc->count + 1) * sizeof(uint64_t) + offs[recno];
+
+  return offs[recno + 1] - offs[recno] - 1;
+}
+
+void
+clarion_cache_close (ClarionHandle *cl)
+{
+  if (cl->cache == NULL)
+    return;
+
+  munmap(cl->cache->map, cl->cache->maplen);
+  free(cl->cache);
+  cl->cache = NULL;
+}
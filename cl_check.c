@@ -0,0 +1,580 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cldump.h"
+
+/*
+ * Unique key check
+ *
+ * --check-keys looks for the records that would make the CREATE UNIQUE
+ * INDEX statements of the SQL schema fail, that is duplicates in the
+ * keys without CL_KEYTYPE_DUPSW. The key of a record is the tuple of
+ * the values of its key fields, the fields of a GROUP part included,
+ * decoded as in cl_where.c, so strings compare without their trailing
+ * spaces and case sensitively, as the SQL dump loads them. Tuples with
+ * a value the SQL dump writes as NULL (empty string, uninitialized
+ * REAL, zero DECIMAL without decimals) can't collide and are left out.
+ *
+ * Each key keeps an open addressing table of the 64-bit hashes of the
+ * tuples seen so far, with the record they came from, 12 bytes a slot.
+ * When a hash is found again, both records are read back and their
+ * tuples compared for real, so a hash collision never passes for a
+ * duplicate. The slots are random accesses to tables too large for the
+ * CPU caches, so the hashes wait in a short queue once their slot was
+ * prefetched, and the misses of consecutive records overlap.
+ *
+ * The check is run on the records the record driver hands to the output
+ * format (see clarion_dump_batch()), in the same scan as the dump. With
+ * more than one job, the decoding thread only copies the key fields of
+ * each record into chunks handed to a thread of its own through a pair
+ * of rings, as in the pipeline, so the dump doesn't wait for the hash
+ * tables; that thread reads records back with pread() when it needs to.
+ * Without a data dump, clarion_check_scan() runs it on its own.
+ */
+
+#define CL_CHECK_AHEAD           16 /* queued hashes */
+#define CL_CHECK_CHUNK           4096 /* records handed to the check thread at once */
+
+typedef struct {
+  ClarionFieldDesc *clfd;
+  int offset;
+} ClarionCheckPart;
+
+typedef struct {
+  uint64_t hash; /* 0 for an empty slot */
+  uint32_t recno;
+} __attribute__ ((packed)) ClarionCheckSlot;
+
+typedef struct {
+  ClarionKeyDesc *clk;
+  int nparts;
+  ClarionCheckPart *part;
+  ClarionCheckSlot *slot;
+  uint32_t size; /* power of 2 */
+  uint32_t used;
+  uint64_t dups;
+} ClarionCheckKey;
+
+typedef struct {
+  ClarionCheckKey *k;
+  uint64_t hash;
+  uint32_t recno;
+} ClarionCheckPending;
+
+typedef struct {
+  uint32_t count; /* 0 at end of data */
+  uint32_t *recno;
+  uint8_t *data; /* datalen bytes a record */
+} ClarionCheckChunk;
+
+struct ClarionCheck {
+  int nkeys;
+  ClarionCheckKey *key;
+  ClarionCheckPending pending[CL_CHECK_AHEAD];
+  int head; /* oldest queued hash */
+  int count;
+  uint8_t *tuple;
+  uint8_t *other;
+  uint8_t *rec; /* record read back */
+
+  /* Check thread, with more than one job */
+  int threaded;
+  int started;
+  size_t datalen; /* record bytes up to the end of the last key field */
+  ClarionRing free;
+  ClarionRing full;
+  ClarionCheckChunk chunk[CL_RING_SIZE];
+  ClarionCheckChunk *cur; /* being filled by the decoding thread */
+  ClarionHandle *cl;
+  pthread_t thread;
+};
+
+
+/* Allocates the hash table of a key for about count tuples */
+static int
+clarion_check_alloc (ClarionCheckKey *k, uint32_t count)
+{
+  uint32_t size = 64;
+
+  while ((size < (1U << 31)) && (size / 2 < count))
+    size *= 2;
+
+  k->slot = (ClarionCheckSlot *) CL_CALLOC(size, sizeof(ClarionCheckSlot));
+
+  if (k->slot == NULL)
+    return -1;
+
+  k->size = size;
+  k->used = 0;
+
+  return 0;
+}
+
+static int
+clarion_check_grow (ClarionCheckKey *k)
+{
+  ClarionCheckSlot *slot = k->slot;
+  uint32_t size = k->size;
+  uint32_t i, j;
+
+  if ((size >= (1U << 31)) || (clarion_check_alloc(k, size) < 0))
+    return -1;
+
+  for (i = 0; i < size; i++)
+    {
+      if (slot[i].hash == 0)
+	continue;
+
+      for (j = slot[i].hash & (k->size - 1); k->slot[j].hash != 0; j = (j + 1) & (k->size - 1))
+	;
+
+      k->slot[j] = slot[i];
+      k->used++;
+    }
+
+  free(slot);
+
+  return 0;
+}
+
+/* Puts the key tuple of a record in tuple, returns its length or -1 if it has a NULL */
+static int
+clarion_check_tuple (ClarionCheckKey *k, const uint8_t *data, uint8_t *tuple)
+{
+  ClarionValue v;
+  uint8_t *p = tuple;
+  uint16_t len;
+  int i;
+
+  for (i = 0; i < k->nparts; i++)
+    {
+      clarion_field_value(k->part[i].clfd, data + k->part[i].offset, &v);
+
+      switch (v.type)
+	{
+	  case CL_VALUE_STRING:
+	    if (v.len == 0)
+	      return -1;
+
+	    len = v.len;
+	    memcpy(p, &len, sizeof(uint16_t));
+	    memcpy(p + sizeof(uint16_t), v.str, v.len);
+	    p += sizeof(uint16_t) + v.len;
+	    break;
+
+	  case CL_VALUE_NUMBER:
+	    if ((v.num == 0) && (v.scale == 0) && (k->part[i].clfd->fldtype == CL_FIELD_DECIMAL))
+	      return -1;
+
+	    memcpy(p, &v.num, sizeof(__int128));
+	    p += sizeof(__int128);
+	    break;
+
+	  case CL_VALUE_REAL:
+	    memcpy(p, &v.real, sizeof(double));
+	    p += sizeof(double);
+	    break;
+
+	  default:
+	    return -1;
+	}
+    }
+
+  return p - tuple;
+}
+
+static int
+clarion_check_name_len (const uint8_t *name)
+{
+  int len = strlen((const char *)name);
+
+  while ((len > 0) && (name[len - 1] == ' '))
+    len--;
+
+  return len;
+}
+
+/* Whether records a and b have the same key tuple, reading them back */
+static int
+clarion_check_same (ClarionHandle *cl, ClarionCheckKey *k, uint32_t a, uint32_t b)
+{
+  ClarionCheck *c = cl->check;
+  int len;
+
+  if (clarion_read_batch(cl, c->rec, a, 1) != 1)
+    return 0;
+
+  len = clarion_check_tuple(k, c->rec + 5, c->tuple);
+
+  if (clarion_read_batch(cl, c->rec, b, 1) != 1)
+    return 0;
+
+  return (len >= 0) && (clarion_check_tuple(k, c->rec + 5, c->other) == len)
+    && (memcmp(c->other, c->tuple, len) == 0);
+}
+
+/* Adds the oldest queued hash to the table of its key, or reports a duplicate */
+static void
+clarion_check_insert (ClarionHandle *cl)
+{
+  ClarionCheck *c = cl->check;
+  ClarionCheckPending *p = &c->pending[c->head];
+  ClarionCheckKey *k = p->k;
+  uint32_t i;
+
+  c->head = (c->head + 1) % CL_CHECK_AHEAD;
+  c->count--;
+
+  if (((k->used + 1) * 2 > k->size) && (clarion_check_grow(k) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (i = p->hash & (k->size - 1); k->slot[i].hash != 0; i = (i + 1) & (k->size - 1))
+    {
+      if ((k->slot[i].hash == p->hash) && clarion_check_same(cl, k, k->slot[i].recno, p->recno))
+	{
+	  fprintf(stderr, "Key %.*s: record %u duplicates record %u\n",
+		  clarion_check_name_len(k->clk->keyname), k->clk->keyname, p->recno + 1, k->slot[i].recno + 1);
+	  k->dups++;
+	  return;
+	}
+    }
+
+  k->slot[i].hash = p->hash;
+  k->slot[i].recno = p->recno;
+  k->used++;
+}
+
+int
+clarion_check_init (ClarionHandle *cl)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  ClarionKeyDesc *clk = cl->clm.clk;
+  ClarionKeyPart *clkp;
+  ClarionCheckKey *k;
+  ClarionCheck *c;
+  size_t keymax = 0;
+  size_t reclen = cl->clm.clh->reclen;
+  size_t keyend = 0;
+  size_t tuplen;
+  int numparts;
+  int field;
+  int i, j, l;
+
+  clarion_probe_keys(cl);
+
+  c = (ClarionCheck *) clarion_arena_calloc(&cl->arena, 1, sizeof(ClarionCheck));
+
+  if (c == NULL)
+    goto nomem;
+
+  c->key = (ClarionCheckKey *) clarion_arena_calloc(&cl->arena, cl->clm.clh->numbkeys + 1, sizeof(ClarionCheckKey));
+
+  if (c->key == NULL)
+    goto nomem;
+
+  for (i = 0; i < cl->clm.clh->numbkeys; i++)
+    {
+      /* Key files that couldn't be read say CL_KEYTYPE_ERROR, like the SQL schema */
+      if (clk[i].keytype & CL_KEYTYPE_DUPSW)
+	continue;
+
+      k = &c->key[c->nkeys];
+      k->clk = &clk[i];
+
+      for (j = 0, numparts = 0; j < clk[i].numcomps; j++)
+	numparts += (clk[i].keypart[j].fldtype == CL_FIELD_GROUP) ? clk[i].keypart[j].numparts : 1;
+
+      k->part = (ClarionCheckPart *) clarion_arena_calloc(&cl->arena, numparts + 1, sizeof(ClarionCheckPart));
+
+      if (k->part == NULL)
+	goto nomem;
+
+      tuplen = 0;
+
+      for (j = 0; j < clk[i].numcomps; j++)
+	{
+	  if (clk[i].keypart[j].fldtype == CL_FIELD_GROUP)
+	    {
+	      clkp = clk[i].keypart[j].subpart;
+	      numparts = clk[i].keypart[j].numparts;
+	    }
+	  else
+	    {
+	      clkp = &clk[i].keypart[j];
+	      numparts = 1;
+	    }
+
+	  for (l = 0; l < numparts; l++)
+	    {
+	      field = clkp[l].fldnum - 1;
+
+	      /* The fields of a nested group are parts of their own */
+	      if (clfd[field].fldtype == CL_FIELD_GROUP)
+		continue;
+
+	      k->part[k->nparts].clfd = &clfd[field];
+	      k->part[k->nparts].offset = clarion_field_offset(cl, field);
+
+	      if (k->part[k->nparts].offset + 5 + clfd[field].length > reclen)
+		reclen = k->part[k->nparts].offset + 5 + clfd[field].length;
+
+	      if (k->part[k->nparts].offset + clfd[field].length > keyend)
+		keyend = k->part[k->nparts].offset + clfd[field].length;
+
+	      tuplen += sizeof(uint16_t) + clfd[field].length + sizeof(__int128);
+	      k->nparts++;
+
+	      if (cl->colread != NULL)
+		cl->colread[field] = 1;
+	    }
+	}
+
+      if (k->nparts == 0)
+	continue;
+
+      if (clarion_check_alloc(k, cl->clm.clh->numrecs) < 0)
+	goto nomem;
+
+      if (tuplen > keymax)
+	keymax = tuplen;
+
+      c->nkeys++;
+    }
+
+  if (c->nkeys == 0)
+    {
+      fprintf(stderr, "No unique keys to check\n");
+      return 0;
+    }
+
+  c->tuple = (uint8_t *) clarion_arena_alloc(&cl->arena, keymax);
+  c->other = (uint8_t *) clarion_arena_alloc(&cl->arena, keymax);
+  c->rec = (uint8_t *) clarion_arena_calloc(&cl->arena, 1, reclen + 1);
+
+  if ((c->tuple == NULL) || (c->other == NULL) || (c->rec == NULL))
+    goto nomem;
+
+  c->cl = cl;
+  c->datalen = keyend;
+  c->threaded = (cl->jobs > 1);
+
+  for (i = 0; c->threaded && (i < CL_RING_SIZE); i++)
+    {
+      c->chunk[i].recno = (uint32_t *) clarion_arena_alloc(&cl->arena, CL_CHECK_CHUNK * sizeof(uint32_t));
+      c->chunk[i].data = (uint8_t *) clarion_arena_alloc(&cl->arena, CL_CHECK_CHUNK * c->datalen);
+
+      if ((c->chunk[i].recno == NULL) || (c->chunk[i].data == NULL))
+	goto nomem;
+
+      clarion_ring_push(&c->free, &c->chunk[i]);
+    }
+
+  cl->check = c;
+
+  return 0;
+
+ nomem:
+  fprintf(stderr, "Out of memory\n");
+
+  return -1;
+}
+
+/* Hashes the key tuples of a record and queues them for their table */
+static void
+clarion_check_add (ClarionHandle *cl, uint32_t recno, const uint8_t *data)
+{
+  ClarionCheck *c = cl->check;
+  ClarionCheckPending *p;
+  ClarionCheckKey *k;
+  uint64_t hash;
+  int len;
+  int n;
+
+  for (n = 0; n < c->nkeys; n++)
+    {
+      k = &c->key[n];
+
+      len = clarion_check_tuple(k, data, c->tuple);
+
+      if (len < 0)
+	continue;
+
+      /* 0 marks empty slots */
+      hash = clarion_fnv(CL_FNV_OFFSET, c->tuple, len);
+      if (hash == 0)
+	hash = 1;
+
+      if (c->count == CL_CHECK_AHEAD)
+	clarion_check_insert(cl);
+
+      __builtin_prefetch(&k->slot[hash & (k->size - 1)], 1);
+
+      p = &c->pending[(c->head + c->count) % CL_CHECK_AHEAD];
+      p->k = k;
+      p->hash = hash;
+      p->recno = recno;
+      c->count++;
+    }
+}
+
+static void *
+clarion_check_worker (void *arg)
+{
+  ClarionHandle *cl = (ClarionHandle *)arg;
+  ClarionCheck *c = cl->check;
+  ClarionCheckChunk *ch;
+  uint32_t count;
+  uint32_t i;
+
+  CL_SET_PHASE(CL_PHASE_DATA);
+  clarion_trace_thread("check");
+
+  do {
+    ch = (ClarionCheckChunk *)clarion_ring_pop(&c->full);
+    count = ch->count;
+
+    for (i = 0; i < count; i++)
+      clarion_check_add(cl, ch->recno[i], ch->data + (size_t)i * c->datalen);
+
+    clarion_ring_push(&c->free, ch);
+  } while (count > 0);
+
+  while (c->count > 0)
+    clarion_check_insert(cl);
+
+  clarion_stats_merge();
+
+  return NULL;
+}
+
+void
+clarion_check_record (ClarionHandle *cl, uint32_t recno, const uint8_t *data)
+{
+  ClarionCheck *c = cl->check;
+  ClarionCheckChunk *ch;
+
+  if (!c->threaded)
+    {
+      clarion_check_add(cl, recno, data);
+      return;
+    }
+
+  if (!c->started)
+    {
+      if (pthread_create(&c->thread, NULL, clarion_check_worker, cl) != 0)
+	{
+	  c->threaded = 0;
+	  clarion_check_add(cl, recno, data);
+	  return;
+	}
+
+      c->started = 1;
+    }
+
+  if (c->cur == NULL)
+    {
+      c->cur = (ClarionCheckChunk *)clarion_ring_pop(&c->free);
+      c->cur->count = 0;
+    }
+
+  ch = c->cur;
+  ch->recno[ch->count] = recno;
+  memcpy(ch->data + (size_t)ch->count * c->datalen, data, c->datalen);
+
+  if (++ch->count == CL_CHECK_CHUNK)
+    {
+      clarion_ring_push(&c->full, ch);
+      c->cur = NULL;
+    }
+}
+
+static void
+clarion_check_none (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+		    uint8_t *data, ClarionOutput *out, void *ctx)
+{
+}
+
+void
+clarion_check_scan (ClarionHandle *cl)
+{
+  /* Deleted records are in no key */
+  if (!(cl->opts & CL_OPT_DELETED_ONLY))
+    cl->opts |= CL_OPT_DUMP_ACTIVE;
+
+  clarion_dump_records(cl, clarion_check_none, NULL);
+}
+
+uint64_t
+clarion_check_report (ClarionHandle *cl)
+{
+  ClarionCheck *c = cl->check;
+  ClarionCheckKey *k;
+  uint64_t dups = 0;
+  int n;
+
+  if (c == NULL)
+    return 0;
+
+  /* The last chunk, then an empty one to stop the check thread */
+  if (c->started)
+    {
+      if ((c->cur != NULL) && (c->cur->count > 0))
+	{
+	  clarion_ring_push(&c->full, c->cur);
+	  c->cur = NULL;
+	}
+
+      if (c->cur == NULL)
+	c->cur = (ClarionCheckChunk *)clarion_ring_pop(&c->free);
+
+      c->cur->count = 0;
+      clarion_ring_push(&c->full, c->cur);
+
+      pthread_join(c->thread, NULL);
+    }
+
+  while (c->count > 0)
+    clarion_check_insert(cl);
+
+  for (n = 0; n < c->nkeys; n++)
+    {
+      k = &c->key[n];
+
+      fprintf(stderr, "Key %.*s: %u distinct, %llu duplicates\n",
+	      clarion_check_name_len(k->clk->keyname), k->clk->keyname,
+	      k->used, (unsigned long long)k->dups);
+
+      dups += k->dups;
+
+      free(k->slot);
+    }
+
+  cl->check = NULL;
+
+  return dups;
+}
@@ -21,6 +21,8 @@
  *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#define _GNU_SOURCE /* copy_file_range() */
+
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
@@ -31,63 +33,87 @@
 #include <sys/mman.h>
 #include <endian.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <errno.h>
 
 #include "cldump.h"
 
 
-static uint8_t key[2];
+/* Don't spread less than this many records or blocks over threads */
+#define CL_DECRYPT_MIN_UNITS     4096
 
+/* Buffer size for out-of-place decryption */
+#define CL_DECRYPT_CHUNK         (1 << 20)
 
-static int
-reopen_dat_sync(ClarionHandle *cl, long fpos, uint8_t *base, uint8_t *pos)
+/* A run of records or memo blocks to decrypt */
+typedef struct {
+  uint8_t *base;
+  size_t count;
+  size_t stride;
+  size_t skip;
+  size_t len;
+  const uint8_t *key;
+} ClarionDecryptJob;
+
+
+/*
+ * XORs buf with the 2-byte key, aligned on buf; the remainder byte of an
+ * odd length is left as is. The key is expanded into a 64-bit keystream
+ * so the bulk of the buffer goes 8 bytes at a time.
+ */
+void
+clarion_xor (uint8_t *buf, size_t len, const uint8_t *key)
 {
-  long lret;
-  int ret;
+  uint8_t ksb[8];
+  uint64_t ks;
+  uint64_t w0, w1, w2, w3;
+  size_t i;
 
-  fclose(cl->data);
-  cl->data = NULL;
+  /* 2-byte blocks, remainder byte left as is */
+  len &= ~(size_t)1;
 
-  ret = msync(base, pos - base, MS_SYNC | MS_INVALIDATE);
-  if (ret != 0)
+  for (i = 0; i < 8; i += 2)
     {
-      fprintf(stderr, "msync failed: %s\n", strerror(errno));
-      return -1;
+      ksb[i] = key[0];
+      ksb[i + 1] = key[1];
     }
+  memcpy(&ks, ksb, 8);
 
-  cl->data = fopen(cl->datfile, "rb");
-  if (!cl->data)
+  for (i = 0; i + 32 <= len; i += 32)
     {
-      fprintf(stderr, "Failed to reopen data file: %s\n", strerror(errno));
-      return -1;
+      memcpy(&w0, buf + i, 8);
+      memcpy(&w1, buf + i + 8, 8);
+      memcpy(&w2, buf + i + 16, 8);
+      memcpy(&w3, buf + i + 24, 8);
+
+      w0 ^= ks;
+      w1 ^= ks;
+      w2 ^= ks;
+      w3 ^= ks;
+
+      memcpy(buf + i, &w0, 8);
+      memcpy(buf + i + 8, &w1, 8);
+      memcpy(buf + i + 16, &w2, 8);
+      memcpy(buf + i + 24, &w3, 8);
     }
 
-  lret = fseek(cl->data, fpos, SEEK_SET);
-  if (lret < 0)
+  for (; i + 8 <= len; i += 8)
     {
-      fprintf(stderr, "Failed to seek: %s\n", strerror(errno));
-      return -1;
+      memcpy(&w0, buf + i, 8);
+      w0 ^= ks;
+      memcpy(buf + i, &w0, 8);
     }
 
-  return 0;
-}
-
-static void
-clarion_decrypt(uint8_t *buf, int len)
-{
-  int i;
-
-  /* 2-byte blocks, remainder byte left as is */
-  for (i = 0; i < (len & ~1); i += 2)
+  for (; i < len; i += 2)
     {
-      buf[i] = buf[i] ^ key[0];
-      buf[i + 1] = buf[i + 1] ^ key[1];
+      buf[i] ^= key[0];
+      buf[i + 1] ^= key[1];
     }
 }
 
-static void
-clarion_get_key(ClarionHeader *clh, int mode)
+void
+clarion_get_key (ClarionHeader *clh, int mode, uint8_t *key)
 {
   uint32_t hidden;
 
@@ -119,218 +145,443 @@ clarion_get_key(ClarionHeader *clh, int mode)
     }
 }
 
-static int
-clarion_decrypt_header(ClarionHandle *cl, uint8_t *base)
-{
-  int ret;
-
-  clarion_decrypt(base + 4, 81);
-
-  /* Re-read header */
-  ret = reopen_dat_sync(cl, 0, base, base + 85);
-  if (ret < 0)
-    return -1;
-
-  free(cl->clm.clh);
-  cl->clm.clh = NULL;
-
-  ret = clarion_read_header(cl);
-  if (ret != 0)
-    {
-      fprintf(stderr, "Could not re-read header after decryption\n");
-
-      return -1;
-    }
-
-  return 0;
-}
-
-static int
-clarion_decrypt_schema(ClarionHandle *cl, uint8_t *base)
+/*
+ * Decrypts the header and the descriptors, in place, in buf which holds
+ * the start of a data file (size bytes). Counts and lengths are picked up
+ * from the decrypted bytes as we go. Returns -1 if the descriptors don't
+ * fit before the start of the records or in buf.
+ */
+int
+clarion_decrypt_meta (uint8_t *buf, size_t size, const uint8_t *key)
 {
-  ClarionFieldDesc *clfd;
   uint8_t *pos;
-  long fpos;
+  uint8_t *end;
+  uint32_t offset;
+  int numbkeys;
+  int numflds;
+  int numpics;
   int numcomps;
-  int numdim;
   int totdim;
   int piclen;
+  int arrays = 0;
   int i;
-  int j;
-  int ret;
 
-  /* field desc */
-  fpos = ftell(cl->data);
-  if (fpos < 0)
+  if (size < 85)
     return -1;
 
-  pos = base + fpos;
-
-  for (i = 0; i < cl->clm.clh->numflds; i++)
-    {
-      clarion_decrypt(pos, 27);
+  /* header */
+  clarion_xor(buf + 4, 81, key);
 
-      pos += 27;
-    }
+  numbkeys = buf[4];
+  numflds = (buf[14] << 8) | buf[13];
+  numpics = (buf[16] << 8) | buf[15];
+  offset = ((uint32_t)buf[24] << 24) | (buf[23] << 16) | (buf[22] << 8) | buf[21];
 
-  ret = reopen_dat_sync(cl, fpos, base, pos);
-  if (ret < 0)
+  if ((offset < 85) || (offset > size))
     return -1;
 
-  ret = clarion_read_field_desc(cl);
-  if (ret != 0)
-    {
-      fprintf(stderr, "Could not read field descriptors after decryption\n");
+  pos = buf + 85;
+  end = buf + offset;
 
-      return -1;
-    }
+  /* field desc */
+  for (i = 0; i < numflds; i++)
+    {
+      if (pos + 27 > end)
+	return -1;
 
-  clfd = cl->clm.clfd;
+      clarion_xor(pos, 27, key);
 
-  /* key desc */
-  fpos = ftell(cl->data);
-  if (fpos < 0)
-    return -1;
+      if ((pos[24] << 8) | pos[23])
+	arrays = 1;
 
-  pos = base + fpos;
+      pos += 27;
+    }
 
-  for (i = 0; i < cl->clm.clh->numbkeys; i++)
+  /* key desc */
+  for (i = 0; i < numbkeys; i++)
     {
-      clarion_decrypt(pos, 19);
+      if (pos + 19 > end)
+	return -1;
+
+      clarion_xor(pos, 19, key);
 
       /* Get the number of components */
       numcomps = pos[0];
 
       pos += 19;
 
-      for (j = 0; j < numcomps; j++)
+      if (pos + numcomps * 6 > end)
+	return -1;
+
+      for (; numcomps > 0; numcomps--)
 	{
-	  clarion_decrypt(pos, 6);
+	  clarion_xor(pos, 6, key);
 
 	  pos += 6;
 	}
 
-      /* We'd decrypt Kxx files here if we needed them */
+      /* Kxx files are kept as they are, see clarion_decrypt_one() */
     }
 
-  ret = reopen_dat_sync(cl, fpos, base, pos);
-  if (ret < 0)
-    return -1;
+  /* pic desc */
+  for (i = 0; i < numpics; i++)
+    {
+      if (pos + 2 > end)
+	return -1;
+
+      piclen = (pos[1] << 8) | pos[0];
 
-  ret = clarion_read_key_desc(cl);
-  if (ret != 0)
+      if (pos + 2 + piclen > end)
+	return -1;
+
+      clarion_xor(pos + 2, piclen, key);
+
+      pos += 2 + piclen;
+    }
+
+  /* arr desc, up to the start of the records - UNTESTED */
+  while (arrays && (pos + 6 <= end))
     {
-      fprintf(stderr, "Could not read key descriptors after decryption\n");
+      clarion_xor(pos, 6, key);
 
-      return -1;
+      totdim = (pos[3] << 8) | pos[2];
+
+      pos += 6;
+
+      if (pos + totdim * 4 > end)
+	return -1;
+
+      clarion_xor(pos, totdim * 4, key);
+      pos += totdim * 4;
     }
 
-  /* pic desc */
-  fpos = ftell(cl->data);
-  if (fpos < 0)
-    return -1;
+  return 0;
+}
 
-  pos = base + fpos;
+/* A candidate key location and how well it decrypts the descriptors */
+typedef struct {
+  ClarionHandle *cl;
+  off_t size;
+  int mode;
+  uint8_t key[2];
+  long score;
+  long max;
+} ClarionKeyGuess;
 
-  for (i = 0; i < cl->clm.clh->numpics; i++)
+/*
+ * Trial-decrypts the header tail and the field descriptors with one
+ * candidate key, in memory, and scores the result: one point per sanity
+ * check that holds on the header and on each field descriptor.
+ */
+static void *
+clarion_score_key (void *arg)
+{
+  ClarionKeyGuess *g = (ClarionKeyGuess *)arg;
+  int fd = fileno(g->cl->data);
+  uint8_t head[85];
+  uint8_t *flds;
+  uint8_t *fld;
+  uint32_t numrecs;
+  uint32_t offset;
+  int numbkeys;
+  int numflds;
+  int reclen;
+  int foffset;
+  int length;
+  int i, j;
+
+  g->score = 0;
+  g->max = 1;
+
+  if (pread(fd, head, 85, 0) != 85)
+    return NULL;
+
+  clarion_get_key(g->cl->clm.clh, g->mode, g->key);
+  clarion_xor(head + 4, 81, g->key);
+
+  numbkeys = head[4];
+  numrecs = ((uint32_t)head[8] << 24) | (head[7] << 16) | (head[6] << 8) | head[5];
+  numflds = (head[14] << 8) | head[13];
+  reclen = (head[20] << 8) | head[19];
+  offset = ((uint32_t)head[24] << 24) | (head[23] << 16) | (head[22] << 8) | head[21];
+
+  /* Not worth looking any further */
+  if ((numflds == 0) || (reclen < 5) || (offset > g->size)
+      || (offset < 85 + numflds * 27 + numbkeys * 19))
+    return NULL;
+
+  g->max = 3 + 4 * numflds;
+
+  /* Records fit in the file */
+  if ((uint64_t)numrecs * reclen <= (uint64_t)(g->size - offset))
+    g->score++;
+
+  /* Record prefix is printable */
+  for (i = 64; i < 67; i++)
     {
-      piclen = (pos[1] << 8) | pos[0];
+      if ((head[i] <= 0x20) || (head[i] >= 0x7f))
+	break;
+    }
+  if (i == 67)
+    g->score++;
 
-      clarion_decrypt(pos + 2, piclen);
+  /* No more memo width than memo length */
+  if (((head[70] << 8) | head[69]) <= ((head[68] << 8) | head[67]))
+    g->score++;
 
-      pos += 2 + piclen;
-    }
+  flds = (uint8_t *) malloc(numflds * 27);
+  if (flds == NULL)
+    return NULL;
 
-  ret = reopen_dat_sync(cl, fpos, base, pos);
-  if (ret < 0)
-    return -1;
+  if (pread(fd, flds, numflds * 27, 85) != numflds * 27)
+    {
+      free(flds);
+      return NULL;
+    }
 
-  clarion_read_pic_desc(cl);
-  if (ret != 0)
+  for (i = 0; i < numflds; i++)
     {
-      fprintf(stderr, "Could not read picture descriptors after decryption\n");
+      fld = flds + i * 27;
 
-      return -1;
+      clarion_xor(fld, 27, g->key);
+
+      if ((fld[0] >= CL_FIELD_LONG) && (fld[0] <= CL_FIELD_DECIMAL))
+	g->score++;
+
+      for (j = 1; j < 17; j++)
+	{
+	  if ((fld[j] < 0x20) || (fld[j] >= 0x7f))
+	    break;
+	}
+      if (j == 17)
+	g->score++;
+
+      /* Field names are prefixed with the record prefix */
+      if ((memcmp(fld + 1, head + 64, 3) == 0) && (fld[4] == ':'))
+	g->score++;
+
+      foffset = (fld[18] << 8) | fld[17];
+      length = (fld[20] << 8) | fld[19];
+
+      if (foffset + length <= reclen)
+	g->score++;
     }
 
-  /* arr desc - UNTESTED */
-  fpos = ftell(cl->data);
-  if (fpos < 0)
-    return -1;
+  free(flds);
 
-  pos = base + fpos;
+  return NULL;
+}
 
-  for (i = 0; i < cl->clm.clh->numflds; i++)
+/*
+ * Finds out where the key is stored by trying all 4 locations at once.
+ * Nothing is written. Returns the best key location, or -1 if none of
+ * them gives believable descriptors or two different keys score the same.
+ */
+int
+clarion_find_key (ClarionHandle *cl)
+{
+  ClarionKeyGuess g[4];
+  pthread_t tids[4];
+  int started[4];
+  struct stat st;
+  int best = -1;
+  int i;
+
+  if (fstat(fileno(cl->data), &st) < 0)
     {
-      if (clfd[i].arrnum == 0)
-	continue;
+      fprintf(stderr, "fstat failed: %s\n", strerror(errno));
+      return -1;
+    }
 
-      while ((pos - base) < cl->clm.clh->offset)
-	{
-	  clarion_decrypt(pos, 6);
+  for (i = 0; i < 4; i++)
+    {
+      g[i].cl = cl;
+      g[i].size = st.st_size;
+      g[i].mode = CL_KEY_NUMDELS_HI + i;
 
-	  numdim = (pos[1] << 8) | pos[0];
-	  totdim = (pos[3] << 8) | pos[2];
+      started[i] = (pthread_create(&tids[i], NULL, clarion_score_key, &g[i]) == 0);
+      if (!started[i])
+	clarion_score_key(&g[i]);
+    }
 
-	  pos += 6;
+  for (i = 0; i < 4; i++)
+    {
+      if (started[i])
+	pthread_join(tids[i], NULL);
 
-	  clarion_decrypt(pos, totdim * 4);
-	  pos += totdim * 4;
-	}
+      /* Compare score / max ratios */
+      if ((best < 0) || (g[i].score * g[best].max > g[best].score * g[i].max))
+	best = i;
     }
 
-  ret = reopen_dat_sync(cl, fpos, base, pos);
-  if (ret < 0)
+  /* Less than 3/4 of the checks passing means garbage */
+  if (g[best].score * 4 < g[best].max * 3)
     return -1;
 
-  clarion_read_arr_desc(cl);
+  for (i = 0; i < 4; i++)
+    {
+      if ((i != best) && (g[i].score * g[best].max == g[best].score * g[i].max)
+	  && (memcmp(g[i].key, g[best].key, 2) != 0))
+	return -1;
+    }
 
-  return 0;
+  return g[best].mode;
 }
 
-static int
-clarion_decrypt_data(ClarionHandle *cl, uint8_t *base, off_t size)
+/*
+ * On-the-fly decryption: the descriptors are read and decrypted in memory,
+ * then the header is parsed again from there; the other descriptors are
+ * parsed from the same buffer as usual. Record bodies and memo blocks are
+ * decrypted as they're read. Nothing gets written to the files.
+ */
+int
+clarion_decrypt_meta_load (ClarionHandle *cl)
 {
-  ClarionHeader *clh;
+  uint8_t head[85];
+  uint32_t offset;
+
+  clarion_get_key(cl->clm.clh, cl->decmode, cl->key);
+
+  /* The header region is already loaded */
+  memcpy(head, cl->meta, 85);
+  clarion_xor(head + 4, 81, cl->key);
+  offset = ((uint32_t)head[24] << 24) | (head[23] << 16) | (head[22] << 8) | head[21];
+
+  if ((offset < 85) || (clarion_load_meta(cl, offset) != 0)
+      || (clarion_decrypt_meta(cl->meta, offset, cl->key) < 0))
+    {
+      fprintf(stderr, "Invalid descriptors after decryption, wrong key location?\n");
+      return -1;
+    }
+
+  return clarion_read_header(cl);
+}
+
+static void *
+clarion_decrypt_worker (void *arg)
+{
+  ClarionDecryptJob *job = (ClarionDecryptJob *)arg;
   uint8_t *pos;
-  long fpos;
+  size_t i;
+
+  pos = job->base;
+
+  CL_PROBE2(decrypt__chunk, job->count, job->count * job->stride);
+
+  for (i = 0; i < job->count; i++)
+    {
+      clarion_xor(pos + job->skip, job->len, job->key);
+
+      pos += job->stride;
+    }
+
+  return NULL;
+}
+
+/*
+ * Decrypts count records or memo blocks of stride bytes starting at base,
+ * len bytes past the first skip bytes of each, split in contiguous runs
+ * over up to cl->jobs threads. The calling thread takes the first run.
+ */
+static void
+clarion_decrypt_units (ClarionHandle *cl, uint8_t *base, size_t count, size_t stride,
+		       size_t skip, size_t len)
+{
+  ClarionDecryptJob *jobs;
+  pthread_t *tids;
+  size_t per;
+  int nthreads;
+  int started;
   int i;
 
-  clh = cl->clm.clh;
+  nthreads = cl->jobs;
+  if ((size_t)nthreads > count / CL_DECRYPT_MIN_UNITS)
+    nthreads = count / CL_DECRYPT_MIN_UNITS;
+  if (nthreads < 1)
+    nthreads = 1;
 
-  fpos = ftell(cl->data);
-  if (fpos < 0)
-    return -1;
+  jobs = (ClarionDecryptJob *) malloc(nthreads * sizeof(ClarionDecryptJob));
+  tids = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
 
-  if (fpos > clh->offset)
+  if ((jobs == NULL) || (tids == NULL))
     {
-      fprintf(stderr, "Error: starting data decryption past start of data (%lx / %x)\n", fpos, clh->offset);
-      exit(1);
+      ClarionDecryptJob job = { base, count, stride, skip, len, cl->key };
+
+      free(jobs);
+      free(tids);
+
+      clarion_decrypt_worker(&job);
+      return;
     }
 
-  pos = base + fpos;
+  per = (count + nthreads - 1) / nthreads;
 
-  for (i = 0; i < clh->numrecs; i++)
+  for (i = 0; i < nthreads; i++)
     {
-      if (pos + clh->reclen > base + size)
-	{
-	  fprintf(stderr, "EOF reached for DAT file\n");
-	  break;
-	}
+      jobs[i].base = base + i * per * stride;
+      jobs[i].count = (count > i * per) ? count - i * per : 0;
+      if (jobs[i].count > per)
+	jobs[i].count = per;
+      jobs[i].stride = stride;
+      jobs[i].skip = skip;
+      jobs[i].len = len;
+      jobs[i].key = cl->key;
+    }
+
+  /* Runs whose thread couldn't be started are done here */
+  for (started = 1; started < nthreads; started++)
+    {
+      if (pthread_create(&tids[started], NULL, clarion_decrypt_worker, &jobs[started]) != 0)
+	break;
+    }
+
+  clarion_decrypt_worker(&jobs[0]);
+
+  for (i = started; i < nthreads; i++)
+    clarion_decrypt_worker(&jobs[i]);
+
+  for (i = 1; i < started; i++)
+    pthread_join(tids[i], NULL);
+
+  free(jobs);
+  free(tids);
+}
+
+static int
+clarion_decrypt_data (ClarionHandle *cl, uint8_t *base, off_t size)
+{
+  uint32_t offset;
+  uint32_t numrecs;
+  size_t count;
+  int reclen;
 
-      clarion_decrypt(pos + 5, clh->reclen - 5);
+  /* Decrypted by now */
+  numrecs = ((uint32_t)base[8] << 24) | (base[7] << 16) | (base[6] << 8) | base[5];
+  reclen = (base[20] << 8) | base[19];
+  offset = ((uint32_t)base[24] << 24) | (base[23] << 16) | (base[22] << 8) | base[21];
 
-      pos += clh->reclen;
+  if (reclen < 5)
+    {
+      fprintf(stderr, "Invalid record length (%d)\n", reclen);
+      return -1;
     }
 
+  count = (size - offset) / reclen;
+
+  if (count < numrecs)
+    fprintf(stderr, "EOF reached for DAT file\n");
+  else
+    count = numrecs;
+
+  clarion_decrypt_units(cl, base + offset, count, reclen, 5, reclen - 5);
+
   return 0;
 }
 
 static int
-clarion_decrypt_memo(ClarionHandle *cl)
+clarion_decrypt_memo (ClarionHandle *cl)
 {
   struct stat st;
-  uint8_t *pos;
   void *mapbase;
   int fd;
   int ret;
@@ -352,6 +603,12 @@ clarion_decrypt_memo(ClarionHandle *cl)
       return -1;
     }
 
+  if (st.st_size <= 6)
+    {
+      close(fd);
+      return 0;
+    }
+
   mapbase = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
   if (mapbase == MAP_FAILED)
     {
@@ -361,22 +618,13 @@ clarion_decrypt_memo(ClarionHandle *cl)
       return -1;
     }
 
-  pos = (uint8_t *)mapbase;
-  /* Skip file header */
-  pos += 6;
-
-  while ((pos - (uint8_t *)mapbase) < st.st_size)
-    {
-      if (pos + 256 > (uint8_t *)mapbase + st.st_size)
-	{
-	  fprintf(stderr, "EOF reached for MEM file\n");
-	  break;
-	}
+  madvise(mapbase, st.st_size, MADV_SEQUENTIAL);
 
-      clarion_decrypt(pos + 4, 252);
+  /* Skip file header */
+  if ((st.st_size - 6) % 256)
+    fprintf(stderr, "EOF reached for MEM file\n");
 
-      pos += 256;
-    }
+  clarion_decrypt_units(cl, (uint8_t *)mapbase + 6, (st.st_size - 6) / 256, 256, 4, 252);
 
   munmap(mapbase, st.st_size);
   close(fd);
@@ -389,7 +637,9 @@ clarion_decrypt_all(ClarionHandle *cl)
 {
   struct stat st;
   ClarionHeader *clh;
+  uint8_t *base;
   void *mapbase;
+  uint16_t sfatr;
   int fd;
   int ret;
 
@@ -421,26 +671,29 @@ clarion_decrypt_all(ClarionHandle *cl)
       exit(1);
     }
 
-  /* Clear encrypted and owned flag */
-  clh->sfatr &= ~(CL_FILE_OWNED | CL_RECORDS_ENCRYPTED);
-  clh->sfatr = htole16(clh->sfatr);
-  memcpy(mapbase + 2, &clh->sfatr, 2);
+  madvise(mapbase, st.st_size, MADV_SEQUENTIAL);
 
-  clarion_get_key(clh, cl->decmode);
+  base = (uint8_t *)mapbase;
 
-  ret = clarion_decrypt_header(cl, (uint8_t *)mapbase);
-  if (ret < 0)
-    goto cleanup;
+  clarion_get_key(clh, cl->decmode, cl->key);
 
-  ret = clarion_decrypt_schema(cl, (uint8_t *)mapbase);
+  ret = clarion_decrypt_meta(base, st.st_size, cl->key);
   if (ret < 0)
-    goto cleanup;
+    {
+      fprintf(stderr, "Invalid descriptors after decryption, wrong key location?\n");
+      goto cleanup;
+    }
+
+  /* Clear encrypted and owned flag */
+  sfatr = clh->sfatr & ~(CL_FILE_OWNED | CL_RECORDS_ENCRYPTED);
+  sfatr = htole16(sfatr);
+  memcpy(base + 2, &sfatr, 2);
 
-  ret = clarion_decrypt_data(cl, (uint8_t *)mapbase, st.st_size);
+  ret = clarion_decrypt_data(cl, base, st.st_size);
   if (ret < 0)
     goto cleanup;
 
-  if (cl->clm.clh->sfatr & CL_MEMO_FILE_EXISTS)
+  if (clh->sfatr & CL_MEMO_FILE_EXISTS)
     {
       ret = clarion_open_memo(cl);
       if (ret < 0)
@@ -462,23 +715,497 @@ clarion_decrypt_all(ClarionHandle *cl)
   if (cl->data)
     fclose(cl->data);
 
-  if (ret == 0)
+  clarion_free_handle(cl);
+
+  exit((ret == 0) ? 0 : 1);
+}
+
+
+/*
+ * Out-of-place decryption
+ *
+ * The data and memo files are encrypted nearly end to end, so they are
+ * streamed through a large buffer, decrypted on the way, rather than
+ * copied then rewritten. Key files are copied as is, with copy_file_range()
+ * so the kernel can do it without going through userspace (or share the
+ * extents on filesystems that support it).
+ */
+
+typedef struct {
+  ClarionHandle *cl;
+  char **files;
+  int nfiles;
+  int next;
+  int failed;
+  const char *dir;
+} ClarionDecryptTo;
+
+static int
+clarion_write_at (int fd, const uint8_t *buf, size_t len, off_t pos)
+{
+  ssize_t ret;
+
+  while (len > 0)
+    {
+      ret = pwrite(fd, buf, len, pos);
+
+      if (ret < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+
+	  return -1;
+	}
+
+      buf += ret;
+      len -= ret;
+      pos += ret;
+    }
+
+  return 0;
+}
+
+static int
+clarion_copy_file (const char *src, const char *dst)
+{
+  uint8_t *buf;
+  ssize_t ret = 0;
+  off_t pos = 0;
+  int in;
+  int out;
+
+  in = open(src, O_RDONLY);
+  if (in < 0)
+    {
+      fprintf(stderr, "Could not open %s: %s\n", src, strerror(errno));
+      return -1;
+    }
+
+  out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+    {
+      fprintf(stderr, "Could not create %s: %s\n", dst, strerror(errno));
+      close(in);
+      return -1;
+    }
+
+  while ((ret = copy_file_range(in, NULL, out, NULL, CL_DECRYPT_CHUNK * 16, 0)) != 0)
+    {
+      if ((ret < 0) && (errno != EINTR))
+	break;
+    }
+
+  /* Not supported here, copy by hand from where it stopped */
+  if (ret < 0)
+    {
+      pos = lseek(in, 0, SEEK_CUR);
+      buf = (uint8_t *) malloc(CL_DECRYPT_CHUNK);
+
+      if (buf != NULL)
+	{
+	  while ((ret = pread(in, buf, CL_DECRYPT_CHUNK, pos)) > 0)
+	    {
+	      if (clarion_write_at(out, buf, ret, pos) < 0)
+		{
+		  ret = -1;
+		  break;
+		}
+
+	      pos += ret;
+	    }
+
+	  free(buf);
+	}
+    }
+
+  if (ret < 0)
+    fprintf(stderr, "Could not copy %s to %s: %s\n", src, dst, strerror(errno));
+
+  close(in);
+  if (close(out) < 0)
+    ret = -1;
+
+  return (ret < 0) ? -1 : 0;
+}
+
+/*
+ * Copies src to dst, decrypting units of stride bytes (len bytes past the
+ * first skip bytes of each) from start onwards; what comes before start
+ * is head, already decrypted by the caller, or copied as is if NULL.
+ */
+static int
+clarion_decrypt_copy (ClarionHandle *cl, const char *src, const char *dst,
+		      const uint8_t *head, off_t start, size_t stride, size_t skip, size_t len)
+{
+  uint8_t *buf;
+  size_t perchunk;
+  size_t got;
+  size_t i;
+  ssize_t ret;
+  off_t pos;
+  int in;
+  int out;
+  int err = 0;
+
+  in = open(src, O_RDONLY);
+  if (in < 0)
+    {
+      fprintf(stderr, "Could not open %s: %s\n", src, strerror(errno));
+      return -1;
+    }
+
+  out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+    {
+      fprintf(stderr, "Could not create %s: %s\n", dst, strerror(errno));
+      close(in);
+      return -1;
+    }
+
+  perchunk = CL_DECRYPT_CHUNK / stride;
+  if (perchunk == 0)
+    perchunk = 1;
+
+  buf = (uint8_t *) malloc((start > (off_t)(perchunk * stride)) ? start : perchunk * stride);
+  if (buf == NULL)
+    {
+      close(in);
+      close(out);
+      return -1;
+    }
+
+  if (head == NULL)
+    {
+      if (pread(in, buf, start, 0) != start)
+	err = -1;
+      head = buf;
+    }
+
+  if ((err == 0) && (clarion_write_at(out, head, start, 0) < 0))
+    err = -1;
+
+  pos = start;
+
+  while (err == 0)
+    {
+      got = 0;
+
+      while (got < perchunk * stride)
+	{
+	  ret = pread(in, buf + got, perchunk * stride - got, pos + got);
+
+	  if ((ret < 0) && (errno == EINTR))
+	    continue;
+	  if (ret < 0)
+	    err = -1;
+	  if (ret <= 0)
+	    break;
+
+	  got += ret;
+	}
+
+      if ((err < 0) || (got == 0))
+	break;
+
+      CL_PROBE2(decrypt__chunk, got / stride, got);
+
+      /* A trailing partial unit is copied as is */
+      for (i = 0; i + stride <= got; i += stride)
+	clarion_xor(buf + i + skip, len, cl->key);
+
+      if (clarion_write_at(out, buf, got, pos) < 0)
+	err = -1;
+
+      pos += got;
+    }
+
+  if (err < 0)
+    fprintf(stderr, "Could not decrypt %s to %s: %s\n", src, dst, strerror(errno));
+
+  free(buf);
+  close(in);
+  if (close(out) < 0)
+    err = -1;
+
+  return err;
+}
+
+/* Returns a malloc'ed path to dir/name where name is the last component of path */
+static char *
+clarion_target_path (const char *dir, const char *path)
+{
+  const char *name;
+  char *target;
+
+  name = strrchr(path, '/');
+  name = (name != NULL) ? name + 1 : path;
+
+  target = (char *) malloc(strlen(dir) + strlen(name) + 2);
+  if (target != NULL)
+    sprintf(target, "%s/%s", dir, name);
+
+  return target;
+}
+
+static int
+clarion_same_file (const char *a, const char *b)
+{
+  struct stat sa;
+  struct stat sb;
+
+  if ((stat(a, &sa) < 0) || (stat(b, &sb) < 0))
+    return 0;
+
+  return (sa.st_dev == sb.st_dev) && (sa.st_ino == sb.st_ino);
+}
+
+static int
+clarion_decrypt_one (ClarionHandle *tmpl, const char *datfile, const char *dir)
+{
+  ClarionHandle cl;
+  struct stat st;
+  uint8_t *head = NULL;
+  uint16_t sfatr;
+  uint32_t offset;
+  char *memfile = NULL;
+  char *keyfile = NULL;
+  char *target = NULL;
+  int numbkeys;
+  int reclen;
+  int encrypted;
+  int ret = -1;
+  int l, r;
+  int i;
+
+  memset(&cl, 0, sizeof(ClarionHandle));
+  cl.opts = tmpl->opts;
+  cl.decmode = tmpl->decmode;
+  cl.datfile = (char *)datfile;
+
+  cl.data = fopen(datfile, "rb");
+  if (cl.data == NULL)
     {
-      clarion_free_handle(cl);
-      exit(0);
+      fprintf(stderr, "Couldn't open file %s !\n", datfile);
+      return -1;
     }
+
+  if ((clarion_read_header(&cl) != 0) || (fstat(fileno(cl.data), &st) < 0))
+    goto out;
+
+  target = clarion_target_path(dir, datfile);
+  if (target == NULL)
+    goto out;
+
+  if (clarion_same_file(datfile, target))
+    {
+      fprintf(stderr, "Won't overwrite %s with its decrypted copy\n", datfile);
+      goto out;
+    }
+
+  encrypted = cl.clm.clh->sfatr & CL_RECORDS_ENCRYPTED;
+
+  if (encrypted && (cl.decmode == 0))
+    {
+      ret = clarion_find_key(&cl);
+
+      if (ret < 0)
+	{
+	  fprintf(stderr, "Couldn't find out the key location for %s, use -x 1-4\n", datfile);
+	  goto out;
+	}
+
+      cl.decmode = ret;
+      ret = -1;
+    }
+
+  if (encrypted)
+    clarion_get_key(cl.clm.clh, cl.decmode, cl.key);
+
+  /* Read and decrypt the descriptors */
+  offset = cl.clm.clh->offset;
+  if (encrypted)
+    {
+      uint8_t tmp[85];
+
+      if (pread(fileno(cl.data), tmp, 85, 0) != 85)
+	goto out;
+
+      clarion_xor(tmp + 4, 81, cl.key);
+      offset = ((uint32_t)tmp[24] << 24) | (tmp[23] << 16) | (tmp[22] << 8) | tmp[21];
+    }
+
+  if ((offset < 85) || (offset > st.st_size))
+    {
+      fprintf(stderr, "Invalid descriptors in %s%s\n", datfile, encrypted ? ", wrong key location?" : "");
+      goto out;
+    }
+
+  head = (uint8_t *) malloc(offset);
+  if ((head == NULL) || (pread(fileno(cl.data), head, offset, 0) != (ssize_t)offset))
+    goto out;
+
+  if (encrypted)
+    {
+      if (clarion_decrypt_meta(head, offset, cl.key) < 0)
+	{
+	  fprintf(stderr, "Invalid descriptors in %s, wrong key location?\n", datfile);
+	  goto out;
+	}
+
+      /* Clear encrypted and owned flag */
+      sfatr = cl.clm.clh->sfatr & ~(CL_FILE_OWNED | CL_RECORDS_ENCRYPTED);
+      sfatr = htole16(sfatr);
+      memcpy(head + 2, &sfatr, 2);
+    }
+
+  numbkeys = head[4];
+  reclen = (head[20] << 8) | head[19];
+
+  if (reclen < 5)
+    {
+      fprintf(stderr, "Invalid record length in %s\n", datfile);
+      goto out;
+    }
+
+  if (encrypted)
+    ret = clarion_decrypt_copy(&cl, datfile, target, head, offset, reclen, 5, reclen - 5);
   else
+    ret = clarion_copy_file(datfile, target);
+
+  if (ret < 0)
+    goto out;
+
+  if (cl.clm.clh->sfatr & CL_MEMO_FILE_EXISTS)
     {
-      if (cl->clm.clk)
-	clarion_free_handle(cl);
+      memfile = strdup(datfile);
+      memfile[strlen(memfile) - 1] = 'M';
+      memfile[strlen(memfile) - 2] = 'E';
+      memfile[strlen(memfile) - 3] = 'M';
+
+      free(target);
+      target = clarion_target_path(dir, memfile);
+
+      if (encrypted)
+	ret = clarion_decrypt_copy(&cl, memfile, target, NULL, 6, 256, 4, 252);
       else
+	ret = clarion_copy_file(memfile, target);
+
+      if (ret < 0)
+	goto out;
+    }
+
+  /*
+   * Key files: their layout isn't documented, and there's no telling
+   * whether or how they are encrypted, so they are copied as is, as
+   * --decrypt leaves them in place. clarion_probe_keys() reads their key
+   * type raw either way, so the copy reports the same keys as the
+   * original. Should Clarion refuse them along with the decrypted data
+   * file, they can be rebuilt from it.
+   */
+  keyfile = strdup(datfile);
+
+  for (i = 0; i < numbkeys; i++)
+    {
+      l = (i + 1) / 16;
+      r = (i + 1) % 16;
+      keyfile[strlen(keyfile) - 3] = 'K';
+      keyfile[strlen(keyfile) - 2] = (l > 9) ? 'a' + (l - 10) : '0' + l;
+      keyfile[strlen(keyfile) - 1] = (r > 9) ? 'a' + (r - 10) : '0' + r;
+
+      if (access(keyfile, R_OK) != 0)
 	{
-	  if (cl->clm.clh)
-	    free(cl->clm.clh);
-	  if (cl->clm.clfd)
-	    free(cl->clm.clfd);
+	  fprintf(stderr, "Couldn't open key file %s !\n", keyfile);
+	  continue;
 	}
 
-      exit(1);
+      free(target);
+      target = clarion_target_path(dir, keyfile);
+
+      if (clarion_copy_file(keyfile, target) < 0)
+	ret = -1;
+    }
+
+  if (ret == 0)
+    fprintf(stderr, "%s: %s to %s\n", datfile, encrypted ? "decrypted" : "not encrypted, copied", dir);
+
+ out:
+  fclose(cl.data);
+  free(cl.meta);
+  clarion_arena_free(&cl.arena);
+  free(head);
+  free(memfile);
+  free(keyfile);
+  free(target);
+
+  return ret;
+}
+
+static void *
+clarion_decrypt_to_worker (void *arg)
+{
+  ClarionDecryptTo *dt = (ClarionDecryptTo *)arg;
+  int i;
+
+  while ((i = __atomic_fetch_add(&dt->next, 1, __ATOMIC_RELAXED)) < dt->nfiles)
+    {
+      if (clarion_decrypt_one(dt->cl, dt->files[i], dt->dir) < 0)
+	__atomic_store_n(&dt->failed, 1, __ATOMIC_RELAXED);
+    }
+
+  return NULL;
+}
+
+/*
+ * Decrypts the given data files, and the .DAT files in the given
+ * directories, to dir, leaving the originals untouched. Files are spread
+ * over up to cl->jobs threads. Returns -1 if any of them failed.
+ */
+int
+clarion_decrypt_to (ClarionHandle *cl, char **paths, int npaths, const char *dir)
+{
+  ClarionDecryptTo dt;
+  pthread_t *tids;
+  struct stat st;
+  int nthreads;
+  int started;
+  int i;
+
+  if ((stat(dir, &st) < 0) || !S_ISDIR(st.st_mode))
+    {
+      fprintf(stderr, "%s is not a directory\n", dir);
+      return -1;
+    }
+
+  memset(&dt, 0, sizeof(ClarionDecryptTo));
+  dt.cl = cl;
+  dt.dir = dir;
+
+  for (i = 0; i < npaths; i++)
+    {
+      if (clarion_collect_files(paths[i], &dt.files, &dt.nfiles) < 0)
+	dt.failed = 1;
+    }
+
+  nthreads = (cl->jobs < dt.nfiles) ? cl->jobs : dt.nfiles;
+
+  tids = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+
+  for (started = 1; (tids != NULL) && (started < nthreads); started++)
+    {
+      if (pthread_create(&tids[started], NULL, clarion_decrypt_to_worker, &dt) != 0)
+	break;
     }
+
+  clarion_decrypt_to_worker(&dt);
+
+  for (i = 1; (tids != NULL) && (i < started); i++)
+    pthread_join(tids[i], NULL);
+
+  free(tids);
+
+  for (i = 0; i < dt.nfiles; i++)
+    free(dt.files[i]);
+  free(dt.files);
+
+  return (dt.failed) ? -1 : 0;
 }
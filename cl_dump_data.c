@@ -28,16 +28,14 @@
 
 #include "cldump.h"
 
-void
-clarion_dump_data (ClarionHandle *cl)
+static void
+clarion_dump_record (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+		     uint8_t *data, ClarionOutput *out, void *ctx)
 {
   int i;
-  int nrecs, nflds;
-  FILE *fp = cl->data;
+  int nflds;
   ClarionHeader *clh = cl->clm.clh;
   ClarionFieldDesc *clfd = cl->clm.clfd;
-  ClarionRecordHeader clrh;
-  uint8_t *buf;
   char *rhd[8] = {
     "NEW RECORD",
     "OLD RECORD",
@@ -49,94 +47,103 @@ clarion_dump_data (ClarionHandle *cl)
     "*** UNDEFINED (7) ***"
   };
 
-  buf = (uint8_t *) malloc(clh->reclen * sizeof(uint8_t));
-
-  for (nrecs = 0; nrecs < clh->numrecs; nrecs++)
-    {      
-      fread(&clrh.rhd, 1, 1, fp);
-      fread(&clrh.rptr, 4, 1, fp);
+  CL_PROBE2(record__start, recno, clrh->rhd);
 
-      if ((clrh.rhd & CL_RECORD_DELETED) && (cl->opts & CL_OPT_DUMP_ACTIVE))
+  fprintf(stderr, "=== RECORD %d:\n", (recno + 1));
+  fprintf(stderr, "rhd  : 0x%02x\n", clrh->rhd);
+  fprintf(stderr, "\tAttributes set:");
+  if (clrh->rhd)
+    {
+      for (i = 0; i < 8; i++)
 	{
-	  fseek(cl->data, (clh->reclen - 5), SEEK_CUR);
-	  continue;
+	  if ((clrh->rhd >> i) & 0x01)
+	    fprintf(stderr, " [%s]", rhd[i]);
 	}
+    }
+  else
+    {
+      fprintf(stderr, " NONE");
+    }
+  fprintf(stderr, "\n");
+  fprintf(stderr, "rptr : 0x%08x\n", clrh->rptr);
+  fprintf(stderr, "\n");
 
-      fprintf(stderr, "=== RECORD %d:\n", (nrecs + 1));
-      fprintf(stderr, "rhd  : 0x%02x\n", clrh.rhd);
-      fprintf(stderr, "\tAttributes set:");
-      if (clrh.rhd)
-	{
-	  for (i = 0; i < 8; i++)
-	    {
-	      if ((clrh.rhd >> i) & 0x01)
-		fprintf(stderr, " [%s]", rhd[i]);
-	    }
-	}
-      else
-	{
-	  fprintf(stderr, " NONE");
-	}
-      fprintf(stderr, "\n");
-      fprintf(stderr, "rptr : 0x%08x\n", clrh.rptr);
-      fprintf(stderr, "\n");
+  fflush(stderr);
 
-      fflush(stderr);
+  clarion_out_printf(out, "=== RECORD %d:\n", (recno + 1));
 
-      fprintf(stdout, "=== RECORD %d:\n", (nrecs + 1));
+  for (nflds = 0; nflds < clh->numflds; nflds++)
+    {
+      /*
+       * A field with type CL_FIELD_GROUP is a pseudo-field
+       * used to indicate that the next clfd[i].length fields
+       * are grouped together.
+       */
+      if (clfd[nflds].fldtype == CL_FIELD_GROUP)
+	{
+	  continue;
+	}
 
-      for (nflds = 0; nflds < clh->numflds; nflds++)
+      /* Not in --columns */
+      if ((cl->colsel != NULL) && !cl->colsel[nflds])
 	{
-	  /*
-	   * A field with type CL_FIELD_GROUP is a pseudo-field
-	   * used to indicate that the next clfd[i].length fields
-	   * are grouped together.
-	   */
-	  if (clfd[nflds].fldtype == CL_FIELD_GROUP)
-	    {
-	      continue;
-	    }
-
-	  fprintf(stdout, "%8s : ", (clfd[nflds].fldname + 4));
-	  switch (clfd[nflds].fldtype)
-	    {
-	      case CL_FIELD_LONG:
-		clarion_dump_field_long(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_REAL:
-		clarion_dump_field_real(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_STRING:
-	      case CL_FIELD_STRING_PIC_TOK:
-		clarion_dump_field_string(buf, &clfd[nflds], cl->data, NULL, cl->charset);
-		break;
-	      case CL_FIELD_BYTE:
-		clarion_dump_field_byte(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_SHORT:
-		clarion_dump_field_short(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_DECIMAL:
-		clarion_dump_field_decimal(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      default:
-	      fprintf(stderr, "Unknown field type %d\n", clfd[nflds].fldtype);
-	      break;
-	    }
-	  fprintf(stdout, "\n");
+	  data += clfd[nflds].length;
+	  continue;
 	}
 
-      if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+      clarion_out_printf(out, "%8s : ", (clfd[nflds].fldname + 4));
+      CL_PROBE2(field__decode, clfd[nflds].fldtype, nflds);
+
+      switch (clfd[nflds].fldtype)
 	{
-	  fprintf(stdout, "MEMO ENTRY   : ");
-	  clarion_dump_memo_entry(&clrh, cl->memo, NULL, cl->charset);
-	  fprintf(stdout, "\n");
+	  case CL_FIELD_LONG:
+	    clarion_dump_field_long(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_REAL:
+	    clarion_dump_field_real(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_STRING:
+	  case CL_FIELD_STRING_PIC_TOK:
+	    clarion_dump_field_string(data, &clfd[nflds], out, NULL, cl->charset);
+	    break;
+	  case CL_FIELD_BYTE:
+	    clarion_dump_field_byte(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_SHORT:
+	    clarion_dump_field_short(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_DECIMAL:
+	    clarion_dump_field_decimal(data, &clfd[nflds], out, NULL);
+	    break;
+	  default:
+	  fprintf(stderr, "Unknown field type %d\n", clfd[nflds].fldtype);
+	  break;
 	}
+      clarion_out_putc(out, '\n');
 
-      fprintf(stdout, "\n");
+      data += clfd[nflds].length;
+    }
 
-      fflush(stdout);
+  if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+    {
+      clarion_out_puts(out, "MEMO ENTRY   : ");
+      CL_SET_PHASE(CL_PHASE_MEMO);
+      clarion_dump_memo_entry(cl, clrh, out, NULL);
+      CL_SET_PHASE(CL_PHASE_DATA);
+      clarion_out_putc(out, '\n');
     }
 
-  free(buf);
+  clarion_out_putc(out, '\n');
+
+  /* Keep stdout in step with the record information on stderr */
+  if (!(cl->opts & CL_OPT_PIPELINE))
+    clarion_out_flush(out);
+
+  CL_PROBE2(record__end, recno, clrh->rhd);
+}
+
+void
+clarion_dump_data (ClarionHandle *cl)
+{
+  clarion_dump_records(cl, clarion_dump_record, NULL);
 }
@@ -28,81 +28,191 @@
 
 #include "cldump.h"
 
+/*
+ * Writes one CSV value as per RFC 4180: values holding the separator, a
+ * double quote or a line break are enclosed in double quotes, with the
+ * embedded double quotes doubled. flags come from clarion_scan() run with
+ * cl->fsep as the separator, so clean values are written as they are.
+ */
 void
-clarion_dump_data_csv (ClarionHandle *cl)
+clarion_csv_write (ClarionOutput *out, const uint8_t *data, int len, unsigned int flags)
+{
+  int pos;
+
+  if (!(flags & (CL_SCAN_DQUOTE | CL_SCAN_SEPARATOR | CL_SCAN_NEWLINE)))
+    {
+      clarion_out_write(out, data, len);
+      return;
+    }
+
+  clarion_out_putc(out, '"');
+
+  while (len > 0)
+    {
+      pos = clarion_scan_find(data, len, '"', '"');
+
+      if (pos > 0)
+	clarion_out_write(out, data, pos);
+
+      if (pos == len)
+	break;
+
+      clarion_out_write(out, "\"\"", 2);
+
+      data += pos + 1;
+      len -= pos + 1;
+    }
+
+  clarion_out_putc(out, '"');
+}
+
+void
+clarion_csv_eol (ClarionHandle *cl, ClarionOutput *out)
+{
+  if (cl->opts & CL_OPT_CSV_CRLF)
+    clarion_out_write(out, "\r\n", 2);
+  else
+    clarion_out_putc(out, '\n');
+}
+
+void
+clarion_dump_field_string_csv (ClarionHandle *cl, uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out)
 {
-  int nrecs, nflds;
-  FILE *fp = cl->data;
+  char *utf;
+  size_t utflen;
+  unsigned int flags;
+  int len;
+
+  len = clarion_scan_string(buf, clfd->length, cl->fsep, &flags);
+
+  if (len == 0)
+    return;
+
+  if ((cl->charset != NULL) && (flags & CL_SCAN_NONASCII))
+    {
+      utf = clarion_iconv_scratch(cl->charset, (char *)buf, len, &utflen);
+
+      if (utf != NULL)
+	{
+	  clarion_csv_write(out, (uint8_t *)utf, utflen, flags);
+	  return;
+	}
+    }
+
+  clarion_csv_write(out, buf, len, flags);
+}
+
+static void
+clarion_dump_memo_entry_csv (ClarionHandle *cl, ClarionRecordHeader *clrh, ClarionOutput *out)
+{
+  uint8_t *memo;
+  char *utf;
+  size_t utflen;
+  unsigned int flags;
+  int len;
+
+  len = clarion_read_memo(cl, clrh, &memo);
+
+  if (len <= 0)
+    return;
+
+  clarion_scan(memo, len, cl->fsep, &flags);
+
+  if ((cl->charset != NULL) && (flags & CL_SCAN_NONASCII))
+    {
+      utf = clarion_iconv_scratch(cl->charset, (char *)memo, len, &utflen);
+
+      if (utf != NULL)
+	{
+	  clarion_csv_write(out, (uint8_t *)utf, utflen, flags);
+	  return;
+	}
+    }
+
+  clarion_csv_write(out, memo, len, flags);
+}
+
+static void
+clarion_dump_record_csv (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+			 uint8_t *data, ClarionOutput *out, void *ctx)
+{
+  int nflds;
+  int first = 1;
   ClarionHeader *clh = cl->clm.clh;
   ClarionFieldDesc *clfd = cl->clm.clfd;
-  ClarionRecordHeader clrh;
-  uint8_t *buf;
 
-  buf = (uint8_t *) malloc(clh->reclen * sizeof(uint8_t));
+  CL_PROBE2(record__start, recno, clrh->rhd);
 
-  for (nrecs = 0; nrecs < clh->numrecs; nrecs++)
-    {      
-      fread(&clrh.rhd, 1, 1, fp);
-      fread(&clrh.rptr, 4, 1, fp);
-
-      if ((clrh.rhd & CL_RECORD_DELETED) && (cl->opts & CL_OPT_DUMP_ACTIVE))
+  for (nflds = 0; nflds < clh->numflds; nflds++)
+    {
+      /*
+       * A field with type CL_FIELD_GROUP is a pseudo-field
+       * used to indicate that the next clfd[i].length fields
+       * are grouped together.
+       */
+      if (clfd[nflds].fldtype == CL_FIELD_GROUP)
 	{
-	  fseek(cl->data, (clh->reclen - 5), SEEK_CUR);
 	  continue;
 	}
 
-      for (nflds = 0; nflds < clh->numflds; nflds++)
+      /* Not in --columns */
+      if ((cl->colsel != NULL) && !cl->colsel[nflds])
 	{
-	  /*
-	   * A field with type CL_FIELD_GROUP is a pseudo-field
-	   * used to indicate that the next clfd[i].length fields
-	   * are grouped together.
-	   */
-	  if (clfd[nflds].fldtype == CL_FIELD_GROUP)
-	    {
-	      continue;
-	    }
-
-	  if (nflds > 0)
-	    fprintf(stdout, "%c", cl->fsep);
-
-	  switch (clfd[nflds].fldtype)
-	    {
-	      case CL_FIELD_LONG:
-		clarion_dump_field_long(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_REAL:
-		clarion_dump_field_real(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_STRING:
-	      case CL_FIELD_STRING_PIC_TOK:
-		clarion_dump_field_string(buf, &clfd[nflds], cl->data, NULL, cl->charset);
-		break;
-	      case CL_FIELD_BYTE:
-		clarion_dump_field_byte(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_SHORT:
-		clarion_dump_field_short(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      case CL_FIELD_DECIMAL:
-		clarion_dump_field_decimal(buf, &clfd[nflds], cl->data, NULL);
-		break;
-	      default:
-	      fprintf(stderr, "Unknown field type %d\n", clfd[nflds].fldtype);
-	      break;
-	    }
+	  data += clfd[nflds].length;
+	  continue;
 	}
 
-      if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+      if (!first)
+	clarion_out_putc(out, cl->fsep);
+      first = 0;
+
+      CL_PROBE2(field__decode, clfd[nflds].fldtype, nflds);
+
+      switch (clfd[nflds].fldtype)
 	{
-	  fprintf(stdout, "%c", cl->fsep);
-	  clarion_dump_memo_entry(&clrh, cl->memo, NULL, cl->charset);
+	  case CL_FIELD_LONG:
+	    clarion_dump_field_long(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_REAL:
+	    clarion_dump_field_real(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_STRING:
+	  case CL_FIELD_STRING_PIC_TOK:
+	    clarion_dump_field_string_csv(cl, data, &clfd[nflds], out);
+	    break;
+	  case CL_FIELD_BYTE:
+	    clarion_dump_field_byte(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_SHORT:
+	    clarion_dump_field_short(data, &clfd[nflds], out, NULL);
+	    break;
+	  case CL_FIELD_DECIMAL:
+	    clarion_dump_field_decimal(data, &clfd[nflds], out, NULL);
+	    break;
+	  default:
+	  fprintf(stderr, "Unknown field type %d\n", clfd[nflds].fldtype);
+	  break;
 	}
 
-      fprintf(stdout, "\n");
+      data += clfd[nflds].length;
+    }
 
-      fflush(stdout);
+  if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+    {
+      if (!first)
+	clarion_out_putc(out, cl->fsep);
+      CL_SET_PHASE(CL_PHASE_MEMO);
+      clarion_dump_memo_entry_csv(cl, clrh, out);
+      CL_SET_PHASE(CL_PHASE_DATA);
     }
 
-  free(buf);
+  clarion_csv_eol(cl, out);
+
+  CL_PROBE2(record__end, recno, clrh->rhd);
+}
+
+void
+clarion_dump_data_csv (ClarionHandle *cl)
+{
+  clarion_dump_records(cl, clarion_dump_record_csv, NULL);
 }
@@ -29,144 +29,145 @@
 
 #include "cldump.h"
 
-char tempBuff[32768];
+/*
+ * Writes the body of a SQL string literal. Single quotes are doubled;
+ * with MySQL rules the backslash is an escape character too and gets
+ * doubled as well, while ANSI SQL takes it literally. Clean runs between
+ * two escapes are copied to the output in one go.
+ */
+static void
+clarion_write_sql_escaped (ClarionOutput *out, const uint8_t *data, int len, int mysql)
+{
+  uint8_t esc = mysql ? '\\' : '\'';
+  int pos;
+
+  while (len > 0)
+    {
+      pos = clarion_scan_find(data, len, '\'', esc);
+
+      if (pos > 0)
+	clarion_out_write(out, data, pos);
+
+      if (pos == len)
+	break;
+
+      clarion_out_putc(out, data[pos]);
+      clarion_out_putc(out, data[pos]);
+
+      data += pos + 1;
+      len -= pos + 1;
+    }
+}
 
 static void
-clarion_dump_field_string_sql (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *charset)
+clarion_dump_field_string_sql (ClarionHandle *cl, uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out)
 {
   char *utf;
-  int i=0,j=0, len;
+  uint8_t *str;
+  size_t utflen;
+  unsigned int flags;
+  int mysql = (cl->opts & CL_OPT_MYSQL);
+  int len;
 
-  fread(buf, 1, clfd->length, fp);
-  buf[clfd->length] = '\0';
-  clarion_trim(buf, clfd->length);
+  len = clarion_scan_string(buf, clfd->length, '\0', &flags);
 
-  len = strlen((char *)buf);
-  if (len > 0)
+  if (len == 0)
+    {
+      clarion_out_write(out, "NULL", 4);
+      return;
+    }
+
+  str = buf;
+
+  /* Transcoding leaves quotes and backslashes alone, escape afterwards */
+  if ((cl->charset != NULL) && (flags & CL_SCAN_NONASCII))
     {
-      // Dirty hack to deal with single Quotes...
-      for (i=0;i<=len;i++) {
-	tempBuff[i+j] = buf[i];
-	if (buf[i] == '\'') { j++; tempBuff[i+j] = '\''; }
-	if (buf[i] == '\\') { j++; tempBuff[i+j] = '\\'; }
-      }
-
-      if (charset != NULL)
+      utf = clarion_iconv_scratch(cl->charset, (char *)buf, len, &utflen);
+
+      if (utf != NULL)
 	{
-	  utf = clarion_iconv(charset, (char *)tempBuff);
-
-	  if (utf != NULL)
-	    {
-	      fprintf(stdout, "'%s'", utf);
-	      free(utf);
-	    }
-	  else {
-	    fprintf(stdout, "'%s'", tempBuff);
-	  }
+	  str = (uint8_t *)utf;
+	  len = utflen;
 	}
-      else
-	fprintf(stdout, "'%s'", tempBuff);
     }
+
+  clarion_out_putc(out, '\'');
+
+  if ((flags & CL_SCAN_SQUOTE) || (mysql && (flags & CL_SCAN_BACKSLASH)))
+    clarion_write_sql_escaped(out, str, len, mysql);
   else
-    fprintf(stdout, "NULL");
+    clarion_out_write(out, str, len);
 
-  fflush(stdout);
+  clarion_out_putc(out, '\'');
 }
 
 static void
-clarion_dump_memo_entry_sql (ClarionRecordHeader *clrh, FILE *fp, char *charset)
+clarion_dump_memo_entry_sql (ClarionHandle *cl, ClarionRecordHeader *clrh, ClarionOutput *out)
 {
-  int i, j;
-  ClarionMemoEntry clme;
-  char buf[512];
-  char *utf;
+  uint8_t *memo;
+  int len;
+
+  len = clarion_read_memo(cl, clrh, &memo);
 
-  if ((clrh->rhd & CL_RECORD_DELETED) || (clrh->rptr == 0))
+  if (len < 0)
     {
-      fprintf(stdout, "NULL");
+      clarion_out_write(out, "NULL", 4);
 
       return;
     }
 
-  fseek(fp, (((clrh->rptr - 1) * 256) + 6), SEEK_SET);
-
-  fprintf(stdout, "'");
-
-  do {
-    memset(buf, 0, 512);
-    fread(&clme.nxtblk, 4, 1, fp);
-    fread(&clme.memo, 1, 252, fp);
-    
-    clme.memo[252] = '\0';
-
-    if (clme.nxtblk == 0)
-      {
-	clarion_trim(clme.memo, 252);
-
-	clarion_singlespace((char *)clme.memo);
-
-	/* Sanitize the \r\n mess */
-	for (i = 0, j = 0; clme.memo[i] != '\0'; i++, j++)
-	  {
-	    switch(clme.memo[i])
-	      {
-	        case '\n':
-		  buf[j++] = '\\';
-		  buf[j] = 'n';
-		  break;
-	        case '\r':
-		  j--;
-		  break;
-	        case '\'':
-		  buf[j++] = '\'';
-		  buf[j] = '\'';
-		  break;
-	        default:
-		  buf[j] = clme.memo[i];
-	      }
-	  }
-      }
-
-    if (strlen(buf) > 0)
-      {
-	if (charset != NULL)
-	  {
-	    utf = clarion_iconv(charset, buf);
-
-	    if (utf != NULL)
-	      {
-		fprintf(stdout, "%s", utf);
-		free(utf);
-	      }
-	    else
-	      fprintf(stdout, "%s", buf);
-	  }
-	else
-	  fprintf(stdout, "%s", buf);
-      }
-
-    if (clme.nxtblk == 0)
-      break;
-    else
-      fseek(fp, ((clme.nxtblk * 256) + 6), SEEK_SET);
-  } while (1);
-
-  fprintf(stdout, "'");
-
-  fflush(stdout);
+  len = clarion_memo_normalize(memo, len, cl->charset, (cl->opts & CL_OPT_MYSQL), &memo);
+
+  clarion_out_putc(out, '\'');
+
+  if (len > 0)
+    clarion_out_write(out, memo, len);
+
+  clarion_out_putc(out, '\'');
 }
 
-void
-clarion_dump_data_sql (ClarionHandle *cl)
+/* Column list of the INSERT statements with --columns, named as in the schema */
+static void
+clarion_dump_columns_sql (ClarionHandle *cl, ClarionOutput *out)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  char buf[17];
+  char *name;
+  int first = 1;
+  int i, j;
+
+  clarion_out_putc(out, '(');
+
+  for (i = 0; i < cl->clm.clh->numflds; i++)
+    {
+      if ((clfd[i].fldtype == CL_FIELD_GROUP) || !cl->colsel[i])
+	continue;
+
+      name = clarion_field_name(&clfd[i], buf);
+
+      for (j = 0; name[j] != '\0'; j++)
+	name[j] = tolower(name[j]);
+
+      clarion_out_printf(out, "%s%c%s%c", first ? "" : ", ", cl->sql_quote_begin, name, cl->sql_quote_end);
+      first = 0;
+    }
+
+  if ((cl->clm.clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+    clarion_out_printf(out, "%s%cmemo%c", first ? "" : ", ", cl->sql_quote_begin, cl->sql_quote_end);
+
+  clarion_out_puts(out, ") ");
+}
+
+static void
+clarion_dump_record_sql (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+			 uint8_t *data, ClarionOutput *out, void *ctx)
 {
   int i;
-  int nrecs, nflds;
-  FILE *fp = cl->data;
+  int nflds;
+  int first = 1;
+  char *tblname = (char *)ctx;
   ClarionHeader *clh = cl->clm.clh;
   ClarionFieldDesc *clfd = cl->clm.clfd;
-  ClarionRecordHeader clrh;
-  uint8_t *buf;
-  char *cbuf, *tblname;
   char *rhd[8] = {
     "NEW RECORD",
     "OLD RECORD",
@@ -178,101 +179,116 @@ clarion_dump_data_sql (ClarionHandle *cl)
     "*** UNDEFINED (7) ***"
   };
 
-  buf = (uint8_t *) malloc(clh->reclen * sizeof(uint8_t));
+  CL_PROBE2(record__start, recno, clrh->rhd);
 
-  cbuf = strdup(cl->datfile);
-  cbuf[strlen(cbuf) - 4] = '\0';
-  tblname = strrchr(cbuf, '/');
-
-  if (tblname != NULL)
-    tblname++;
-  else
-    tblname = cbuf;
-
-  for (i = 0; i < strlen(tblname); i++)
+  if (clrh->rhd & CL_RECORD_DELETED)
     {
-      tblname[i] = tolower(tblname[i]);
+      clarion_out_puts(out, "-- Record attributes:");
+
+      for (i = 0; i < 8; i++)
+	{
+	  if ((clrh->rhd >> i) & 0x01)
+	    clarion_out_printf(out, " [%s]", rhd[i]);
+	}
+      clarion_out_putc(out, '\n');
     }
 
-  for (nrecs = 0; nrecs < clh->numrecs; nrecs++)
-    {      
-      fread(&clrh.rhd, 1, 1, fp);
-      fread(&clrh.rptr, 4, 1, fp);
+  clarion_out_printf(out, "INSERT INTO %c%s%c ", cl->sql_quote_begin, tblname, cl->sql_quote_end);
+
+  if (cl->colsel != NULL)
+    clarion_dump_columns_sql(cl, out);
 
-      if (clrh.rhd & CL_RECORD_DELETED)
+  clarion_out_puts(out, "VALUES(");
+
+  for (nflds = 0; nflds < clh->numflds; nflds++)
+    {
+      /*
+       * A field with type CL_FIELD_GROUP is a pseudo-field
+       * used to indicate that the next clfd[i].length fields
+       * are grouped together.
+       */
+      if (clfd[nflds].fldtype == CL_FIELD_GROUP)
 	{
-	  if (cl->opts & CL_OPT_DUMP_ACTIVE)
-	    {
-	      fseek(cl->data, (clh->reclen - 5), SEEK_CUR);
-	      continue;
-	    }
-	  else
-	    {
-	      fprintf(stdout, "-- Record attributes:");
-
-	      for (i = 0; i < 8; i++)
-		{
-		  if ((clrh.rhd >> i) & 0x01)
-		    fprintf(stdout, " [%s]", rhd[i]);
-		}
-	      fprintf(stdout, "\n");
-	    }
+	  continue;
 	}
 
-      fprintf(stdout, "INSERT INTO %c%s%c VALUES(", cl->sql_quote_begin, tblname, cl->sql_quote_end);
-
-      for (nflds = 0; nflds < clh->numflds; nflds++)
+      /* Not in --columns */
+      if ((cl->colsel != NULL) && !cl->colsel[nflds])
 	{
-	  /*
-	   * A field with type CL_FIELD_GROUP is a pseudo-field
-	   * used to indicate that the next clfd[i].length fields
-	   * are grouped together.
-	   */
-	  if (clfd[nflds].fldtype == CL_FIELD_GROUP)
-	    {
-	      continue;
-	    }
-
-	  switch (clfd[nflds].fldtype)
-	    {
-	      case CL_FIELD_LONG:
-		clarion_dump_field_long(buf, &clfd[nflds], cl->data, "NULL");
-		break;
-	      case CL_FIELD_REAL:
-		clarion_dump_field_real(buf, &clfd[nflds], cl->data, "NULL");
-		break;
-	      case CL_FIELD_STRING:
-	      case CL_FIELD_STRING_PIC_TOK:
-		clarion_dump_field_string_sql(buf, &clfd[nflds], cl->data, cl->charset);
-		break;
-	      case CL_FIELD_BYTE:
-		clarion_dump_field_byte(buf, &clfd[nflds], cl->data, "NULL");
-		break;
-	      case CL_FIELD_SHORT:
-		clarion_dump_field_short(buf, &clfd[nflds], cl->data, "NULL");
-		break;
-	      case CL_FIELD_DECIMAL:
-		clarion_dump_field_decimal(buf, &clfd[nflds], cl->data, "NULL");
-		break;
-	      default:
-	      fprintf(stderr, "Unknown field type %d\n", clfd[nflds].fldtype);
-	      break;
-	    }
-
-	  if (nflds < clh->numflds - 1)
-	    fprintf(stdout, ", ");
+	  data += clfd[nflds].length;
+	  continue;
 	}
 
-      if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+      if (!first)
+	clarion_out_write(out, ", ", 2);
+      first = 0;
+
+      CL_PROBE2(field__decode, clfd[nflds].fldtype, nflds);
+
+      switch (clfd[nflds].fldtype)
 	{
-	  fprintf(stdout, ", ");
-	  clarion_dump_memo_entry_sql(&clrh, cl->memo, cl->charset);
+	  case CL_FIELD_LONG:
+	    clarion_dump_field_long(data, &clfd[nflds], out, "NULL");
+	    break;
+	  case CL_FIELD_REAL:
+	    clarion_dump_field_real(data, &clfd[nflds], out, "NULL");
+	    break;
+	  case CL_FIELD_STRING:
+	  case CL_FIELD_STRING_PIC_TOK:
+	    clarion_dump_field_string_sql(cl, data, &clfd[nflds], out);
+	    break;
+	  case CL_FIELD_BYTE:
+	    clarion_dump_field_byte(data, &clfd[nflds], out, "NULL");
+	    break;
+	  case CL_FIELD_SHORT:
+	    clarion_dump_field_short(data, &clfd[nflds], out, "NULL");
+	    break;
+	  case CL_FIELD_DECIMAL:
+	    clarion_dump_field_decimal(data, &clfd[nflds], out, "NULL");
+	    break;
+	  default:
+	  fprintf(stderr, "Unknown field type %d\n", clfd[nflds].fldtype);
+	  break;
 	}
 
-      fprintf(stdout, ");\n");
+      data += clfd[nflds].length;
+    }
+
+  if ((clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
+    {
+      if (!first)
+	clarion_out_write(out, ", ", 2);
+      CL_SET_PHASE(CL_PHASE_MEMO);
+      clarion_dump_memo_entry_sql(cl, clrh, out);
+      CL_SET_PHASE(CL_PHASE_DATA);
+    }
+
+  clarion_out_write(out, ");\n", 3);
+
+  CL_PROBE2(record__end, recno, clrh->rhd);
+}
+
+void
+clarion_dump_data_sql (ClarionHandle *cl)
+{
+  int i;
+  char *cbuf, *tblname;
 
-      fflush(stdout);
+  cbuf = strdup(cl->datfile);
+  cbuf[strlen(cbuf) - 4] = '\0';
+  tblname = strrchr(cbuf, '/');
+
+  if (tblname != NULL)
+    tblname++;
+  else
+    tblname = cbuf;
+
+  for (i = 0; i < strlen(tblname); i++)
+    {
+      tblname[i] = tolower(tblname[i]);
     }
 
-  free(buf);
+  clarion_dump_records(cl, clarion_dump_record_sql, tblname);
+
+  free(cbuf);
 }
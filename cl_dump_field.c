@@ -29,47 +29,64 @@
 
 #include "cldump.h"
 
-void
-clarion_dump_memo_entry (ClarionRecordHeader *clrh, FILE *fp, char *plchold, char *charset)
+/* Per-thread buffer the memo entries are collected into */
+static __thread uint8_t *cl_memo_buf;
+static __thread size_t cl_memo_buflen;
+
+/*
+ * Collects the memo entry of a record, block by block, into a per-thread
+ * buffer that is reused from one record to the next. Trailing spaces of
+ * the last block are trimmed and each block stops at its first NUL byte.
+ * Returns the length of the memo or -1 if the record has none.
+ */
+int
+clarion_read_memo (ClarionHandle *cl, ClarionRecordHeader *clrh, uint8_t **memo)
 {
+  FILE *fp = cl->memo;
   ClarionMemoEntry clme;
-  char *utf;
   uint32_t curblk;
+  size_t len = 0;
+  size_t blklen;
+  uint32_t blocks = 0;
+  uint8_t *tmp;
 
   if ((clrh->rhd & CL_RECORD_DELETED) || (clrh->rptr == 0))
-    {
-      if (plchold != NULL)
-	fprintf(stdout, "%s", plchold);
+    return -1;
 
-      return;
-    }
+  if (cl->cache != NULL)
+    return clarion_cache_memo(cl, clrh->recno, memo);
 
-  fseek(fp, (((clrh->rptr - 1) * 256) + 6), SEEK_SET);
+  CL_FSEEK(CL_PHASE_MEMO, fp, (((clrh->rptr - 1) * 256) + 6), SEEK_SET);
 
   curblk = clrh->rptr - 1;
   do {
-    fread(&clme.nxtblk, 4, 1, fp);
-    fread(&clme.memo, 1, 252, fp);
-    
+    CL_FREAD(CL_PHASE_MEMO, &clme.nxtblk, 4, 1, fp);
+    CL_FREAD(CL_PHASE_MEMO, &clme.memo, 1, 252, fp);
+    blocks++;
+
+    if (cl->opts & CL_OPT_DECRYPT_READ)
+      clarion_xor(clme.memo, 252, cl->key);
+
     clme.memo[252] = '\0';
 
     if (clme.nxtblk == 0)
       clarion_trim(clme.memo, 252);
 
-    if (charset != NULL)
+    blklen = strlen((char *)clme.memo);
+
+    if (len + blklen + 1 > cl_memo_buflen)
       {
-	utf = clarion_iconv(charset, (char *)clme.memo);
-
-	if (utf != NULL)
-	  {
-	    fprintf(stdout, "%s", utf);
-	    free(utf);
-	  }
-	else
-	  fprintf(stdout, "%s", clme.memo);
+	tmp = (uint8_t *) CL_REALLOC(cl_memo_buf, cl_memo_buflen + 4096);
+
+	if (tmp == NULL)
+	  break;
+
+	cl_memo_buf = tmp;
+	cl_memo_buflen += 4096;
       }
-    else
-      fprintf(stdout, "%s", clme.memo);
+
+    memcpy(cl_memo_buf + len, clme.memo, blklen);
+    len += blklen;
 
     if (clme.nxtblk == 0)
       break;
@@ -79,125 +96,170 @@ clarion_dump_memo_entry (ClarionRecordHeader *clrh, FILE *fp, char *plchold, cha
 	break;
       }
 
-    fseek(fp, ((clme.nxtblk * 256) + 6), SEEK_SET);
+    CL_FSEEK(CL_PHASE_MEMO, fp, ((clme.nxtblk * 256) + 6), SEEK_SET);
     curblk = clme.nxtblk;
   } while (1);
 
-  fflush(stdout);
+  CL_STAT(membytes, (uint64_t)blocks * 256);
+  clarion_stats_memo(blocks);
+  CL_PROBE2(memo__fetch, clrh->rptr, blocks);
+
+  if (cl_memo_buf == NULL)
+    return -1;
+
+  cl_memo_buf[len] = '\0';
+  *memo = cl_memo_buf;
+
+  return len;
 }
 
 void
-clarion_dump_field_long (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold)
+clarion_dump_memo_entry (ClarionHandle *cl, ClarionRecordHeader *clrh, ClarionOutput *out, char *plchold)
 {
-  uint32_t *lbuf = (uint32_t *) buf;
+  char *charset = cl->charset;
+  uint8_t *memo;
+  char *utf;
+  size_t utflen;
+  unsigned int flags;
+  int len;
 
-  fread(buf, clfd->length, 1, fp);
+  len = clarion_read_memo(cl, clrh, &memo);
 
-  /* Clear the starting uninitialized byte */
-  if ((*lbuf >> 24) & 0x80)
-    *lbuf &= 0x00ffffff;
+  if (len < 0)
+    {
+      if (plchold != NULL)
+	clarion_out_puts(out, plchold);
 
-  fprintf(stdout, "%d", *lbuf);
-  fflush(stdout);
+      return;
+    }
+
+  clarion_scan(memo, len, '\0', &flags);
+
+  if ((charset != NULL) && (flags & CL_SCAN_NONASCII))
+    {
+      utf = clarion_iconv_scratch(charset, (char *)memo, len, &utflen);
+
+      if (utf != NULL)
+	{
+	  memo = (uint8_t *)utf;
+	  len = utflen;
+	}
+    }
+
+  clarion_out_write(out, memo, len);
 }
 
+/*
+ * The field decoders below work on the field data as found in the
+ * record, buf pointing to its first byte; the record is left untouched.
+ */
+
 void
-clarion_dump_field_real (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold)
+clarion_dump_field_long (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold)
 {
-  double *dbuf = (double *) buf;
-  uint8_t uninit[8];
+  uint32_t lval;
+
+  memcpy(&lval, buf, 4);
+  lval = le32toh(lval);
 
-  fread(buf, clfd->length, 1, fp);
+  /* Clear the starting uninitialized byte */
+  if ((lval >> 24) & 0x80)
+    lval &= 0x00ffffff;
 
+  clarion_out_int(out, (int32_t)lval);
+}
+
+void
+clarion_dump_field_real (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold)
+{
   /* Uninitialized: BO FF FF FF FF FF EF FF */
-  memset(uninit, 0xff, 8);
-#if BYTE_ORDER == BIG_ENDIAN
-  uninit[7] = 0xb0;
-  uninit[1] = 0xef;
-#else
-  uninit[0] = 0xb0;
-  uninit[6] = 0xef;
-#endif
+  static const uint8_t uninit[8] = { 0xb0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xff };
+  uint64_t qval;
+  double dval;
 
   if (memcmp(uninit, buf, clfd->length) == 0)
     {
       if (plchold != NULL)
-	fprintf(stdout, "%s", plchold);
+	clarion_out_puts(out, plchold);
+
+      return;
     }
-  else
-    fprintf(stdout, "%*f", clfd->decdec, *dbuf);
 
-  fflush(stdout);
+  memcpy(&qval, buf, 8);
+  qval = le64toh(qval);
+  memcpy(&dval, &qval, 8);
+
+  clarion_out_printf(out, "%*f", clfd->decdec, dval);
 }
 
 void
-clarion_dump_field_string (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold, char *charset)
+clarion_dump_field_string (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold, char *charset)
 {
   char *utf;
+  size_t utflen;
+  unsigned int flags;
+  int len;
 
-  fread(buf, 1, clfd->length, fp);
-  buf[clfd->length] = '\0';
-  clarion_trim(buf, clfd->length);
+  len = clarion_scan_string(buf, clfd->length, '\0', &flags);
 
-  if (strlen((char *)buf) > 0)
+  if (len > 0)
     {
-      if (charset != NULL)
+      /* Plain ASCII reads the same in the source charset and in UTF-8 */
+      if ((charset != NULL) && (flags & CL_SCAN_NONASCII))
 	{
-	  utf = clarion_iconv(charset, (char *)buf);
+	  utf = clarion_iconv_scratch(charset, (char *)buf, len, &utflen);
 
 	  if (utf != NULL)
-	    {
-	      fprintf(stdout, "%s", utf);
-	      free(utf);
-	    }
+	    clarion_out_write(out, utf, utflen);
 	  else
-	    fprintf(stdout, "%s", buf);
+	    clarion_out_write(out, buf, len);
 	}
       else
-	fprintf(stdout, "%s", buf);
+	clarion_out_write(out, buf, len);
     }
   else if (plchold != NULL)
-    fprintf(stdout, "%s", plchold);
-
-  fflush(stdout);
+    clarion_out_puts(out, plchold);
 }
 
 void
-clarion_dump_field_byte (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold)
+clarion_dump_field_byte (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold)
 {
-  fread(buf, clfd->length, 1, fp);
-
-  fprintf(stdout, "%d", *buf);
-  fflush(stdout);
+  clarion_out_int(out, *buf);
 }
 
 void
-clarion_dump_field_short (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold)
+clarion_dump_field_short (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold)
 {
-  uint16_t *sbuf = (uint16_t *) buf;
+  uint16_t sval;
 
-  fread(buf, clfd->length, 1, fp);
+  memcpy(&sval, buf, 2);
 
-  fprintf(stdout, "%d", *sbuf);
-  fflush(stdout);
+  clarion_out_int(out, le16toh(sval));
 }
 
 void
-clarion_dump_field_decimal (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold)
+clarion_dump_field_decimal (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold)
 {
   int i;
   int count;
+  char sbuf[2 * 32 + 2];
   char *cbuf, *obuf;
   uint8_t mask;
 
-  fread(buf, 1, clfd->length, fp);
-
   /*
    * BCD means two figures per byte
    * We eventually need to put a . somewhere
    * Not forgetting the '\0'
    */
-  cbuf = (char *) malloc(clfd->length * 2 + 2);
+  if (clfd->length <= 32)
+    cbuf = sbuf;
+  else
+    {
+      cbuf = (char *) clarion_scratch_alloc(clfd->length * 2 + 2);
+
+      if (cbuf == NULL)
+	return;
+    }
 
   /* Odd number of figures, strip the first nibble */
   mask = (clfd->decsig % 2) ? 0x0f : 0xf0;
@@ -229,23 +291,19 @@ clarion_dump_field_decimal (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char
   cbuf[count] = '\0';
 
   /* Strip the leading zeros */  
-  for (obuf = cbuf; i < strlen(cbuf); obuf++)
-    {
-      if (*obuf != '0')
-	break;
-    }
+  for (obuf = cbuf; *obuf == '0'; obuf++)
+    ;
 
   if (*obuf == '.')
-    fprintf(stdout, "0%s", obuf);
+    {
+      clarion_out_putc(out, '0');
+      clarion_out_write(out, obuf, cbuf + count - obuf);
+    }
   else
     {
-      if (strlen(obuf) > 0)
-	fprintf(stdout, "%s", obuf);
+      if (*obuf != '\0')
+	clarion_out_write(out, obuf, cbuf + count - obuf);
       else if (plchold != NULL)
-	fprintf(stdout, "%s", plchold);
+	clarion_out_puts(out, plchold);
     }
-
-  free(cbuf);
-
-  fflush(stdout);
 }
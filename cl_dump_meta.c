@@ -28,11 +28,75 @@
 
 #include "cldump.h"
 
+/* Decodes the time of last change of a header, -1 if out of range */
+int
+clarion_decode_time (uint32_t chgtime, int *hour, int *min, int *sec, int *cs)
+{
+  int tmp;
+
+  if ((chgtime < 1) || (chgtime > 8640000))
+    return -1;
+
+  tmp = (chgtime - 1);
+  *hour = tmp / 360000;
+  tmp = chgtime % 360000;
+  *min = tmp / 6000;
+  tmp = tmp % 6000;
+  *sec = tmp / 100;
+  *cs = tmp % 100;
+
+  return 0;
+}
+
+/* Decodes the date of last change of a header, -1 if out of range */
+int
+clarion_decode_date (uint32_t chgdate, int *year, int *month, int *day)
+{
+  int i;
+  int tmp;
+  int days_in_month[12] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+  };
+
+  if ((chgdate <= 3) || (chgdate > 109211))
+    return -1;
+
+  tmp = (chgdate > 36527) ? (chgdate - 3) : (chgdate - 4);
+  *year = (1801 + (4 * (tmp / 1461)));
+  tmp = tmp % 1461;
+  if (tmp != 1460)
+    {
+      *year += (tmp / 365);
+      *day = tmp % 365;
+    }
+  else
+    {
+      *year += 3;
+      *day = 365;
+    }
+  *year += (*year < 100) ? 1900 : 0;
+  if ((*year % 4 == 0) && (*year != 1900))
+    days_in_month[1] = 29;
+  for (i = 0; i < 12; i++)
+    {
+      *day -= days_in_month[i];
+      if (*day < 0)
+	{
+	  *day += days_in_month[i] + 1;
+	  break;
+	}
+    }
+  *month = i + 1;
+
+  return 0;
+}
+
 static void
 clarion_dump_header (ClarionHeader *clh)
 {
   int i;
-  int tmp, val, year, day;
+  int year, month, day;
+  int hour, min, sec, cs;
   char *sfatr[8] = {
     "FILE LOCKED",
     "FILE OWNED",
@@ -43,9 +107,6 @@ clarion_dump_header (ClarionHeader *clh)
     "READ ONLY",
     "MAY BE CREATED"
   };
-  int days_in_month[12] = {
-    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
-  };
 
   fprintf(stderr, "===== FILE HEADER FOLLOWS =====\n");
 
@@ -100,58 +161,17 @@ clarion_dump_header (ClarionHeader *clh)
   fprintf(stderr, "reserved : 0x%08x\n", clh->reserved);
 
   fprintf(stderr, "chgtime  : 0x%08x [", clh->chgtime);
-  if ((clh->chgtime < 1) || (clh->chgtime > 8640000))
-    {
-      fprintf(stderr, "INVALID");
-    }
+  if (clarion_decode_time(clh->chgtime, &hour, &min, &sec, &cs) < 0)
+    fprintf(stderr, "INVALID");
   else
-    {
-      tmp = (clh -> chgtime - 1);
-      val = tmp / 360000;
-      fprintf(stderr, "%02d:", val);
-      tmp = clh->chgtime % 360000;
-      val = tmp / 6000;
-      fprintf(stderr, "%02d:", val);
-      tmp = tmp % 6000;
-      val = tmp / 100;
-      fprintf(stderr, "%02d.%02d", val, (tmp % 100));
-    }
+    fprintf(stderr, "%02d:%02d:%02d.%02d", hour, min, sec, cs);
   fprintf(stderr, "]\n");
 
   fprintf(stderr, "chgdate  : 0x%08x [", clh->chgdate);
-  if ((clh->chgdate <= 3) || (clh->chgdate > 109211))
-    {
-      fprintf(stderr, "INVALID");
-    }
+  if (clarion_decode_date(clh->chgdate, &year, &month, &day) < 0)
+    fprintf(stderr, "INVALID");
   else
-    {
-      tmp = (clh->chgdate > 36527) ? (clh->chgdate - 3) : (clh->chgdate - 4);
-      year = (1801 + (4 * (tmp / 1461)));
-      tmp = tmp % 1461;
-      if (tmp != 1460)
-	{
-	  year += (tmp / 365);
-	  day = tmp % 365;
-	}
-      else
-	{
-	  year += 3;
-	  day = 365;
-	}
-      year += (year < 100) ? 1900 : 0;
-      if ((year % 4 == 0) && (year != 1900))
-	days_in_month[1] = 29;
-      for (i = 0; i < 12; i++)
-	{
-	  day -= days_in_month[i];
-	  if (day < 0)
-	    {
-	      day += days_in_month[i] + 1;
-	      break;
-	    }
-	}
-      fprintf(stderr, "%d-%02d-%02d", year, (i + 1), day);
-    }
+    fprintf(stderr, "%d-%02d-%02d", year, month, day);
   fprintf(stderr, "]\n");
 
   fprintf(stderr, "reserved2: 0x%04x\n", clh->reserved2);
@@ -344,5 +364,7 @@ void
 clarion_dump_schema (ClarionHandle *cl)
 {
   clarion_dump_field_desc(cl->clm.clfd, cl->clm.clh->numflds, cl->clm.clp);
+
+  clarion_probe_keys(cl);
   clarion_dump_key_desc(cl->clm.clk, cl->clm.clfd, cl->clm.clh->numbkeys);
 }
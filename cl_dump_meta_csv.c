@@ -32,12 +32,20 @@ static void
 clarion_dump_field_desc_csv(ClarionHandle *cl)
 {
   int i;
+  int first = 1;
   uint8_t buf[17];
   uint8_t *pbuf;
+  unsigned int flags;
   ClarionFieldDesc *clfd;
+  ClarionOutput out;
 
   clfd = cl->clm.clfd;
 
+  fflush(stdout);
+
+  if (clarion_out_init(&out, fileno(stdout), 4096) < 0)
+    return;
+
   for (i = 0; i < cl->clm.clh->numflds; i++)
     {
       /*
@@ -45,29 +53,34 @@ clarion_dump_field_desc_csv(ClarionHandle *cl)
        * used to indicate that the next clfd[i].length fields
        * are grouped together.
        */
-      if (clfd[i].fldtype == CL_FIELD_GROUP)
+      if ((clfd[i].fldtype == CL_FIELD_GROUP) || ((cl->colsel != NULL) && !cl->colsel[i]))
 	{
 	  continue;
 	}
 
-      if (i > 0)
-	fprintf(stdout, "%c", cl->fsep);
+      if (!first)
+	clarion_out_putc(&out, cl->fsep);
+      first = 0;
 
       memcpy(buf, clfd[i].fldname, 17);
       clarion_trim(buf, 16);
       pbuf = (uint8_t *)strchr((char *)buf, ':');
+      pbuf = (pbuf != NULL) ? pbuf + 1 : buf;
 
-      fprintf(stdout, "%s", (pbuf != NULL) ? ++pbuf : buf);
+      clarion_scan(pbuf, strlen((char *)pbuf), cl->fsep, &flags);
+      clarion_csv_write(&out, pbuf, strlen((char *)pbuf), flags);
     }
 
   if ((cl->clm.clh->sfatr & CL_MEMO_FILE_EXISTS) && (!(cl->opts & CL_OPT_NO_MEMO)))
     {
-      fprintf(stdout, "%cMEMO", cl->fsep);
+      if (!first)
+	clarion_out_putc(&out, cl->fsep);
+      clarion_out_puts(&out, "MEMO");
     }
 
-  fprintf(stdout, "\n");
+  clarion_csv_eol(cl, &out);
 
-  fflush(stdout);
+  clarion_out_free(&out);
 }
 
 void
@@ -222,6 +222,7 @@ clarion_dump_schema_sql (ClarionHandle *cl)
   clarion_dump_field_desc_sql(cl);
   fprintf(stdout, "\n);\n");
 
+  clarion_probe_keys(cl);
   clarion_dump_key_desc_sql(cl, cl->clm.clk, cl->clm.clfd, cl->clm.clh->numbkeys, pbuf);
 
   free(buf);
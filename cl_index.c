@@ -0,0 +1,588 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cldump.h"
+
+/*
+ * Secondary hash indexes
+ *
+ * --build-index COL writes <table>.<COL>.IDX next to the data file: an
+ * open addressing table from the 64-bit hash of each value of the field
+ * to the numbers of the records holding it, in record order. Values are
+ * decoded as in cl_where.c, strings without their trailing spaces and
+ * numbers by value, uninitialized REALs are left out. All the records
+ * are indexed, deleted ones included, whatever the selection options.
+ * The hashes are computed by the parallel scan (see
+ * clarion_scan_records()), the table is then laid out in two passes
+ * over them.
+ *
+ * --lookup COL=VALUE maps the index and dumps the records listed under
+ * the hash of VALUE. The lookup also goes into the --where comparisons,
+ * so records that only share the hash are filtered out and the selection
+ * options apply as usual. An index built before the change date and time
+ * or the number of records of the header changed is stale: it is left
+ * alone and the whole table is scanned instead.
+ */
+
+#define CL_INDEX_MAGIC           "CLDINDEX"
+#define CL_INDEX_VERSION         1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t numrecs;
+  uint32_t chgdate;
+  uint32_t chgtime;
+  uint16_t reclen;
+  uint16_t field;
+  uint8_t fldtype;
+  uint8_t pad;
+  uint16_t length;
+  uint32_t count; /* record numbers */
+  uint32_t size; /* slots, power of 2 */
+  uint32_t values; /* slots in use */
+  uint32_t pad2;
+} ClarionIndexHeader;
+
+typedef struct {
+  uint64_t hash; /* 0 for an empty slot */
+  uint32_t first; /* of its record numbers */
+  uint32_t count;
+} ClarionIndexSlot;
+
+struct ClarionIndex {
+  uint8_t *map;
+  size_t maplen;
+  const ClarionIndexSlot *slot;
+  const uint32_t *recno;
+  uint32_t size;
+  uint32_t count;
+  uint64_t hash; /* of the value looked up */
+};
+
+typedef struct {
+  uint64_t hash;
+  uint32_t recno;
+} ClarionIndexEntry;
+
+/* The hashes of the records of a scan slice */
+typedef struct {
+  ClarionFieldDesc *clfd;
+  int offset;
+  ClarionIndexEntry *ent;
+  uint32_t count;
+  uint32_t size;
+} ClarionIndexBuild;
+
+
+/* <table>.<field>.IDX next to the data file */
+static char *
+clarion_index_path (ClarionHandle *cl, int field)
+{
+  const char *base;
+  const char *dot;
+  char buf[17];
+  char *name;
+  char *path;
+  size_t len;
+
+  name = clarion_field_name(&cl->clm.clfd[field], buf);
+
+  base = strrchr(cl->datfile, '/');
+  base = (base != NULL) ? base + 1 : cl->datfile;
+
+  dot = strrchr(base, '.');
+  len = (dot != NULL) ? (size_t)(dot - cl->datfile) : strlen(cl->datfile);
+
+  path = (char *) CL_MALLOC(len + strlen(name) + 8);
+
+  if (path != NULL)
+    sprintf(path, "%.*s.%s.IDX", (int)len, cl->datfile, name);
+
+  return path;
+}
+
+static void
+clarion_index_key (ClarionHandle *cl, int field, ClarionIndexHeader *key)
+{
+  ClarionHeader *clh = cl->clm.clh;
+
+  memset(key, 0, sizeof(ClarionIndexHeader));
+  memcpy(key->magic, CL_INDEX_MAGIC, 8);
+  key->version = CL_INDEX_VERSION;
+  key->numrecs = clh->numrecs;
+  key->chgdate = clh->chgdate;
+  key->chgtime = clh->chgtime;
+  key->reclen = clh->reclen;
+  key->field = field;
+  key->fldtype = cl->clm.clfd[field].fldtype;
+  key->length = cl->clm.clfd[field].length;
+}
+
+/*
+ * Finds the slot of hash, or the empty one it goes in. Returns size when
+ * there is neither, the table has no empty slot left.
+ */
+static uint32_t
+clarion_index_probe (const ClarionIndexSlot *slot, uint32_t size, uint64_t hash)
+{
+  uint32_t i;
+  uint32_t n;
+
+  for (i = hash & (size - 1), n = 0; n < size; i = (i + 1) & (size - 1), n++)
+    {
+      if ((slot[i].hash == 0) || (slot[i].hash == hash))
+	return i;
+    }
+
+  return size;
+}
+
+static uint32_t
+clarion_index_size (uint32_t count)
+{
+  uint32_t size = 16;
+
+  while ((size < (1U << 31)) && (size / 2 < count))
+    size *= 2;
+
+  return size;
+}
+
+static void
+clarion_index_add (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+		   uint8_t *data, ClarionOutput *out, void *ctx)
+{
+  ClarionIndexBuild *ib = (ClarionIndexBuild *)ctx;
+  ClarionIndexEntry *tmp;
+  ClarionValue v;
+  uint32_t size;
+
+  clarion_field_value(ib->clfd, data + ib->offset, &v);
+
+  if (v.type == CL_VALUE_NULL)
+    return;
+
+  if (ib->count == ib->size)
+    {
+      size = (ib->size > 0) ? ib->size * 2 : 4096;
+      tmp = (ClarionIndexEntry *) CL_REALLOC(ib->ent, (size_t)size * sizeof(ClarionIndexEntry));
+
+      if (tmp == NULL)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+
+      ib->ent = tmp;
+      ib->size = size;
+    }
+
+  ib->ent[ib->count].hash = clarion_value_hash(ib->clfd, &v);
+  ib->ent[ib->count].recno = recno;
+  ib->count++;
+}
+
+/* Writes the index to path, aside first so a concurrent lookup sees either one whole */
+static int
+clarion_index_write (const char *path, ClarionIndexHeader *hdr, ClarionIndexSlot *slot, uint32_t *recno)
+{
+  char *tmp;
+  FILE *fp;
+  mode_t mask;
+  int ret;
+  int fd;
+
+  tmp = (char *) CL_MALLOC(strlen(path) + 8);
+  if (tmp == NULL)
+    return -1;
+
+  sprintf(tmp, "%s.XXXXXX", path);
+
+  fd = mkstemp(tmp);
+  if (fd < 0)
+    {
+      free(tmp);
+      return -1;
+    }
+
+  mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+
+  fp = fdopen(fd, "wb");
+  if (fp == NULL)
+    {
+      close(fd);
+      unlink(tmp);
+      free(tmp);
+      return -1;
+    }
+
+  fwrite(hdr, sizeof(ClarionIndexHeader), 1, fp);
+  fwrite(slot, sizeof(ClarionIndexSlot), hdr->size, fp);
+  fwrite(recno, sizeof(uint32_t), hdr->count, fp);
+
+  ret = ferror(fp) ? -1 : 0;
+
+  if ((fclose(fp) != 0) || (ret < 0) || (rename(tmp, path) < 0))
+    {
+      unlink(tmp);
+      ret = -1;
+    }
+
+  free(tmp);
+
+  return ret;
+}
+
+int
+clarion_index_build (ClarionHandle *cl, const char *col)
+{
+  ClarionIndexHeader hdr;
+  ClarionIndexBuild *ib;
+  ClarionIndexSlot *tmp = NULL;
+  ClarionIndexSlot *slot = NULL;
+  ClarionIndexEntry *e;
+  uint32_t *recno = NULL;
+  uint32_t tmpsize;
+  uint32_t first;
+  uint32_t i, k;
+  uint64_t t0;
+  void **ctx;
+  char *path = NULL;
+  int nctx;
+  int field;
+  int ret = -1;
+  int j;
+
+  field = clarion_find_field(cl, col, strlen(col));
+
+  if (field < 0)
+    {
+      fprintf(stderr, "Unknown column %s\n", col);
+      return -1;
+    }
+
+  t0 = CL_TRACE_BEGIN();
+
+  /* All of the records go in */
+  cl->opts &= ~(CL_OPT_DUMP_ACTIVE | CL_OPT_DELETED_ONLY);
+  cl->status = 0;
+  cl->recfirst = 0;
+  cl->recend = 0;
+  cl->skip = 0;
+  cl->limit = 0;
+  cl->sample = 0;
+  cl->where = NULL;
+
+  if (cl->colread != NULL)
+    cl->colread[field] = 1;
+
+  ib = (ClarionIndexBuild *) CL_CALLOC(cl->jobs, sizeof(ClarionIndexBuild));
+  ctx = (void **) CL_CALLOC(cl->jobs, sizeof(void *));
+
+  if ((ib == NULL) || (ctx == NULL))
+    goto nomem;
+
+  for (j = 0; j < cl->jobs; j++)
+    {
+      ib[j].clfd = &cl->clm.clfd[field];
+      ib[j].offset = clarion_field_offset(cl, field);
+      ctx[j] = &ib[j];
+    }
+
+  nctx = clarion_scan_records(cl, clarion_index_add, ctx, cl->jobs);
+
+  clarion_index_key(cl, field, &hdr);
+
+  for (j = 0; j < nctx; j++)
+    hdr.count += ib[j].count;
+
+  /* Counts per hash first, the slices come in record order */
+  tmpsize = clarion_index_size(hdr.count);
+  tmp = (ClarionIndexSlot *) CL_CALLOC(tmpsize, sizeof(ClarionIndexSlot));
+
+  if (tmp == NULL)
+    goto nomem;
+
+  for (j = 0; j < nctx; j++)
+    {
+      for (i = 0, e = ib[j].ent; i < ib[j].count; i++, e++)
+	{
+	  k = clarion_index_probe(tmp, tmpsize, e->hash);
+
+	  if (tmp[k].hash == 0)
+	    {
+	      tmp[k].hash = e->hash;
+	      hdr.values++;
+	    }
+
+	  tmp[k].count++;
+	}
+    }
+
+  /* Then the slots of the index, sized for the distinct values */
+  hdr.size = clarion_index_size(hdr.values);
+  slot = (ClarionIndexSlot *) CL_CALLOC(hdr.size, sizeof(ClarionIndexSlot));
+  recno = (uint32_t *) CL_MALLOC(((size_t)hdr.count + 1) * sizeof(uint32_t));
+
+  if ((slot == NULL) || (recno == NULL))
+    goto nomem;
+
+  for (i = 0; i < tmpsize; i++)
+    {
+      if (tmp[i].hash != 0)
+	slot[clarion_index_probe(slot, hdr.size, tmp[i].hash)] = tmp[i];
+    }
+
+  for (i = 0, first = 0; i < hdr.size; i++)
+    {
+      slot[i].first = first;
+      first += slot[i].count;
+      slot[i].count = 0;
+    }
+
+  for (j = 0; j < nctx; j++)
+    {
+      for (i = 0, e = ib[j].ent; i < ib[j].count; i++, e++)
+	{
+	  k = clarion_index_probe(slot, hdr.size, e->hash);
+	  recno[slot[k].first + slot[k].count++] = e->recno;
+	}
+    }
+
+  path = clarion_index_path(cl, field);
+
+  if (path == NULL)
+    goto nomem;
+
+  ret = clarion_index_write(path, &hdr, slot, recno);
+
+  if (ret < 0)
+    fprintf(stderr, "Couldn't write index %s\n", path);
+
+  CL_TRACE_END("index", "io", t0, "records", hdr.count);
+
+ out:
+  for (j = 0; (ib != NULL) && (j < cl->jobs); j++)
+    free(ib[j].ent);
+
+  free(ib);
+  free(ctx);
+  free(tmp);
+  free(slot);
+  free(recno);
+  free(path);
+
+  return ret;
+
+ nomem:
+  fprintf(stderr, "Out of memory\n");
+  goto out;
+}
+
+/* Maps the index at path if it matches key, NULL otherwise */
+static ClarionIndex *
+clarion_index_map (const char *path, const ClarionIndexHeader *key)
+{
+  ClarionIndexHeader hdr;
+  ClarionIndex *ix;
+  struct stat st;
+  uint8_t *map;
+  uint32_t used;
+  uint32_t i;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(ClarionIndexHeader)))
+    {
+      close(fd);
+      return NULL;
+    }
+
+  map = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  memcpy(&hdr, map, sizeof(ClarionIndexHeader));
+
+  ix = (ClarionIndex *) CL_MALLOC(sizeof(ClarionIndex));
+
+  if ((ix == NULL) || (memcmp(hdr.magic, key->magic, offsetof(ClarionIndexHeader, count)) != 0)
+      || (hdr.size == 0) || (hdr.size & (hdr.size - 1))
+      || ((uint64_t)st.st_size != sizeof(ClarionIndexHeader) + (uint64_t)hdr.size * sizeof(ClarionIndexSlot)
+	  + (uint64_t)hdr.count * sizeof(uint32_t)))
+    {
+      free(ix);
+      munmap(map, st.st_size);
+      return NULL;
+    }
+
+  ix->map = map;
+  ix->maplen = st.st_size;
+  ix->slot = (const ClarionIndexSlot *)(map + sizeof(ClarionIndexHeader));
+  ix->recno = (const uint32_t *)(ix->slot + hdr.size);
+  ix->size = hdr.size;
+  ix->count = hdr.count;
+
+  /* Every slice inside the record numbers, and an empty slot left to end the probes */
+  for (i = 0, used = 0; (hdr.values < hdr.size) && (i < hdr.size); i++)
+    {
+      if ((uint64_t)ix->slot[i].first + ix->slot[i].count > hdr.count)
+	break;
+
+      if (ix->slot[i].hash != 0)
+	used++;
+    }
+
+  if ((hdr.values >= hdr.size) || (i < hdr.size) || (used != hdr.values))
+    {
+      free(ix);
+      munmap(map, st.st_size);
+      return NULL;
+    }
+
+  return ix;
+}
+
+/*
+ * --lookup: spec is COL=VALUE. Adds the comparison to --where and maps
+ * the index of COL if there is an up to date one.
+ */
+int
+clarion_index_open (ClarionHandle *cl, const char *spec)
+{
+  ClarionIndexHeader key;
+  ClarionValue *v;
+  const char *eq;
+  char *lit;
+  char *path;
+  int field;
+
+  eq = strchr(spec, '=');
+
+  if (eq == NULL)
+    {
+      fprintf(stderr, "Syntax error in --lookup, COL=VALUE expected: %s\n", spec);
+      return -1;
+    }
+
+  field = clarion_find_field(cl, spec, eq - spec);
+
+  if (field < 0)
+    {
+      fprintf(stderr, "Unknown column %.*s\n", (int)(eq - spec), spec);
+      return -1;
+    }
+
+  lit = (char *) clarion_arena_alloc(&cl->arena, strlen(eq));
+  v = (ClarionValue *) clarion_arena_calloc(&cl->arena, 1, sizeof(ClarionValue));
+
+  if ((lit == NULL) || (v == NULL))
+    return -1;
+
+  strcpy(lit, eq + 1);
+
+  if (clarion_value_parse(&cl->clm.clfd[field], lit, v) < 0)
+    {
+      fprintf(stderr, "Not a number in --lookup: %s\n", lit);
+      return -1;
+    }
+
+  if (clarion_where_equal(cl, field, v) < 0)
+    return -1;
+
+  path = clarion_index_path(cl, field);
+
+  if (path == NULL)
+    return -1;
+
+  clarion_index_key(cl, field, &key);
+
+  cl->index = clarion_index_map(path, &key);
+
+  if (cl->index == NULL)
+    fprintf(stderr, "No up to date index %s, scanning the table\n", path);
+  else
+    cl->index->hash = clarion_value_hash(&cl->clm.clfd[field], v);
+
+  free(path);
+
+  return 0;
+}
+
+/*
+ * Record numbers listed under the value looked up, in range and in file
+ * order. Returns NULL to scan the records in range after all.
+ */
+uint32_t *
+clarion_index_records (ClarionHandle *cl, uint32_t *count)
+{
+  ClarionIndex *ix = cl->index;
+  const ClarionIndexSlot *s;
+  uint32_t *recs;
+  uint32_t i;
+  uint32_t n = 0;
+
+  /* The slots were checked by clarion_index_map() */
+  s = &ix->slot[clarion_index_probe(ix->slot, ix->size, ix->hash)];
+
+  recs = (uint32_t *) CL_MALLOC(((size_t)s->count + 1) * sizeof(uint32_t));
+
+  if (recs == NULL)
+    return NULL;
+
+  for (i = 0; (s->hash != 0) && (i < s->count); i++)
+    {
+      if ((ix->recno[s->first + i] >= cl->recfirst) && (ix->recno[s->first + i] < cl->recend))
+	recs[n++] = ix->recno[s->first + i];
+    }
+
+  *count = n;
+
+  return recs;
+}
+
+void
+clarion_index_close (ClarionHandle *cl)
+{
+  if (cl->index == NULL)
+    return;
+
+  munmap(cl->index->map, cl->index->maplen);
+  free(cl->index);
+  cl->index = NULL;
+}
@@ -0,0 +1,406 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "cldump.h"
+
+/*
+ * Table inventory for --inventory
+ *
+ * Only the header and the descriptors of each data file are read, and
+ * the memo and key files are only looked up for their size, so a table
+ * costs a couple of small reads whatever its size. Files are spread over
+ * up to cl->jobs threads, then listed by name, one CSV or JSON row each.
+ * The schema fingerprint is a 64-bit FNV-1a hash of the descriptors, the
+ * same for tables with the same fields, keys and pictures.
+ */
+
+enum {
+  CL_TABLE_UNREADABLE = 0,
+  CL_TABLE_INVALID,
+  CL_TABLE_ENCRYPTED, /* no key found, only sfatr is known */
+  CL_TABLE_OK
+};
+
+static const char *cl_table_states[] = {
+  "unreadable",
+  "invalid",
+  "encrypted",
+  "ok"
+};
+
+typedef struct {
+  char *file;
+  int state;
+  ClarionHeader clh;
+  uint64_t datsize;
+  uint64_t memsize;
+  uint64_t keysize;
+  uint64_t fingerprint;
+} ClarionTable;
+
+typedef struct {
+  ClarionHandle *cl;
+  ClarionTable *tables;
+  int ntables;
+  int next;
+} ClarionInventory;
+
+
+/* Size of file, 0 if it can't be found */
+static uint64_t
+clarion_file_size (const char *file)
+{
+  struct stat st;
+
+  return (stat(file, &st) == 0) ? (uint64_t)st.st_size : 0;
+}
+
+static void
+clarion_inventory_one (ClarionHandle *tmpl, ClarionTable *t)
+{
+  ClarionHandle cl;
+  ClarionHeader *clh;
+  struct stat st;
+  char *name;
+  size_t len;
+  int l, r;
+  int i;
+
+  memset(&cl, 0, sizeof(ClarionHandle));
+  cl.opts = tmpl->opts;
+  cl.decmode = tmpl->decmode;
+  cl.datfile = t->file;
+
+  t->state = CL_TABLE_UNREADABLE;
+
+  cl.data = fopen(t->file, "rb");
+  if (cl.data == NULL)
+    {
+      fprintf(stderr, "Couldn't open file %s !\n", t->file);
+      return;
+    }
+
+  if (fstat(fileno(cl.data), &st) == 0)
+    t->datsize = st.st_size;
+
+  t->state = CL_TABLE_INVALID;
+
+  if (clarion_read_header(&cl) != 0)
+    goto out;
+
+  clh = cl.clm.clh;
+
+  if (clh->sfatr & CL_RECORDS_ENCRYPTED)
+    {
+      t->state = CL_TABLE_ENCRYPTED;
+      t->clh.sfatr = clh->sfatr;
+
+      if (cl.decmode == 0)
+	cl.decmode = clarion_find_key(&cl);
+
+      if ((cl.decmode <= 0) || (clarion_decrypt_meta_load(&cl) != 0))
+	goto out;
+
+      clh = cl.clm.clh;
+    }
+  else if ((clh->offset < 85) || (clarion_load_meta(&cl, clh->offset) != 0))
+    goto out;
+
+  t->clh = *clh;
+  t->state = CL_TABLE_OK;
+
+  /* numbkeys, numflds to reclen, then the descriptors */
+  t->fingerprint = clarion_fnv(CL_FNV_OFFSET, cl.meta + 4, 1);
+  t->fingerprint = clarion_fnv(t->fingerprint, cl.meta + 13, 8);
+  t->fingerprint = clarion_fnv(t->fingerprint, cl.meta + 85, clh->offset - 85);
+
+  len = strlen(t->file);
+  name = strdup(t->file);
+  if (name == NULL)
+    goto out;
+
+  if (clh->sfatr & CL_MEMO_FILE_EXISTS)
+    {
+      memcpy(name + len - 3, "MEM", 3);
+      t->memsize = clarion_file_size(name);
+    }
+
+  name[len - 3] = 'K';
+
+  for (i = 0; i < clh->numbkeys; i++)
+    {
+      l = (i + 1) / 16;
+      r = (i + 1) % 16;
+      name[len - 2] = (l > 9) ? 'a' + (l - 10) : '0' + l;
+      name[len - 1] = (r > 9) ? 'a' + (r - 10) : '0' + r;
+
+      t->keysize += clarion_file_size(name);
+    }
+
+  free(name);
+
+ out:
+  fclose(cl.data);
+  free(cl.meta);
+  clarion_arena_free(&cl.arena);
+}
+
+static void *
+clarion_inventory_worker (void *arg)
+{
+  ClarionInventory *inv = (ClarionInventory *)arg;
+  int i;
+
+  while ((i = __atomic_fetch_add(&inv->next, 1, __ATOMIC_RELAXED)) < inv->ntables)
+    clarion_inventory_one(inv->cl, &inv->tables[i]);
+
+  return NULL;
+}
+
+static int
+clarion_cmp_table (const void *a, const void *b)
+{
+  return strcmp(((const ClarionTable *)a)->file, ((const ClarionTable *)b)->file);
+}
+
+/* Last change as YYYY-MM-DD HH:MM:SS.cc, empty if the date is invalid */
+static void
+clarion_table_changed (ClarionTable *t, char *buf, size_t size)
+{
+  int year, month, day;
+  int hour, min, sec, cs;
+  int n;
+
+  buf[0] = '\0';
+
+  if ((t->state != CL_TABLE_OK) || (clarion_decode_date(t->clh.chgdate, &year, &month, &day) < 0))
+    return;
+
+  n = snprintf(buf, size, "%d-%02d-%02d", year, month, day);
+
+  if (clarion_decode_time(t->clh.chgtime, &hour, &min, &sec, &cs) == 0)
+    snprintf(buf + n, size - n, " %02d:%02d:%02d.%02d", hour, min, sec, cs);
+}
+
+static void
+clarion_inventory_csv (ClarionHandle *cl, ClarionTable *tables, int ntables, ClarionOutput *out)
+{
+  static const char *cols[] = {
+    "file", "state", "numrecs", "numdels", "reclen", "numflds", "numkeys", "sfatr",
+    "encrypted", "memo", "datsize", "memsize", "keysize", "changed", "fingerprint"
+  };
+  ClarionTable *t;
+  unsigned int flags;
+  char changed[32];
+  int i;
+
+  if (cl->opts & CL_OPT_CSV_HEADER)
+    {
+      for (i = 0; i < (int)(sizeof(cols) / sizeof(cols[0])); i++)
+	{
+	  if (i > 0)
+	    clarion_out_putc(out, cl->fsep);
+	  clarion_out_puts(out, cols[i]);
+	}
+
+      clarion_csv_eol(cl, out);
+    }
+
+  for (i = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      clarion_scan((const uint8_t *)t->file, strlen(t->file), cl->fsep, &flags);
+      clarion_csv_write(out, (const uint8_t *)t->file, strlen(t->file), flags);
+      clarion_out_printf(out, "%c%s", cl->fsep, cl_table_states[t->state]);
+
+      if (t->state == CL_TABLE_OK)
+	clarion_out_printf(out, "%c%u%c%u%c%u%c%u%c%u", cl->fsep, t->clh.numrecs, cl->fsep, t->clh.numdels,
+			   cl->fsep, t->clh.reclen, cl->fsep, t->clh.numflds, cl->fsep, t->clh.numbkeys);
+      else
+	clarion_out_printf(out, "%c%c%c%c%c", cl->fsep, cl->fsep, cl->fsep, cl->fsep, cl->fsep);
+
+      if (t->state >= CL_TABLE_ENCRYPTED)
+	clarion_out_printf(out, "%c0x%04x%c%d%c%d", cl->fsep, t->clh.sfatr,
+			   cl->fsep, !!(t->clh.sfatr & CL_RECORDS_ENCRYPTED),
+			   cl->fsep, !!(t->clh.sfatr & CL_MEMO_FILE_EXISTS));
+      else
+	clarion_out_printf(out, "%c%c%c", cl->fsep, cl->fsep, cl->fsep);
+
+      clarion_table_changed(t, changed, sizeof(changed));
+
+      clarion_out_printf(out, "%c%llu%c%llu%c%llu%c%s%c", cl->fsep, (unsigned long long)t->datsize,
+			 cl->fsep, (unsigned long long)t->memsize, cl->fsep, (unsigned long long)t->keysize,
+			 cl->fsep, changed, cl->fsep);
+
+      if (t->state == CL_TABLE_OK)
+	clarion_out_printf(out, "%016llx", (unsigned long long)t->fingerprint);
+
+      clarion_csv_eol(cl, out);
+    }
+}
+
+static void
+clarion_json_string (ClarionOutput *out, const char *s)
+{
+  clarion_out_putc(out, '"');
+
+  for (; *s != '\0'; s++)
+    {
+      if ((*s == '"') || (*s == '\\'))
+	clarion_out_putc(out, '\\');
+
+      if ((uint8_t)*s < 0x20)
+	clarion_out_printf(out, "\\u%04x", (uint8_t)*s);
+      else
+	clarion_out_putc(out, *s);
+    }
+
+  clarion_out_putc(out, '"');
+}
+
+static void
+clarion_inventory_json (ClarionTable *tables, int ntables, ClarionOutput *out)
+{
+  ClarionTable *t;
+  char changed[32];
+  int i;
+
+  clarion_out_puts(out, "[\n");
+
+  for (i = 0; i < ntables; i++)
+    {
+      t = &tables[i];
+
+      clarion_out_puts(out, "  {\"file\": ");
+      clarion_json_string(out, t->file);
+      clarion_out_printf(out, ", \"state\": \"%s\"", cl_table_states[t->state]);
+
+      if (t->state == CL_TABLE_OK)
+	clarion_out_printf(out, ", \"numrecs\": %u, \"numdels\": %u, \"reclen\": %u, \"numflds\": %u, \"numkeys\": %u",
+			   t->clh.numrecs, t->clh.numdels, t->clh.reclen, t->clh.numflds, t->clh.numbkeys);
+
+      if (t->state >= CL_TABLE_ENCRYPTED)
+	clarion_out_printf(out, ", \"sfatr\": %u, \"encrypted\": %s, \"memo\": %s", t->clh.sfatr,
+			   (t->clh.sfatr & CL_RECORDS_ENCRYPTED) ? "true" : "false",
+			   (t->clh.sfatr & CL_MEMO_FILE_EXISTS) ? "true" : "false");
+
+      clarion_out_printf(out, ", \"datsize\": %llu, \"memsize\": %llu, \"keysize\": %llu",
+			 (unsigned long long)t->datsize, (unsigned long long)t->memsize,
+			 (unsigned long long)t->keysize);
+
+      clarion_table_changed(t, changed, sizeof(changed));
+
+      if (changed[0] != '\0')
+	clarion_out_printf(out, ", \"changed\": \"%s\"", changed);
+
+      if (t->state == CL_TABLE_OK)
+	clarion_out_printf(out, ", \"fingerprint\": \"%016llx\"", (unsigned long long)t->fingerprint);
+
+      clarion_out_puts(out, (i + 1 < ntables) ? "},\n" : "}\n");
+    }
+
+  clarion_out_puts(out, "]\n");
+}
+
+/*
+ * Lists the given data files, and the .DAT files in the given
+ * directories, on stdout, as JSON if json is set and as CSV otherwise.
+ * Returns -1 if any of them couldn't be read.
+ */
+int
+clarion_inventory (ClarionHandle *cl, char **paths, int npaths, int json)
+{
+  ClarionInventory inv;
+  ClarionOutput out;
+  pthread_t *tids;
+  char **files = NULL;
+  int nfiles = 0;
+  int nthreads;
+  int started;
+  int ret = 0;
+  int i;
+
+  for (i = 0; i < npaths; i++)
+    {
+      if (clarion_collect_files(paths[i], &files, &nfiles) < 0)
+	ret = -1;
+    }
+
+  memset(&inv, 0, sizeof(ClarionInventory));
+  inv.cl = cl;
+  inv.ntables = nfiles;
+  inv.tables = (ClarionTable *) calloc((nfiles > 0) ? nfiles : 1, sizeof(ClarionTable));
+
+  if ((inv.tables == NULL) || (clarion_out_init(&out, STDOUT_FILENO, 64 * 1024) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (i = 0; i < nfiles; i++)
+    inv.tables[i].file = files[i];
+  free(files);
+
+  nthreads = (cl->jobs < nfiles) ? cl->jobs : nfiles;
+
+  tids = (pthread_t *) malloc(((nthreads > 0) ? nthreads : 1) * sizeof(pthread_t));
+
+  for (started = 1; (tids != NULL) && (started < nthreads); started++)
+    {
+      if (pthread_create(&tids[started], NULL, clarion_inventory_worker, &inv) != 0)
+	break;
+    }
+
+  clarion_inventory_worker(&inv);
+
+  for (i = 1; (tids != NULL) && (i < started); i++)
+    pthread_join(tids[i], NULL);
+
+  free(tids);
+
+  qsort(inv.tables, nfiles, sizeof(ClarionTable), clarion_cmp_table);
+
+  if (json)
+    clarion_inventory_json(inv.tables, nfiles, &out);
+  else
+    clarion_inventory_csv(cl, inv.tables, nfiles, &out);
+
+  clarion_out_free(&out);
+
+  for (i = 0; i < nfiles; i++)
+    {
+      if (inv.tables[i].state <= CL_TABLE_INVALID)
+	ret = -1;
+
+      free(inv.tables[i].file);
+    }
+  free(inv.tables);
+
+  return ret;
+}
@@ -25,57 +25,138 @@
 #include <stdint.h>
 #include <endian.h>
 #include <byteswap.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "cldump.h"
 
+/*
+ * The header and the descriptors, [0, clh->offset), are read in one go
+ * into cl->meta and parsed from there; every read is checked against the
+ * end of the region. Key files are only opened when their key type is
+ * needed, by clarion_probe_keys(). Everything is allocated from the
+ * handle's arena.
+ */
+
+static inline uint16_t
+cl_get16 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+cl_get32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Checks that len more bytes are available past cl->metapos */
+static inline int
+cl_meta_avail (ClarionHandle *cl, size_t len)
+{
+  return (cl->metapos + len <= cl->metalen);
+}
+
+/* Reads [0, size) of the data file into cl->meta */
+int
+clarion_load_meta (ClarionHandle *cl, uint32_t size)
+{
+  struct stat st;
+  uint8_t *buf;
+  size_t got = 0;
+  ssize_t ret;
+  int fd = fileno(cl->data);
+
+  if ((fstat(fd, &st) == 0) && (size > st.st_size))
+    {
+      fprintf(stderr, "Descriptors past the end of the data file (%u / %lu)\n", size, (unsigned long)st.st_size);
+      return -1;
+    }
+
+  buf = (uint8_t *) CL_REALLOC(cl->meta, size);
+  if (buf == NULL)
+    return -1;
+
+  cl->meta = buf;
+  cl->metalen = 0;
+
+  while (got < size)
+    {
+      ret = CL_PREAD(CL_PHASE_META, fd, buf + got, size - got, got);
+
+      if ((ret < 0) && (errno == EINTR))
+	continue;
+
+      if (ret <= 0)
+	{
+	  fprintf(stderr, "Short read on data file: %s\n", (ret < 0) ? strerror(errno) : "EOF");
+	  return -1;
+	}
+
+      got += ret;
+    }
+
+  cl->metalen = size;
+
+  CL_STAT(datbytes, size);
+
+  return 0;
+}
+
 int
 clarion_read_header (ClarionHandle *cl)
 {
   ClarionHeader *clh;
-  FILE *fp = cl->data;
-
-  clh = (ClarionHeader *) malloc(sizeof(ClarionHeader));
+  uint8_t *p;
 
-  if (clh == NULL)
+  if ((cl->metalen < 85) && (clarion_load_meta(cl, 85) != 0))
     return -1;
 
-  fread(&clh->filesig, 2, 1, fp);
+  p = cl->meta;
 
-  if (clh->filesig != CL_DATA_FILE_SIG)
+  if (cl_get16(p) != CL_DATA_FILE_SIG)
     {
-      free(clh);
       fprintf(stderr, "Invalid data file !\n");
       return -1;
     }
 
-  fread(&clh->sfatr, 2, 1, fp);
-  fread(&clh->numbkeys, 1, 1, fp);
-  fread(&clh->numrecs, 4, 1, fp);
-  fread(&clh->numdels, 4, 1, fp);
-  fread(&clh->numflds, 2, 1, fp);
-  fread(&clh->numpics, 2, 1, fp);
-  fread(&clh->numarrs, 2, 1, fp);
-  fread(&clh->reclen, 2, 1, fp);
-  fread(&clh->offset, 4, 1, fp);
-  fread(&clh->logeof, 4, 1, fp);
-  fread(&clh->logbof, 4, 1, fp);
-  fread(&clh->freerec, 4, 1, fp);
-  fread(clh->recname, 1, 12, fp);
+  clh = (ClarionHeader *) clarion_arena_alloc(&cl->arena, sizeof(ClarionHeader));
+
+  if (clh == NULL)
+    return -1;
+
+  clh->filesig = cl_get16(p);
+  clh->sfatr = cl_get16(p + 2);
+  clh->numbkeys = p[4];
+  clh->numrecs = cl_get32(p + 5);
+  clh->numdels = cl_get32(p + 9);
+  clh->numflds = cl_get16(p + 13);
+  clh->numpics = cl_get16(p + 15);
+  clh->numarrs = cl_get16(p + 17);
+  clh->reclen = cl_get16(p + 19);
+  clh->offset = cl_get32(p + 21);
+  clh->logeof = cl_get32(p + 25);
+  clh->logbof = cl_get32(p + 29);
+  clh->freerec = cl_get32(p + 33);
+  memcpy(clh->recname, p + 37, 12);
   clh->recname[12] = '\0';
-  fread(clh->memnam, 1, 12, fp);
+  memcpy(clh->memnam, p + 49, 12);
   clh->memnam[12] = '\0';
-  fread(clh->filpre, 1, 3, fp);
+  memcpy(clh->filpre, p + 61, 3);
   clh->filpre[3] = '\0';
-  fread(clh->recpre, 1, 3, fp);
+  memcpy(clh->recpre, p + 64, 3);
   clh->recpre[3] = '\0';
-  fread(&clh->memolen, 2, 1, fp);
-  fread(&clh->memowid, 2, 1, fp);
-  fread(&clh->reserved, 4, 1, fp);
-  fread(&clh->chgtime, 4, 1, fp);
-  fread(&clh->chgdate, 4, 1, fp);
-  fread(&clh->reserved2, 2, 1, fp);
+  clh->memolen = cl_get16(p + 67);
+  clh->memowid = cl_get16(p + 69);
+  clh->reserved = cl_get32(p + 71);
+  clh->chgtime = cl_get32(p + 75);
+  clh->chgdate = cl_get32(p + 79);
+  clh->reserved2 = cl_get16(p + 83);
 
   cl->clm.clh = clh;
+  cl->metapos = 85;
 
   return 0;
 }
@@ -86,32 +167,41 @@ clarion_read_field_desc(ClarionHandle *cl)
 {
   int i;
   int numflds = cl->clm.clh->numflds;
-  FILE *fp = cl->data;
   ClarionFieldDesc *clfd;
+  uint8_t *p;
 
   if (numflds == 0)
     return 0;
 
-  clfd = (ClarionFieldDesc *) malloc(numflds * sizeof(ClarionFieldDesc));
+  if (!cl_meta_avail(cl, numflds * 27))
+    {
+      fprintf(stderr, "Field descriptors past the start of the records\n");
+      return -1;
+    }
+
+  clfd = (ClarionFieldDesc *) clarion_arena_alloc(&cl->arena, numflds * sizeof(ClarionFieldDesc));
 
   if (clfd == NULL)
     return -1;
 
-  for (i = 0; i < numflds; i++)
+  p = cl->meta + cl->metapos;
+
+  for (i = 0; i < numflds; i++, p += 27)
     {
-      fread(&clfd[i].fldtype, 1, 1, fp);
-      fread(&clfd[i].fldname, 1, 16, fp);
+      clfd[i].fldtype = p[0];
+      memcpy(clfd[i].fldname, p + 1, 16);
       clfd[i].fldname[16] = '\0';
-      fread(&clfd[i].foffset, 2, 1, fp);
-      fread(&clfd[i].length, 2, 1, fp);
-      fread(&clfd[i].decsig, 1, 1, fp);
-      fread(&clfd[i].decdec, 1, 1, fp);
-      fread(&clfd[i].arrnum, 2, 1, fp);
-      fread(&clfd[i].picnum, 2, 1, fp);
+      clfd[i].foffset = cl_get16(p + 17);
+      clfd[i].length = cl_get16(p + 19);
+      clfd[i].decsig = p[21];
+      clfd[i].decdec = p[22];
+      clfd[i].arrnum = cl_get16(p + 23);
+      clfd[i].picnum = cl_get16(p + 25);
       clfd[i].arr = NULL;
       clfd[i].nbarrs = 0;
     }
 
+  cl->metapos += numflds * 27;
   cl->clm.clfd = clfd;
 
   return 0;
@@ -121,65 +211,65 @@ int
 clarion_read_key_desc (ClarionHandle *cl)
 {
   int i, j, k;
-  int l, r;
   int numbkeys = cl->clm.clh->numbkeys;
+  int numflds = cl->clm.clh->numflds;
   int numparts;
-  FILE *fp = cl->data;
-  FILE *fk;
   ClarionKeyDesc *clk;
   ClarionKeyPart *subpart;
   ClarionFieldDesc *clfd;
-  char *keyfile;
+  uint8_t *p;
 
   if (numbkeys == 0)
     return 0;
 
-  clk = (ClarionKeyDesc *) malloc(numbkeys * sizeof(ClarionKeyDesc));
+  clk = (ClarionKeyDesc *) clarion_arena_calloc(&cl->arena, numbkeys, sizeof(ClarionKeyDesc));
 
   if (clk == NULL)
     return -1;
 
-  keyfile = strdup(cl->datfile);
-  keyfile[strlen(keyfile) - 3] = 'K';
+  cl->clm.clk = clk;
 
   clfd = cl->clm.clfd;
 
   for (i = 0; i < numbkeys; i++)
     {
-      fread(&clk[i].numcomps, 1, 1, fp);
-      fread(&clk[i].keyname, 1, 16, fp);
-      fread(&clk[i].comptype, 1, 1, fp);
-      fread(&clk[i].complen, 1, 1, fp);
+      if (!cl_meta_avail(cl, 19))
+	goto truncated;
 
-      /* Read the keytype from the key file */
-      l = (i + 1) / 16;
-      r = (i + 1) % 16;
-      keyfile[strlen(keyfile) - 2] = (l > 9) ? 'a' + (l - 10) : '0' + l;
-      keyfile[strlen(keyfile) - 1] = (r > 9) ? 'a' + (r - 10) : '0' + r;
+      p = cl->meta + cl->metapos;
 
-      fk = fopen(keyfile, "rb");
+      clk[i].numcomps = p[0];
+      memcpy(clk[i].keyname, p + 1, 16);
+      clk[i].comptype = p[17];
+      clk[i].complen = p[18];
+      clk[i].keytype = CL_KEYTYPE_ERROR;
 
-      if (fk != NULL)
-	{
-	  fseek(fk, 29, SEEK_SET);
-	  fread(&clk[i].keytype, 1, 1, fk);
-	  fclose(fk);
-	}
-      else
-	{
-	  clk[i].keytype = CL_KEYTYPE_ERROR;
-	  fprintf(stderr, "Couldn't open key file %s !\n", keyfile);
-	}
-      /* Done */
+      cl->metapos += 19;
+
+      if (!cl_meta_avail(cl, clk[i].numcomps * 6))
+	goto truncated;
 
-      clk[i].keypart = (ClarionKeyPart *) malloc(clk[i].numcomps * sizeof(ClarionKeyPart));
+      clk[i].keypart = (ClarionKeyPart *) clarion_arena_alloc(&cl->arena, clk[i].numcomps * sizeof(ClarionKeyPart));
 
-      for (j = 0; j < clk[i].numcomps; j++)
+      if (clk[i].keypart == NULL)
+	return -1;
+
+      p = cl->meta + cl->metapos;
+
+      for (j = 0; j < clk[i].numcomps; j++, p += 6)
 	{
-	  fread(&clk[i].keypart[j].fldtype, 1, 1, fp);
-	  fread(&clk[i].keypart[j].fldnum, 2, 1, fp);
-	  fread(&clk[i].keypart[j].elmoff, 2, 1, fp);
-	  fread(&clk[i].keypart[j].elmlen, 1, 1, fp);
+	  clk[i].keypart[j].fldtype = p[0];
+	  clk[i].keypart[j].fldnum = cl_get16(p + 1);
+	  clk[i].keypart[j].elmoff = cl_get16(p + 3);
+	  clk[i].keypart[j].elmlen = p[5];
+	  clk[i].keypart[j].numparts = 0;
+	  clk[i].keypart[j].subpart = NULL;
+
+	  if ((clk[i].keypart[j].fldnum < 1) || (clk[i].keypart[j].fldnum > numflds))
+	    {
+	      fprintf(stderr, "Key %d refers to unknown field %d\n", i + 1, clk[i].keypart[j].fldnum);
+	      return -1;
+	    }
 
 	  /*
 	   * Collect subparts if this part of the key is
@@ -188,10 +278,20 @@ clarion_read_key_desc (ClarionHandle *cl)
 	  if (clk[i].keypart[j].fldtype == CL_FIELD_GROUP)
 	    {
 	      numparts = clfd[clk[i].keypart[j].fldnum - 1].length;
-	      clk[i].keypart[j].numparts = numparts;
 
-	      subpart = (ClarionKeyPart *) malloc(numparts * sizeof(ClarionKeyPart));
+	      if (clk[i].keypart[j].fldnum + numparts > numflds)
+		{
+		  fprintf(stderr, "Key %d refers to a group past the last field\n", i + 1);
+		  return -1;
+		}
+
+	      subpart = (ClarionKeyPart *) clarion_arena_alloc(&cl->arena, numparts * sizeof(ClarionKeyPart));
+
+	      if (subpart == NULL)
+		return -1;
+
 	      clk[i].keypart[j].subpart = subpart;
+	      clk[i].keypart[j].numparts = numparts;
 
 	      for (k = 0; k < numparts; k++)
 		{
@@ -203,19 +303,66 @@ clarion_read_key_desc (ClarionHandle *cl)
 		  subpart[k].subpart = NULL;
 		}
 	    }
-	  else
-	    {
-	      clk[i].keypart[j].numparts = 0;
-	      clk[i].keypart[j].subpart = NULL;
-	    }
 	}
+
+      cl->metapos += clk[i].numcomps * 6;
     }
 
-  cl->clm.clk = clk;
+  return 0;
 
-  free(keyfile);
+ truncated:
+  fprintf(stderr, "Key descriptors past the start of the records\n");
 
-  return 0;
+  return -1;
+}
+
+/*
+ * Reads the key type of every key from its key file, once; only the
+ * schema dumps need it.
+ */
+void
+clarion_probe_keys (ClarionHandle *cl)
+{
+  int i;
+  int l, r;
+  int numbkeys = cl->clm.clh->numbkeys;
+  int fd;
+  ClarionKeyDesc *clk = cl->clm.clk;
+  char *keyfile;
+  size_t len;
+
+  if (cl->keys_probed || (numbkeys == 0))
+    return;
+
+  cl->keys_probed = 1;
+
+  keyfile = strdup(cl->datfile);
+  len = strlen(keyfile);
+  keyfile[len - 3] = 'K';
+
+  for (i = 0; i < numbkeys; i++)
+    {
+      l = (i + 1) / 16;
+      r = (i + 1) % 16;
+      keyfile[len - 2] = (l > 9) ? 'a' + (l - 10) : '0' + l;
+      keyfile[len - 1] = (r > 9) ? 'a' + (r - 10) : '0' + r;
+
+      fd = open(keyfile, O_RDONLY);
+
+      if (fd >= 0)
+	{
+	  if (CL_PREAD(CL_PHASE_META, fd, &clk[i].keytype, 1, 29) != 1)
+	    clk[i].keytype = CL_KEYTYPE_ERROR;
+	  close(fd);
+	}
+      else
+	{
+	  clk[i].keytype = CL_KEYTYPE_ERROR;
+	  fprintf(stderr, "Couldn't open key file %s !\n", keyfile);
+	}
+    }
+
+  free(keyfile);
 }
 
 int
@@ -223,30 +370,84 @@ clarion_read_pic_desc (ClarionHandle *cl)
 {
   int i;
   int numpics = cl->clm.clh->numpics;
-  FILE *fp = cl->data;
   ClarionPicDesc *clp;
+  uint8_t *p;
 
   if (numpics == 0)
     return 0;
 
-  clp = (ClarionPicDesc *) malloc(numpics * sizeof(ClarionPicDesc));
+  clp = (ClarionPicDesc *) clarion_arena_calloc(&cl->arena, numpics, sizeof(ClarionPicDesc));
 
   if (clp == NULL)
     return -1;
 
+  cl->clm.clp = clp;
+
   for (i = 0; i < numpics; i++)
     {
-      fread(&clp[i].piclen, 2, 1, fp);
+      if (!cl_meta_avail(cl, 2))
+	goto truncated;
+
+      p = cl->meta + cl->metapos;
+      clp[i].piclen = cl_get16(p);
 
-      clp[i].picstr = (uint8_t *) malloc(clp[i].piclen + 1);
+      if (!cl_meta_avail(cl, 2 + clp[i].piclen))
+	goto truncated;
 
-      fread(clp[i].picstr, 1, clp[i].piclen, fp);
+      clp[i].picstr = (uint8_t *) clarion_arena_alloc(&cl->arena, clp[i].piclen + 1);
+
+      if (clp[i].picstr == NULL)
+	return -1;
+
+      memcpy(clp[i].picstr, p + 2, clp[i].piclen);
       clp[i].picstr[clp[i].piclen] = '\0';
-    }
 
-  cl->clm.clp = clp;
+      cl->metapos += 2 + clp[i].piclen;
+    }
 
   return 0;
+
+ truncated:
+  fprintf(stderr, "Picture descriptors past the start of the records\n");
+
+  return -1;
+}
+
+/*
+ * Counts the array descriptors of a field starting at pos; they end where
+ * numdim == totdim for the next one, or at the end of the region.
+ * Returns 0 if they don't fit in the region.
+ */
+static int
+clarion_count_arr_desc (ClarionHandle *cl, uint32_t pos)
+{
+  int count = 0;
+  uint8_t *p;
+
+  do
+    {
+      if (pos + 6 > cl->metalen)
+	return 0;
+
+      pos += 6 + cl_get16(cl->meta + pos + 2) * 4;
+
+      if (pos > cl->metalen)
+	return 0;
+
+      count++;
+
+      if (pos == cl->metalen)
+	break;
+
+      if (pos + 4 > cl->metalen)
+	return 0;
+
+      /* Peek at the next one */
+      p = cl->meta + pos;
+    }
+  while (cl_get16(p) != cl_get16(p + 2));
+
+  return count;
 }
 
 void
@@ -254,52 +455,56 @@ clarion_read_arr_desc (ClarionHandle *cl)
 {
   int i, j, k;
   int numflds = cl->clm.clh->numflds;
-  unsigned long offset = cl->clm.clh->offset;
-  FILE *fp = cl->data;
+  int count;
   ClarionFieldDesc *clfd = cl->clm.clfd;
-  uint16_t numdim, totdim;
+  ClarionArrDesc *arr;
+  uint8_t *p;
 
   for (i = 0; i < numflds; i++)
     {
-      if (clfd[i].arrnum != 0)
-	{
-	  j = 0;
-	  do
-	    {
-	      clfd[i].arr = (ClarionArrDesc *) realloc(clfd[i].arr, (j + 1) * sizeof(ClarionArrDesc));
-	      
-	      fread(&clfd[i].arr[j].numdim, 2, 1, fp);
-	      fread(&clfd[i].arr[j].totdim, 2, 1, fp);
-	      fread(&clfd[i].arr[j].elmsiz, 2, 1, fp);
+      if (clfd[i].arrnum == 0)
+	continue;
 
-	      clfd[i].arr[j].part = (ClarionArrPart *) malloc(clfd[i].arr[j].totdim * sizeof(ClarionArrPart));
+      /* Count them first so they're allocated in one go */
+      count = clarion_count_arr_desc(cl, cl->metapos);
 
-	      for (k = 0; k < clfd[i].arr[j].totdim; k++)
-		{
-		  fread(&clfd[i].arr[j].part[k].maxdim, 2, 1, fp);
-		  fread(&clfd[i].arr[j].part[k].lendim, 2, 1, fp);
-		}
+      if (count == 0)
+	{
+	  fprintf(stderr, "Array descriptors past the start of the records\n");
+	  return;
+	}
 
-	      if (ftell(fp) == offset)
-		{
-		  clfd[i].nbarrs = j + 1;
-		  return;
-		}
+      arr = (ClarionArrDesc *) clarion_arena_alloc(&cl->arena, count * sizeof(ClarionArrDesc));
+      if (arr == NULL)
+	return;
 
-	      fread(&numdim, 2, 1, fp);
-	      fread(&totdim, 2, 1, fp);
+      p = cl->meta + cl->metapos;
 
-	      fseek(fp, (ftell(fp) - 4), SEEK_SET);
+      for (j = 0; j < count; j++)
+	{
+	  arr[j].numdim = cl_get16(p);
+	  arr[j].totdim = cl_get16(p + 2);
+	  arr[j].elmsiz = cl_get16(p + 4);
 
-	      if (numdim != totdim)
-		j++;
-	      else
-		{
-		  clfd[i].nbarrs = j + 1;
-		  break;
-		}
+	  arr[j].part = (ClarionArrPart *) clarion_arena_alloc(&cl->arena, arr[j].totdim * sizeof(ClarionArrPart));
+	  if (arr[j].part == NULL)
+	    return;
+
+	  p += 6;
 
-	    } while (1);
+	  for (k = 0; k < arr[j].totdim; k++, p += 4)
+	    {
+	      arr[j].part[k].maxdim = cl_get16(p);
+	      arr[j].part[k].lendim = cl_get16(p + 2);
+	    }
 	}
+
+      clfd[i].arr = arr;
+      clfd[i].nbarrs = count;
+      cl->metapos = p - cl->meta;
+
+      /* Nothing left for the next fields */
+      if (cl->metapos == cl->metalen)
+	return;
     }
 }
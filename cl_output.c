@@ -0,0 +1,220 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <endian.h>
+#include <byteswap.h>
+#include <errno.h>
+
+#include "cldump.h"
+
+/*
+ * Output sink for the data dumpers
+ *
+ * Formatted data is appended to a large buffer that is handed over to
+ * the drain function when full: by default it is written to the file
+ * descriptor in one go, in pipeline mode the buffer goes to the writer
+ * thread and a recycled one takes its place.
+ */
+
+int
+clarion_write_all (int fd, const uint8_t *buf, size_t len)
+{
+  uint64_t t0 = CL_TRACE_BEGIN();
+  size_t total = len;
+  ssize_t ret;
+  int phase;
+
+  phase = CL_SET_PHASE(CL_PHASE_OUTPUT);
+
+  CL_PROBE1(output__flush, len);
+
+  while (len > 0)
+    {
+      ret = CL_WRITE(CL_PHASE_OUTPUT, fd, buf, len);
+
+      if (ret < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+
+	  CL_SET_PHASE(phase);
+	  CL_TRACE_END("write", "io", t0, "bytes", total - len);
+	  return -1;
+	}
+
+      CL_STAT(outbytes, ret);
+
+      buf += ret;
+      len -= ret;
+    }
+
+  CL_SET_PHASE(phase);
+  CL_TRACE_END("write", "io", t0, "bytes", total);
+
+  return 0;
+}
+
+static void
+clarion_out_drain_fd (ClarionOutput *out)
+{
+  if (clarion_write_all(out->fd, out->buf, out->len) < 0)
+    {
+      fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+      exit(1);
+    }
+
+  out->len = 0;
+}
+
+int
+clarion_out_init (ClarionOutput *out, int fd, size_t size)
+{
+  memset(out, 0, sizeof(ClarionOutput));
+
+  out->buf = (uint8_t *) CL_MALLOC(size);
+
+  if (out->buf == NULL)
+    return -1;
+
+  out->size = size;
+  out->fd = fd;
+  out->drain = clarion_out_drain_fd;
+
+  return 0;
+}
+
+void
+clarion_out_flush (ClarionOutput *out)
+{
+  if (out->len > 0)
+    out->drain(out);
+}
+
+void
+clarion_out_free (ClarionOutput *out)
+{
+  clarion_out_flush(out);
+
+  free(out->buf);
+  out->buf = NULL;
+}
+
+void
+clarion_out_write (ClarionOutput *out, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  size_t room;
+
+  while (len > 0)
+    {
+      room = out->size - out->len;
+
+      if (room == 0)
+	{
+	  out->drain(out);
+	  continue;
+	}
+
+      if (room > len)
+	room = len;
+
+      memcpy(out->buf + out->len, p, room);
+      out->len += room;
+
+      p += room;
+      len -= room;
+    }
+}
+
+void
+clarion_out_putc (ClarionOutput *out, int c)
+{
+  if (out->len == out->size)
+    out->drain(out);
+
+  out->buf[out->len++] = c;
+}
+
+void
+clarion_out_puts (ClarionOutput *out, const char *s)
+{
+  clarion_out_write(out, s, strlen(s));
+}
+
+void
+clarion_out_int (ClarionOutput *out, long long val)
+{
+  char buf[24];
+  char *p = buf + sizeof(buf);
+  unsigned long long v;
+
+  v = (val < 0) ? -(unsigned long long)val : (unsigned long long)val;
+
+  do {
+    *--p = '0' + (v % 10);
+    v /= 10;
+  } while (v != 0);
+
+  if (val < 0)
+    *--p = '-';
+
+  clarion_out_write(out, p, buf + sizeof(buf) - p);
+}
+
+void
+clarion_out_printf (ClarionOutput *out, const char *fmt, ...)
+{
+  va_list ap;
+  char *tmp;
+  int ret;
+
+  if (out->size - out->len < 64)
+    out->drain(out);
+
+  va_start(ap, fmt);
+  ret = vsnprintf((char *)out->buf + out->len, out->size - out->len, fmt, ap);
+  va_end(ap);
+
+  if (ret < 0)
+    return;
+
+  if ((size_t)ret < out->size - out->len)
+    {
+      out->len += ret;
+      return;
+    }
+
+  /* Didn't fit, format aside */
+  tmp = (char *) clarion_scratch_alloc(ret + 1);
+
+  if (tmp == NULL)
+    return;
+
+  va_start(ap, fmt);
+  vsnprintf(tmp, ret + 1, fmt, ap);
+  va_end(ap);
+
+  clarion_out_write(out, tmp, ret);
+}
@@ -0,0 +1,1018 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <endian.h>
+#include <byteswap.h>
+#include <errno.h>
+
+#include "cldump.h"
+
+/*
+ * Record driver
+ *
+ * Records are read by blocks of CL_BATCH_SIZE bytes, decoded one by one
+ * by the record function of the output format and written out through
+ * a ClarionOutput. In pipeline mode (--pipeline) the three stages run
+ * concurrently: a reader thread prefetches record blocks, the calling
+ * thread decodes and formats them and a writer thread drains the output
+ * buffers. The stages are connected by bounded single-producer/single-
+ * consumer rings, and the blocks and output buffers are recycled through
+ * a second ring going the other way, so the output order is unchanged.
+ *
+ * Only the records in [recfirst, recend) are read. Once --limit records
+ * were dumped the drivers stop, and in pipeline mode the reader is told
+ * to stop too while the blocks it already queued are dropped.
+ *
+ * Scans, record functions that output nothing like --aggregate, go
+ * through slices of the range in parallel instead, see
+ * clarion_scan_records(). With --sort-by, the records are dumped in the
+ * order of cl_sort.c. --check-keys looks at each record dumped on the
+ * way, see cl_check.c.
+ */
+
+#define CL_BATCH_SIZE            (256 * 1024)
+#define CL_OUTPUT_SIZE           (256 * 1024)
+
+typedef struct {
+  uint8_t *data;
+  uint32_t first; /* index of the first record in the batch */
+  uint32_t count; /* number of records, 0 at end of data */
+  uint32_t *recno; /* record indexes, NULL if they follow each other from first */
+} ClarionBatch;
+
+typedef struct {
+  uint8_t *buf;
+  size_t len; /* 0 at end of output */
+} ClarionChunk;
+
+typedef struct {
+  ClarionHandle *cl;
+  uint32_t perbatch;
+
+  ClarionRing free_in;
+  ClarionRing full_in;
+  ClarionRing full_out;
+  ClarionRing free_out;
+
+  ClarionBatch batch[CL_RING_SIZE];
+  ClarionChunk chunk[CL_RING_SIZE];
+
+  pthread_t reader;
+  pthread_t writer;
+
+  int stop; /* set once the limit is reached, read by the reader */
+} ClarionPipeline;
+
+typedef struct {
+  ClarionHandle *cl;
+  ClarionRecordFn fn;
+  uint32_t perbatch;
+  size_t slack;
+  uint64_t done; /* records read by all of the threads */
+} ClarionScan;
+
+typedef struct {
+  ClarionScan *scan;
+  void *ctx;
+  uint32_t first;
+  uint32_t end;
+  int main; /* gone through by the calling thread */
+  pthread_t thread;
+} ClarionScanJob;
+
+
+/* Spin for a bit, then yield, then back off with short sleeps */
+static void
+clarion_ring_wait (unsigned int *spins)
+{
+  struct timespec ts;
+
+  (*spins)++;
+
+  if (*spins < 64)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+  else if (*spins < 128)
+    sched_yield();
+  else
+    {
+      ts.tv_sec = 0;
+      ts.tv_nsec = (*spins < 256) ? 10000 : 200000;
+      nanosleep(&ts, NULL);
+    }
+}
+
+void
+clarion_ring_push (ClarionRing *r, void *p)
+{
+  unsigned int head = r->head;
+  unsigned int spins = 0;
+  uint64_t t0;
+
+  if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == CL_RING_SIZE)
+    {
+      t0 = CL_TRACE_BEGIN();
+
+      while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == CL_RING_SIZE)
+	clarion_ring_wait(&spins);
+
+      CL_TRACE_END("wait", "wait", t0, NULL, 0);
+    }
+
+  r->slot[head & (CL_RING_SIZE - 1)] = p;
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void *
+clarion_ring_pop (ClarionRing *r)
+{
+  unsigned int tail = r->tail;
+  unsigned int spins = 0;
+  uint64_t t0;
+  void *p;
+
+  if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+    {
+      t0 = CL_TRACE_BEGIN();
+
+      while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+	clarion_ring_wait(&spins);
+
+      CL_TRACE_END("wait", "wait", t0, NULL, 0);
+    }
+
+  p = r->slot[tail & (CL_RING_SIZE - 1)];
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+  return p;
+}
+
+
+/*
+ * Reads up to count records starting at record index first into buf,
+ * decrypting them when decrypting on the fly, or puts them together
+ * from the cache. Returns the number of complete records read.
+ */
+uint32_t
+clarion_read_batch (ClarionHandle *cl, uint8_t *buf, uint32_t first, uint32_t count)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  int fd = fileno(cl->data);
+  size_t want = (size_t)count * clh->reclen;
+  size_t got = 0;
+  uint64_t t0 = CL_TRACE_BEGIN();
+  off_t pos;
+  ssize_t ret;
+  uint32_t nrecs;
+  uint32_t i;
+
+  if (cl->cache != NULL)
+    return clarion_cache_read(cl, buf, first, count);
+
+  pos = (off_t)clh->offset + (off_t)first * clh->reclen;
+
+  while (got < want)
+    {
+      ret = CL_PREAD(CL_PHASE_DATA, fd, buf + got, want - got, pos + got);
+
+      if (ret < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+
+	  fprintf(stderr, "Error reading data file: %s\n", strerror(errno));
+	  break;
+	}
+
+      if (ret == 0)
+	break;
+
+      got += ret;
+    }
+
+  CL_STAT(datbytes, got);
+  CL_TRACE_END("read", "io", t0, "records", got / clh->reclen);
+
+  if (got < want)
+    fprintf(stderr, "EOF reached for DAT file\n");
+
+  nrecs = got / clh->reclen;
+
+  /* Record headers are stored in the clear */
+  if (cl->opts & CL_OPT_DECRYPT_READ)
+    {
+      for (i = 0; i < nrecs; i++)
+	clarion_xor(buf + (size_t)i * clh->reclen + 5, clh->reclen - 5, cl->key);
+    }
+
+  return nrecs;
+}
+
+static void
+clarion_pipeline_read_all (ClarionPipeline *pl)
+{
+  uint32_t end = pl->cl->recend;
+  ClarionBatch *b;
+  uint32_t next;
+  uint32_t n;
+
+  next = clarion_select_next(pl->cl, pl->cl->recfirst);
+
+  while ((next < end) && !__atomic_load_n(&pl->stop, __ATOMIC_RELAXED))
+    {
+      b = (ClarionBatch *)clarion_ring_pop(&pl->free_in);
+
+      n = end - next;
+      if (n > pl->perbatch)
+	n = pl->perbatch;
+
+      b->first = next;
+      b->count = clarion_read_batch(pl->cl, b->data, next, n);
+
+      clarion_ring_push(&pl->full_in, b);
+
+      /* Nothing left to read, that was the end of data marker */
+      if (b->count == 0)
+	return;
+
+      if (b->count < n)
+	break;
+
+      next = clarion_select_next(pl->cl, next + n);
+    }
+
+  /* End of data marker */
+  b = (ClarionBatch *)clarion_ring_pop(&pl->free_in);
+  b->count = 0;
+  clarion_ring_push(&pl->full_in, b);
+}
+
+static void *
+clarion_pipeline_reader (void *arg)
+{
+  CL_SET_PHASE(CL_PHASE_DATA);
+  clarion_trace_thread("reader");
+
+  clarion_pipeline_read_all((ClarionPipeline *)arg);
+
+  clarion_stats_merge();
+
+  return NULL;
+}
+
+static void *
+clarion_pipeline_writer (void *arg)
+{
+  ClarionPipeline *pl = (ClarionPipeline *)arg;
+  ClarionChunk *c;
+
+  CL_SET_PHASE(CL_PHASE_OUTPUT);
+  clarion_trace_thread("writer");
+
+  do {
+    c = (ClarionChunk *)clarion_ring_pop(&pl->full_out);
+
+    if (c->len == 0)
+      break;
+
+    if (clarion_write_all(STDOUT_FILENO, c->buf, c->len) < 0)
+      {
+	fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+	exit(1);
+      }
+
+    c->len = 0;
+    clarion_ring_push(&pl->free_out, c);
+  } while (1);
+
+  clarion_stats_merge();
+
+  return NULL;
+}
+
+/* Hands the full output buffer to the writer, continues in a free one */
+static void
+clarion_pipeline_drain (ClarionOutput *out)
+{
+  ClarionPipeline *pl = (ClarionPipeline *)out->priv;
+  ClarionChunk *c;
+  uint8_t *tmp;
+
+  c = (ClarionChunk *)clarion_ring_pop(&pl->free_out);
+
+  tmp = c->buf;
+  c->buf = out->buf;
+  c->len = out->len;
+
+  clarion_ring_push(&pl->full_out, c);
+
+  out->buf = tmp;
+  out->len = 0;
+}
+
+
+/* Dumps the selected records of a batch, returns 1 once the limit is reached */
+static int
+clarion_dump_batch (ClarionHandle *cl, ClarionBatch *b, ClarionOutput *out, ClarionRecordFn fn, void *ctx)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  ClarionRecordHeader clrh;
+  uint64_t t0 = CL_TRACE_BEGIN();
+  uint8_t *rec;
+  uint32_t i;
+  int done = 0;
+
+  /* Whatever the previous batch needed aside is done with */
+  clarion_scratch_reset();
+
+  CL_STAT(scanned, b->count);
+
+  for (i = 0; i < b->count; i++)
+    {
+      rec = b->data + (size_t)i * clh->reclen;
+
+      clrh.rhd = rec[0];
+      memcpy(&clrh.rptr, rec + 1, 4);
+      clrh.rptr = le32toh(clrh.rptr);
+      clrh.recno = (b->recno != NULL) ? b->recno[i] : b->first + i;
+
+      if (!cl->rhdsel[clrh.rhd])
+	{
+	  if (clrh.rhd & CL_RECORD_DELETED)
+	    CL_STAT(skipped, 1);
+	  continue;
+	}
+
+      if ((cl->where != NULL) && !clarion_where_match(cl->where, rec + 5))
+	continue;
+
+      if (cl->skip > 0)
+	{
+	  cl->skip--;
+	  continue;
+	}
+
+      if (cl->check != NULL)
+	clarion_check_record(cl, clrh.recno, rec + 5);
+
+      fn(cl, clrh.recno, &clrh, rec + 5, out, ctx);
+      CL_STAT(emitted, 1);
+
+      if ((cl->limit != 0) && (++cl->dumped == cl->limit))
+	{
+	  done = 1;
+	  break;
+	}
+    }
+
+  CL_TRACE_END("decode", "cpu", t0, "first", b->first);
+
+  /* Scans (no output) report their progress themselves */
+  if ((out != NULL) && (cl->progress > 0))
+    {
+      if (cl->sel != NULL)
+	clarion_stats_progress(cl_stats.emitted, cl->nsel, cl->progress);
+      else
+	clarion_stats_progress(cl_stats.scanned, cl->recend - cl->recfirst, cl->progress);
+    }
+
+  return done;
+}
+
+/*
+ * Fields are decoded one after the other from the start of the record;
+ * if the descriptors add up to more than the record length, leave some
+ * room after the last record of a batch so decoding stays in bounds.
+ */
+static size_t
+clarion_batch_slack (ClarionHandle *cl)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  size_t datalen = 5;
+  int i;
+
+  for (i = 0; i < cl->clm.clh->numflds; i++)
+    {
+      if (clfd[i].fldtype != CL_FIELD_GROUP)
+	datalen += clfd[i].length;
+    }
+
+  return (datalen > cl->clm.clh->reclen) ? datalen - cl->clm.clh->reclen + 1 : 1;
+}
+
+static void
+clarion_dump_records_serial (ClarionHandle *cl, uint32_t perbatch, size_t slack, ClarionRecordFn fn, void *ctx)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  ClarionOutput out;
+  ClarionBatch b;
+  uint32_t next;
+  uint32_t n;
+
+  b.data = (uint8_t *) CL_CALLOC(1, (size_t)perbatch * clh->reclen + slack);
+  b.recno = NULL;
+
+  if ((b.data == NULL) || (clarion_out_init(&out, STDOUT_FILENO, CL_OUTPUT_SIZE) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  next = clarion_select_next(cl, cl->recfirst);
+
+  while (next < cl->recend)
+    {
+      n = cl->recend - next;
+      if (n > perbatch)
+	n = perbatch;
+
+      b.first = next;
+      b.count = clarion_read_batch(cl, b.data, next, n);
+
+      if (clarion_dump_batch(cl, &b, &out, fn, ctx) || (b.count < n))
+	break;
+
+      next = clarion_select_next(cl, next + n);
+    }
+
+  clarion_out_free(&out);
+  free(b.data);
+}
+
+static int
+clarion_cmp_recno (const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * Deleted records are chained from clh->freerec through their rptr, by
+ * record number starting at 1, down to 0. Walks the chain reading the
+ * record headers only and returns the record indexes in file order, or
+ * NULL if the chain is out of range, goes through a live record or
+ * doesn't hold numdels records; a loop never reaches 0 and runs past
+ * numdels.
+ */
+static uint32_t *
+clarion_walk_deleted (ClarionHandle *cl)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  int fd = fileno(cl->data);
+  uint32_t *recs;
+  uint32_t n = 0;
+  uint32_t cur;
+  uint32_t rptr;
+  uint8_t rh[5];
+  const char *err = NULL;
+
+  recs = (uint32_t *) CL_MALLOC(((size_t)clh->numdels + 1) * sizeof(uint32_t));
+
+  if (recs == NULL)
+    return NULL;
+
+  for (cur = clh->freerec; cur != 0; cur = le32toh(rptr))
+    {
+      if (cur > clh->numrecs)
+	{
+	  err = "points past the last record";
+	  break;
+	}
+
+      if (n == clh->numdels)
+	{
+	  err = "loops or is longer than numdels";
+	  break;
+	}
+
+      if (CL_PREAD(CL_PHASE_DATA, fd, rh, 5, (off_t)clh->offset + (off_t)(cur - 1) * clh->reclen) != 5)
+	{
+	  err = "could not be read";
+	  break;
+	}
+
+      CL_STAT(datbytes, 5);
+
+      if (!(rh[0] & CL_RECORD_DELETED))
+	{
+	  err = "goes through a live record";
+	  break;
+	}
+
+      recs[n++] = cur - 1;
+      memcpy(&rptr, rh + 1, 4);
+    }
+
+  if ((err == NULL) && (n != clh->numdels))
+    err = "is shorter than numdels";
+
+  if (err != NULL)
+    {
+      fprintf(stderr, "Deleted record chain %s (%u of %u records), scanning all records\n",
+	      err, n, clh->numdels);
+      free(recs);
+      return NULL;
+    }
+
+  qsort(recs, n, sizeof(uint32_t), clarion_cmp_recno);
+
+  return recs;
+}
+
+/* Dumps the count records indexed by recs in file order, reading runs of adjacent ones at once */
+static void
+clarion_dump_record_list (ClarionHandle *cl, const uint32_t *recs, uint32_t count,
+			  uint32_t perbatch, size_t slack, ClarionRecordFn fn, void *ctx)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  ClarionOutput out;
+  ClarionBatch b;
+  uint32_t i;
+  uint32_t n;
+
+  b.data = (uint8_t *) CL_CALLOC(1, (size_t)perbatch * clh->reclen + slack);
+  b.recno = NULL;
+
+  if ((b.data == NULL) || (clarion_out_init(&out, STDOUT_FILENO, CL_OUTPUT_SIZE) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (i = 0; i < count; i += n)
+    {
+      for (n = 1; (i + n < count) && (n < perbatch); n++)
+	{
+	  if (recs[i + n] != recs[i] + n)
+	    break;
+	}
+
+      b.first = recs[i];
+      b.count = clarion_read_batch(cl, b.data, recs[i], n);
+
+      if (clarion_dump_batch(cl, &b, &out, fn, ctx))
+	break;
+    }
+
+  clarion_out_free(&out);
+  free(b.data);
+}
+
+/* Dumps the deleted records in range only, walking their chain */
+static int
+clarion_dump_records_deleted (ClarionHandle *cl, uint32_t perbatch, size_t slack, ClarionRecordFn fn, void *ctx)
+{
+  uint32_t *recs;
+  uint32_t i;
+  uint32_t n = 0;
+
+  recs = clarion_walk_deleted(cl);
+
+  if (recs == NULL)
+    return -1;
+
+  for (i = 0; i < cl->clm.clh->numdels; i++)
+    {
+      if ((recs[i] >= cl->recfirst) && (recs[i] < cl->recend))
+	recs[n++] = recs[i];
+    }
+
+  clarion_dump_record_list(cl, recs, n, perbatch, slack, fn, ctx);
+  free(recs);
+
+  return 0;
+}
+
+static void
+clarion_dump_records_pipeline (ClarionHandle *cl, uint32_t perbatch, size_t slack, ClarionRecordFn fn, void *ctx)
+{
+  ClarionPipeline pl;
+  ClarionOutput out;
+  ClarionBatch *b;
+  ClarionChunk *c;
+  int i;
+
+  memset(&pl, 0, sizeof(ClarionPipeline));
+  pl.cl = cl;
+  pl.perbatch = perbatch;
+
+  if (clarion_out_init(&out, STDOUT_FILENO, CL_OUTPUT_SIZE) < 0)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  out.drain = clarion_pipeline_drain;
+  out.priv = &pl;
+
+  for (i = 0; i < CL_RING_SIZE; i++)
+    {
+      pl.batch[i].data = (uint8_t *) CL_CALLOC(1, (size_t)perbatch * cl->clm.clh->reclen + slack);
+      pl.chunk[i].buf = (uint8_t *) CL_MALLOC(CL_OUTPUT_SIZE);
+
+      if ((pl.batch[i].data == NULL) || (pl.chunk[i].buf == NULL))
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+
+      clarion_ring_push(&pl.free_in, &pl.batch[i]);
+    }
+
+  /* One chunk is always held back for the end of output marker */
+  for (i = 0; i < CL_RING_SIZE - 1; i++)
+    clarion_ring_push(&pl.free_out, &pl.chunk[i]);
+
+  if ((pthread_create(&pl.reader, NULL, clarion_pipeline_reader, &pl) != 0)
+      || (pthread_create(&pl.writer, NULL, clarion_pipeline_writer, &pl) != 0))
+    {
+      fprintf(stderr, "Could not start pipeline threads\n");
+      exit(1);
+    }
+
+  do {
+    b = (ClarionBatch *)clarion_ring_pop(&pl.full_in);
+
+    if (b->count == 0)
+      break;
+
+    /* Past the limit, blocks still on their way are only handed back */
+    if (!pl.stop && clarion_dump_batch(cl, b, &out, fn, ctx))
+      __atomic_store_n(&pl.stop, 1, __ATOMIC_RELAXED);
+
+    clarion_ring_push(&pl.free_in, b);
+  } while (1);
+
+  clarion_out_flush(&out);
+
+  c = &pl.chunk[CL_RING_SIZE - 1];
+  c->len = 0;
+  clarion_ring_push(&pl.full_out, c);
+
+  pthread_join(pl.reader, NULL);
+  pthread_join(pl.writer, NULL);
+
+  /* Buffers were swapped around, but each one is still held exactly once */
+  for (i = 0; i < CL_RING_SIZE; i++)
+    {
+      free(pl.batch[i].data);
+      free(pl.chunk[i].buf);
+    }
+
+  free(out.buf);
+}
+
+/* Sets the range up, returns -1 if there are no records to go through */
+static int
+clarion_records_setup (ClarionHandle *cl, uint32_t *perbatch, size_t *slack)
+{
+  ClarionHeader *clh = cl->clm.clh;
+
+  /* Whatever went through stdio so far comes first */
+  fflush(stdout);
+
+  CL_SET_PHASE(CL_PHASE_DATA);
+
+  if ((clh->numrecs == 0) || (clh->reclen == 0))
+    return -1;
+
+  if ((cl->recend == 0) || (cl->recend > clh->numrecs))
+    cl->recend = clh->numrecs;
+
+  if (cl->recfirst >= cl->recend)
+    return -1;
+
+  clarion_select_init(cl);
+
+  *perbatch = CL_BATCH_SIZE / clh->reclen;
+  if (*perbatch == 0)
+    *perbatch = 1;
+
+  *slack = clarion_batch_slack(cl);
+
+  return 0;
+}
+
+static void
+clarion_records_prescan (ClarionHandle *cl)
+{
+  uint64_t tp;
+
+  if (!(cl->opts & CL_OPT_PRESCAN))
+    return;
+
+  tp = CL_TRACE_BEGIN();
+
+  if (clarion_prescan(cl) < 0)
+    fprintf(stderr, "Could not map the data file for the prescan, reading all records\n");
+
+  CL_TRACE_END("prescan", "cpu", tp, "selected", cl->nsel);
+}
+
+/* Dumps the selected records with the driver that fits the options */
+static void
+clarion_dump_records_select (ClarionHandle *cl, uint32_t perbatch, size_t slack, ClarionRecordFn fn, void *ctx)
+{
+  uint32_t *recs;
+  uint32_t count;
+
+  /* Scan all of the records if the deleted record chain doesn't add up */
+  if ((cl->opts & CL_OPT_DELETED_ONLY) && (cl->sample == 0)
+      && (clarion_dump_records_deleted(cl, perbatch, slack, fn, ctx) == 0))
+    return;
+
+  clarion_records_prescan(cl);
+
+  recs = NULL;
+  if (cl->index != NULL)
+    recs = clarion_index_records(cl, &count);
+  else if (cl->sample != 0)
+    recs = clarion_sample(cl, &count);
+
+  if (recs != NULL)
+    {
+      clarion_dump_record_list(cl, recs, count, perbatch, slack, fn, ctx);
+      free(recs);
+    }
+  else if (cl->opts & CL_OPT_PIPELINE)
+    clarion_dump_records_pipeline(cl, perbatch, slack, fn, ctx);
+  else
+    clarion_dump_records_serial(cl, perbatch, slack, fn, ctx);
+}
+
+/*
+ * --sort-by: the sort keys of the selected records are collected first,
+ * then the records are read again in sort order, runs of adjacent ones
+ * at once. --offset and --limit apply to the sorted records.
+ */
+static void
+clarion_dump_records_sorted (ClarionHandle *cl, uint32_t perbatch, size_t slack, ClarionRecordFn fn, void *ctx)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  ClarionOutput out;
+  ClarionBatch b;
+  uint64_t skip = cl->skip;
+  uint64_t limit = cl->limit;
+  ClarionStats saved[2];
+  ClarionCheck *check = cl->check;
+  uint32_t got;
+  uint32_t n;
+  uint32_t i;
+  uint32_t m;
+
+  cl->skip = 0;
+  cl->limit = 0;
+  cl->check = NULL;
+
+  clarion_stats_save(saved);
+
+  clarion_dump_records_select(cl, perbatch, slack, clarion_sort_key, NULL);
+
+  /* Collecting the keys didn't dump anything, the records are counted once read in order */
+  clarion_stats_restore(saved);
+  cl->skip = skip;
+  cl->limit = limit;
+  cl->check = check;
+
+  if (clarion_sort_finish(cl) < 0)
+    {
+      fprintf(stderr, "Could not sort the records\n");
+      exit(1);
+    }
+
+  b.data = (uint8_t *) CL_CALLOC(1, (size_t)perbatch * clh->reclen + slack);
+  b.recno = (uint32_t *) CL_MALLOC(perbatch * sizeof(uint32_t));
+
+  if ((b.data == NULL) || (b.recno == NULL) || (clarion_out_init(&out, STDOUT_FILENO, CL_OUTPUT_SIZE) < 0))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  do {
+    for (n = 0; (n < perbatch) && clarion_sort_next(cl, &b.recno[n]); n++)
+      ;
+
+    for (i = 0; i < n; i += m)
+      {
+	for (m = 1; (i + m < n) && (b.recno[i + m] == b.recno[i] + m); m++)
+	  ;
+
+	got = clarion_read_batch(cl, b.data + (size_t)i * clh->reclen, b.recno[i], m);
+
+	if (got < m)
+	  {
+	    n = i + got;
+	    break;
+	  }
+      }
+
+    b.first = b.recno[0];
+    b.count = n;
+  } while ((n > 0) && !clarion_dump_batch(cl, &b, &out, fn, ctx) && (n == perbatch));
+
+  clarion_out_free(&out);
+  free(b.data);
+  free(b.recno);
+
+  clarion_sort_free(cl);
+}
+
+void
+clarion_dump_records (ClarionHandle *cl, ClarionRecordFn fn, void *ctx)
+{
+  uint64_t t0;
+  uint32_t perbatch;
+  size_t slack;
+
+  if (clarion_records_setup(cl, &perbatch, &slack) < 0)
+    return;
+
+  t0 = CL_TRACE_BEGIN();
+
+  if (cl->sort != NULL)
+    clarion_dump_records_sorted(cl, perbatch, slack, fn, ctx);
+  else
+    clarion_dump_records_select(cl, perbatch, slack, fn, ctx);
+
+  CL_TRACE_END("records", "phase", t0, "numrecs", cl->clm.clh->numrecs);
+}
+
+/* Goes through the selected records of [first, end) */
+static void
+clarion_scan_slice (ClarionScanJob *job)
+{
+  ClarionScan *sc = job->scan;
+  ClarionHandle *cl = sc->cl;
+  ClarionBatch b;
+  uint64_t done;
+  uint32_t next;
+  uint32_t n;
+
+  b.data = (uint8_t *) CL_CALLOC(1, (size_t)sc->perbatch * cl->clm.clh->reclen + sc->slack);
+  b.recno = NULL;
+
+  if (b.data == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  next = clarion_select_next(cl, job->first);
+
+  while (next < job->end)
+    {
+      n = job->end - next;
+      if (n > sc->perbatch)
+	n = sc->perbatch;
+
+      b.first = next;
+      b.count = clarion_read_batch(cl, b.data, next, n);
+
+      clarion_dump_batch(cl, &b, NULL, sc->fn, job->ctx);
+
+      done = __atomic_add_fetch(&sc->done, b.count, __ATOMIC_RELAXED);
+
+      /* Only the calling thread reports progress */
+      if (job->main && (cl->progress > 0))
+	clarion_stats_progress(done, cl->recend - cl->recfirst, cl->progress);
+
+      if (b.count < n)
+	break;
+
+      next = clarion_select_next(cl, next + n);
+    }
+
+  free(b.data);
+}
+
+static void *
+clarion_scan_worker (void *arg)
+{
+  CL_SET_PHASE(CL_PHASE_DATA);
+  clarion_trace_thread("scan");
+
+  clarion_scan_slice((ClarionScanJob *)arg);
+
+  clarion_stats_merge();
+
+  return NULL;
+}
+
+/*
+ * Hands the selected records to fn, which outputs nothing, splitting the
+ * range in up to nctx slices gone through by as many threads, each one
+ * with its own ctx[i]. Where the order of the records matters (--offset,
+ * --limit, --sample), for --deleted-only, while checking keys or for an
+ * index lookup, they all go to ctx[0] through clarion_dump_records().
+ * Returns the number of contexts that were used.
+ */
+int
+clarion_scan_records (ClarionHandle *cl, ClarionRecordFn fn, void **ctx, int nctx)
+{
+  ClarionScan sc;
+  ClarionScanJob *jobs;
+  uint32_t *bounds;
+  uint64_t t0;
+  uint64_t range;
+  int n;
+  int i;
+
+  if ((nctx <= 1) || (cl->skip != 0) || (cl->limit != 0) || (cl->sample != 0)
+      || (cl->opts & CL_OPT_DELETED_ONLY) || (cl->check != NULL) || (cl->index != NULL))
+    {
+      clarion_dump_records(cl, fn, ctx[0]);
+      return 1;
+    }
+
+  memset(&sc, 0, sizeof(ClarionScan));
+  sc.cl = cl;
+  sc.fn = fn;
+
+  if (clarion_records_setup(cl, &sc.perbatch, &sc.slack) < 0)
+    return 1;
+
+  t0 = CL_TRACE_BEGIN();
+
+  clarion_records_prescan(cl);
+
+  /* At least a batch of records to dump per thread */
+  range = (cl->sel != NULL) ? cl->nsel : cl->recend - cl->recfirst;
+  n = (range + sc.perbatch - 1) / sc.perbatch;
+  if (n > nctx)
+    n = nctx;
+  if (n < 1)
+    n = 1;
+
+  jobs = (ClarionScanJob *) CL_CALLOC(n, sizeof(ClarionScanJob));
+  bounds = (uint32_t *) CL_MALLOC((n + 1) * sizeof(uint32_t));
+
+  if ((jobs == NULL) || (bounds == NULL))
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  clarion_select_split(cl, n, bounds);
+
+  for (i = 0; i < n; i++)
+    {
+      jobs[i].scan = &sc;
+      jobs[i].ctx = ctx[i];
+      jobs[i].first = bounds[i];
+      jobs[i].end = bounds[i + 1];
+    }
+
+  free(bounds);
+
+  /* The first slice is gone through by the calling thread */
+  for (i = 1; i < n; i++)
+    {
+      if (pthread_create(&jobs[i].thread, NULL, clarion_scan_worker, &jobs[i]) != 0)
+	{
+	  fprintf(stderr, "Could not start scan threads\n");
+	  exit(1);
+	}
+    }
+
+  jobs[0].main = 1;
+  clarion_scan_slice(&jobs[0]);
+
+  for (i = 1; i < n; i++)
+    pthread_join(jobs[i].thread, NULL);
+
+  free(jobs);
+
+  CL_TRACE_END("records", "phase", t0, "numrecs", cl->clm.clh->numrecs);
+
+  return n;
+}
@@ -0,0 +1,431 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <endian.h>
+#include <byteswap.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define CL_SCAN_X86 1
+#endif
+
+#include "cldump.h"
+
+/*
+ * String scanning kernels
+ *
+ * One pass over a fixed-length Clarion STRING returns the length once
+ * the trailing space padding is dropped, along with a set of CL_SCAN_*
+ * flags telling the output code whether it has anything to escape,
+ * quote or transcode. Padding is made of spaces only, so scanning it
+ * never sets a flag and the whole field can be processed in one go.
+ */
+
+typedef int (*clarion_scan_fn) (const uint8_t *data, int length, uint8_t sep, unsigned int *flags);
+typedef int (*clarion_find_fn) (const uint8_t *data, int length, uint8_t a, uint8_t b);
+
+static int
+clarion_scan_select (const uint8_t *data, int length, uint8_t sep, unsigned int *flags);
+
+static int
+clarion_find_select (const uint8_t *data, int length, uint8_t a, uint8_t b);
+
+/* Set once, by the first caller, and read by all threads: see clarion_scan_setup() */
+static clarion_scan_fn clarion_scan_impl = clarion_scan_select;
+static clarion_find_fn clarion_find_impl = clarion_find_select;
+static pthread_once_t clarion_scan_once = PTHREAD_ONCE_INIT;
+
+
+static int
+clarion_scan_scalar (const uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  int i;
+  int last = -1;
+  unsigned int f = 0;
+
+  for (i = 0; i < length; i++)
+    {
+      switch (data[i])
+	{
+	  case 0x20:
+	    continue;
+	  case '\'':
+	    f |= CL_SCAN_SQUOTE;
+	    break;
+	  case '"':
+	    f |= CL_SCAN_DQUOTE;
+	    break;
+	  case '\\':
+	    f |= CL_SCAN_BACKSLASH;
+	    break;
+	  case '\r':
+	  case '\n':
+	    f |= CL_SCAN_NEWLINE;
+	    break;
+	  case '\0':
+	    f |= CL_SCAN_NUL;
+	    break;
+	  default:
+	    if (data[i] & 0x80)
+	      f |= CL_SCAN_NONASCII;
+	    break;
+	}
+
+      if ((sep != '\0') && (data[i] == sep))
+	f |= CL_SCAN_SEPARATOR;
+
+      last = i;
+    }
+
+  *flags = f;
+
+  return last + 1;
+}
+
+static int
+clarion_find_scalar (const uint8_t *data, int length, uint8_t a, uint8_t b)
+{
+  int i;
+
+  for (i = 0; i < length; i++)
+    {
+      if ((data[i] == a) || (data[i] == b))
+	break;
+    }
+
+  return i;
+}
+
+#ifdef CL_SCAN_X86
+/*
+ * Fold the per-class accumulators into CL_SCAN_* flags. Each accumulator
+ * is the OR of the byte-wise compare results for its class.
+ */
+__attribute__((target("sse2")))
+static unsigned int
+clarion_scan_flags_sse2 (__m128i sq, __m128i dq, __m128i bs, __m128i sp, __m128i nl, __m128i nul, __m128i hi)
+{
+  unsigned int f = 0;
+
+  if (_mm_movemask_epi8(sq))
+    f |= CL_SCAN_SQUOTE;
+  if (_mm_movemask_epi8(dq))
+    f |= CL_SCAN_DQUOTE;
+  if (_mm_movemask_epi8(bs))
+    f |= CL_SCAN_BACKSLASH;
+  if (_mm_movemask_epi8(sp))
+    f |= CL_SCAN_SEPARATOR;
+  if (_mm_movemask_epi8(nl))
+    f |= CL_SCAN_NEWLINE;
+  if (_mm_movemask_epi8(nul))
+    f |= CL_SCAN_NUL;
+  if (_mm_movemask_epi8(hi))
+    f |= CL_SCAN_NONASCII;
+
+  return f;
+}
+
+__attribute__((target("sse2")))
+static int
+clarion_scan_sse2 (const uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  const __m128i vspace = _mm_set1_epi8(0x20);
+  const __m128i vsq = _mm_set1_epi8('\'');
+  const __m128i vdq = _mm_set1_epi8('"');
+  const __m128i vbs = _mm_set1_epi8('\\');
+  const __m128i vcr = _mm_set1_epi8('\r');
+  const __m128i vlf = _mm_set1_epi8('\n');
+  const __m128i vzero = _mm_setzero_si128();
+  __m128i vsep;
+  __m128i sq, dq, bs, sp, nl, nul, hi;
+  __m128i v;
+  uint8_t tail[16];
+  unsigned int mask;
+  int last = -1;
+  int i;
+
+  /* No separator: compare against a space and drop the flag at the end */
+  vsep = _mm_set1_epi8((sep != '\0') ? (char)sep : 0x20);
+
+  sq = dq = bs = sp = nl = nul = hi = vzero;
+
+  for (i = 0; i < length; i += 16)
+    {
+      if (length - i >= 16)
+	v = _mm_loadu_si128((const __m128i *)(data + i));
+      else
+	{
+	  /* Pad the tail with spaces so it doesn't count */
+	  memset(tail, 0x20, 16);
+	  memcpy(tail, data + i, length - i);
+	  v = _mm_loadu_si128((const __m128i *)tail);
+	}
+
+      mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, vspace)) & 0xffff;
+      if (mask)
+	last = i + 31 - __builtin_clz(mask);
+
+      sq = _mm_or_si128(sq, _mm_cmpeq_epi8(v, vsq));
+      dq = _mm_or_si128(dq, _mm_cmpeq_epi8(v, vdq));
+      bs = _mm_or_si128(bs, _mm_cmpeq_epi8(v, vbs));
+      sp = _mm_or_si128(sp, _mm_cmpeq_epi8(v, vsep));
+      nl = _mm_or_si128(nl, _mm_or_si128(_mm_cmpeq_epi8(v, vcr), _mm_cmpeq_epi8(v, vlf)));
+      nul = _mm_or_si128(nul, _mm_cmpeq_epi8(v, vzero));
+      hi = _mm_or_si128(hi, v);
+    }
+
+  *flags = clarion_scan_flags_sse2(sq, dq, bs, sp, nl, nul, hi);
+
+  if (sep == '\0')
+    *flags &= ~CL_SCAN_SEPARATOR;
+
+  return last + 1;
+}
+
+__attribute__((target("sse2")))
+static int
+clarion_find_sse2 (const uint8_t *data, int length, uint8_t a, uint8_t b)
+{
+  const __m128i va = _mm_set1_epi8((char)a);
+  const __m128i vb = _mm_set1_epi8((char)b);
+  __m128i v;
+  unsigned int mask;
+  int i;
+
+  for (i = 0; i + 16 <= length; i += 16)
+    {
+      v = _mm_loadu_si128((const __m128i *)(data + i));
+      mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+
+      if (mask)
+	return i + __builtin_ctz(mask);
+    }
+
+  return i + clarion_find_scalar(data + i, length - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static int
+clarion_scan_avx2 (const uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  const __m256i vspace = _mm256_set1_epi8(0x20);
+  const __m256i vsq = _mm256_set1_epi8('\'');
+  const __m256i vdq = _mm256_set1_epi8('"');
+  const __m256i vbs = _mm256_set1_epi8('\\');
+  const __m256i vcr = _mm256_set1_epi8('\r');
+  const __m256i vlf = _mm256_set1_epi8('\n');
+  const __m256i vzero = _mm256_setzero_si256();
+  __m256i vsep;
+  __m256i sq, dq, bs, sp, nl, nul, hi;
+  __m256i v;
+  uint8_t tail[32];
+  unsigned int mask;
+  unsigned int f = 0;
+  int last = -1;
+  int i;
+
+  vsep = _mm256_set1_epi8((sep != '\0') ? (char)sep : 0x20);
+
+  sq = dq = bs = sp = nl = nul = hi = vzero;
+
+  for (i = 0; i < length; i += 32)
+    {
+      if (length - i >= 32)
+	v = _mm256_loadu_si256((const __m256i *)(data + i));
+      else
+	{
+	  memset(tail, 0x20, 32);
+	  memcpy(tail, data + i, length - i);
+	  v = _mm256_loadu_si256((const __m256i *)tail);
+	}
+
+      mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vspace));
+      if (mask)
+	last = i + 31 - __builtin_clz(mask);
+
+      sq = _mm256_or_si256(sq, _mm256_cmpeq_epi8(v, vsq));
+      dq = _mm256_or_si256(dq, _mm256_cmpeq_epi8(v, vdq));
+      bs = _mm256_or_si256(bs, _mm256_cmpeq_epi8(v, vbs));
+      sp = _mm256_or_si256(sp, _mm256_cmpeq_epi8(v, vsep));
+      nl = _mm256_or_si256(nl, _mm256_or_si256(_mm256_cmpeq_epi8(v, vcr), _mm256_cmpeq_epi8(v, vlf)));
+      nul = _mm256_or_si256(nul, _mm256_cmpeq_epi8(v, vzero));
+      hi = _mm256_or_si256(hi, v);
+    }
+
+  if (_mm256_movemask_epi8(sq))
+    f |= CL_SCAN_SQUOTE;
+  if (_mm256_movemask_epi8(dq))
+    f |= CL_SCAN_DQUOTE;
+  if (_mm256_movemask_epi8(bs))
+    f |= CL_SCAN_BACKSLASH;
+  if (_mm256_movemask_epi8(sp) && (sep != '\0'))
+    f |= CL_SCAN_SEPARATOR;
+  if (_mm256_movemask_epi8(nl))
+    f |= CL_SCAN_NEWLINE;
+  if (_mm256_movemask_epi8(nul))
+    f |= CL_SCAN_NUL;
+  if (_mm256_movemask_epi8(hi))
+    f |= CL_SCAN_NONASCII;
+
+  *flags = f;
+
+  return last + 1;
+}
+
+__attribute__((target("avx2")))
+static int
+clarion_find_avx2 (const uint8_t *data, int length, uint8_t a, uint8_t b)
+{
+  const __m256i va = _mm256_set1_epi8((char)a);
+  const __m256i vb = _mm256_set1_epi8((char)b);
+  __m256i v;
+  unsigned int mask;
+  int i;
+
+  for (i = 0; i + 32 <= length; i += 32)
+    {
+      v = _mm256_loadu_si256((const __m256i *)(data + i));
+      mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+
+      if (mask)
+	return i + __builtin_ctz(mask);
+    }
+
+  return i + clarion_find_sse2(data + i, length - i, a, b);
+}
+#endif /* CL_SCAN_X86 */
+
+/*
+ * Pick the best kernels for this CPU on first use; CL_SCAN_KERNEL
+ * (scalar, sse2, avx2) in the environment overrides the choice. Run
+ * once through pthread_once(), since the decoding threads may all get
+ * there first; the pointers are only stored when the choice is made.
+ */
+static void
+clarion_scan_setup (void)
+{
+  clarion_scan_fn scan = clarion_scan_scalar;
+  clarion_find_fn find = clarion_find_scalar;
+
+#ifdef CL_SCAN_X86
+  {
+    char *force = getenv("CL_SCAN_KERNEL");
+
+    __builtin_cpu_init();
+
+    if ((force != NULL) && (strcmp(force, "scalar") == 0))
+      ;
+    else if ((force != NULL) && (strcmp(force, "sse2") == 0))
+      {
+	scan = clarion_scan_sse2;
+	find = clarion_find_sse2;
+      }
+    else if (__builtin_cpu_supports("avx2"))
+      {
+	scan = clarion_scan_avx2;
+	find = clarion_find_avx2;
+      }
+    else if (__builtin_cpu_supports("sse2"))
+      {
+	scan = clarion_scan_sse2;
+	find = clarion_find_sse2;
+      }
+  }
+#endif
+
+  __atomic_store_n(&clarion_scan_impl, scan, __ATOMIC_RELEASE);
+  __atomic_store_n(&clarion_find_impl, find, __ATOMIC_RELEASE);
+}
+
+static int
+clarion_scan_select (const uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  pthread_once(&clarion_scan_once, clarion_scan_setup);
+
+  return __atomic_load_n(&clarion_scan_impl, __ATOMIC_ACQUIRE)(data, length, sep, flags);
+}
+
+static int
+clarion_find_select (const uint8_t *data, int length, uint8_t a, uint8_t b)
+{
+  pthread_once(&clarion_scan_once, clarion_scan_setup);
+
+  return __atomic_load_n(&clarion_find_impl, __ATOMIC_ACQUIRE)(data, length, a, b);
+}
+
+int
+clarion_scan (const uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  if (length <= 0)
+    {
+      *flags = 0;
+      return 0;
+    }
+
+  return __atomic_load_n(&clarion_scan_impl, __ATOMIC_ACQUIRE)(data, length, sep, flags);
+}
+
+/*
+ * Returns the index of the first a or b in data, or length if there is none
+ */
+int
+clarion_scan_find (const uint8_t *data, int length, uint8_t a, uint8_t b)
+{
+  if (length <= 0)
+    return 0;
+
+  return __atomic_load_n(&clarion_find_impl, __ATOMIC_ACQUIRE)(data, length, a, b);
+}
+
+int
+clarion_trim_scan (uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  int len;
+
+  len = clarion_scan(data, length, sep, flags);
+  data[len] = '\0';
+
+  /* Embedded NULs end the string for everything downstream */
+  if (*flags & CL_SCAN_NUL)
+    len = strlen((char *)data);
+
+  return len;
+}
+
+/*
+ * Same as clarion_trim_scan() for a field still sitting in its record:
+ * the data is left untouched, the length stops at the first NUL if any.
+ */
+int
+clarion_scan_string (const uint8_t *data, int length, uint8_t sep, unsigned int *flags)
+{
+  int len;
+
+  len = clarion_scan(data, length, sep, flags);
+
+  if (*flags & CL_SCAN_NUL)
+    len = strnlen((const char *)data, len);
+
+  return len;
+}
@@ -0,0 +1,362 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cldump.h"
+
+/*
+ * Record selection
+ *
+ * Whether a record gets dumped only depends on its rhd byte: -d drops
+ * deleted records, --deleted-only keeps only them and --status keeps
+ * records with any of the given flags. The rules are folded into a
+ * 256-entry table looked up for each record. With --prescan, the rhd
+ * bytes of all records are first read from the mapped data file into
+ * a bitmap of the records to dump, so the record driver can skip over
+ * blocks without any and the totals are known upfront.
+ *
+ * --records limits all of this to a range of records, and --sample to
+ * an evenly spread subset of it.
+ */
+
+void
+clarion_select_init (ClarionHandle *cl)
+{
+  uint8_t reject = (cl->opts & CL_OPT_DUMP_ACTIVE) ? CL_RECORD_DELETED : 0;
+  uint8_t require = (cl->opts & CL_OPT_DELETED_ONLY) ? CL_RECORD_DELETED : 0;
+  uint8_t any = cl->status;
+  int i;
+
+  for (i = 0; i < 256; i++)
+    {
+      cl->rhdsel[i] = ((i & reject) == 0)
+	&& ((i & require) == require)
+	&& ((any == 0) || ((i & any) != 0));
+    }
+}
+
+/*
+ * Sets bit i of bits for each record i in [first, end), the records
+ * starting at rec, that rhdsel selects, bits being zeroed already, and
+ * returns the number of bits set. Records are usually wider than a cache
+ * line, so this is bound by the memory traffic rather than the lookups.
+ */
+static uint32_t
+clarion_prescan_records (const uint8_t *rec, size_t reclen, uint32_t first, uint32_t end,
+			 const uint8_t *rhdsel, uint64_t *bits)
+{
+  uint32_t nsel = 0;
+  uint32_t i;
+  uint64_t bit;
+
+  for (i = first; i < end; i++)
+    {
+      bit = rhdsel[rec[(size_t)i * reclen]];
+
+      bits[i >> 6] |= bit << (i & 63);
+      nsel += bit;
+    }
+
+  return nsel;
+}
+
+/*
+ * Builds cl->sel from the mapped data file. Records past the end of a
+ * truncated file are left out. Returns -1 if the file can't be mapped,
+ * the dump then goes through all of the records.
+ */
+int
+clarion_prescan (ClarionHandle *cl)
+{
+  ClarionHeader *clh = cl->clm.clh;
+  int fd = fileno(cl->data);
+  struct stat st;
+  uint8_t *map;
+  size_t maplen;
+  uint64_t avail;
+  uint32_t count;
+
+  if ((clh->numrecs == 0) || (clh->reclen == 0) || (fstat(fd, &st) < 0))
+    return -1;
+
+  if ((uint64_t)st.st_size <= clh->offset)
+    return -1;
+
+  avail = ((uint64_t)st.st_size - clh->offset) / clh->reclen;
+  count = (avail < clh->numrecs) ? avail : clh->numrecs;
+
+  if (count > cl->recend)
+    count = cl->recend;
+
+  cl->sel = (uint64_t *) CL_CALLOC(((size_t)clh->numrecs + 63) / 64, sizeof(uint64_t));
+
+  if (cl->sel == NULL)
+    return -1;
+
+  maplen = clh->offset + (size_t)count * clh->reclen;
+  map = (uint8_t *) mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (map == MAP_FAILED)
+    {
+      free(cl->sel);
+      cl->sel = NULL;
+      return -1;
+    }
+
+  madvise(map, maplen, MADV_SEQUENTIAL);
+
+  if (cl->recfirst < count)
+    cl->nsel = clarion_prescan_records(map + clh->offset, clh->reclen, cl->recfirst, count,
+				       cl->rhdsel, cl->sel);
+
+  munmap(map, maplen);
+
+  return 0;
+}
+
+/* Returns the index of the first record to dump from index from on, numrecs if none */
+uint32_t
+clarion_select_next (ClarionHandle *cl, uint32_t from)
+{
+  uint32_t numrecs = cl->clm.clh->numrecs;
+  uint32_t nwords = ((uint64_t)numrecs + 63) / 64;
+  uint32_t w;
+  uint64_t bits;
+
+  if ((cl->sel == NULL) || (from >= numrecs))
+    return from;
+
+  w = from >> 6;
+  bits = cl->sel[w] & (~0ULL << (from & 63));
+
+  while (bits == 0)
+    {
+      if (++w >= nwords)
+	return numrecs;
+
+      bits = cl->sel[w];
+    }
+
+  return (w << 6) + __builtin_ctzll(bits);
+}
+
+/*
+ * Cuts the records in range into n slices [bounds[i], bounds[i + 1]) for
+ * the threads of clarion_scan_records(). With --prescan the bounds sit at
+ * equal ranks of the selected records, walking the word popcounts as
+ * clarion_sample() does, so clustered records don't leave threads idle.
+ */
+void
+clarion_select_split (ClarionHandle *cl, int n, uint32_t *bounds)
+{
+  uint64_t rank = 0; /* selected records before word w */
+  uint64_t r;
+  uint64_t bits;
+  uint32_t w = 0;
+  int i;
+
+  bounds[0] = cl->recfirst;
+  bounds[n] = cl->recend;
+
+  for (i = 1; i < n; i++)
+    {
+      if ((cl->sel == NULL) || (cl->nsel == 0))
+	{
+	  bounds[i] = cl->recfirst + (uint64_t)(cl->recend - cl->recfirst) * i / n;
+	  continue;
+	}
+
+      r = (uint64_t)cl->nsel * i / n;
+
+      while (rank + __builtin_popcountll(cl->sel[w]) <= r)
+	rank += __builtin_popcountll(cl->sel[w++]);
+
+      for (bits = cl->sel[w], r -= rank; r > 0; r--)
+	bits &= bits - 1;
+
+      bounds[i] = (w << 6) + __builtin_ctzll(bits);
+    }
+}
+
+/*
+ * --sample picks one record at random in each of sample equal strata of
+ * the records in range, or of those selected by --prescan, so the sample
+ * is spread over the whole file and comes out in file order. The seed is
+ * fixed so runs are repeatable. Returns the indexes of the sampled
+ * records, or NULL to dump all of them if the sample isn't smaller.
+ */
+uint32_t *
+clarion_sample (ClarionHandle *cl, uint32_t *count)
+{
+  uint64_t pop = (cl->sel != NULL) ? cl->nsel : cl->recend - cl->recfirst;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  uint64_t rank = 0; /* selected records before word w */
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t r;
+  uint64_t bits;
+  uint32_t *recs;
+  uint32_t w = 0;
+  uint32_t k;
+
+  if (cl->sample >= pop)
+    return NULL;
+
+  recs = (uint32_t *) CL_MALLOC((size_t)cl->sample * sizeof(uint32_t));
+
+  if (recs == NULL)
+    return NULL;
+
+  for (k = 0; k < cl->sample; k++)
+    {
+      lo = pop * k / cl->sample;
+      hi = pop * (k + 1) / cl->sample;
+
+      /* xorshift64* */
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      r = lo + (state * 0x2545f4914f6cdd1dULL) % (hi - lo);
+
+      if (cl->sel == NULL)
+	{
+	  recs[k] = cl->recfirst + r;
+	  continue;
+	}
+
+      /* The r-th selected record, ranks only go up */
+      while (rank + __builtin_popcountll(cl->sel[w]) <= r)
+	rank += __builtin_popcountll(cl->sel[w++]);
+
+      for (bits = cl->sel[w], r -= rank; r > 0; r--)
+	bits &= bits - 1;
+
+      recs[k] = (w << 6) + __builtin_ctzll(bits);
+    }
+
+  *count = cl->sample;
+
+  return recs;
+}
+
+/*
+ * Index of the field called name (len bytes), with or without its
+ * prefix, in any case; GROUP pseudo-fields don't count. Returns -1 if
+ * there is no such field.
+ */
+int
+clarion_find_field (ClarionHandle *cl, const char *name, size_t len)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  char buf[17];
+  char *p;
+  int i;
+
+  for (i = 0; i < cl->clm.clh->numflds; i++)
+    {
+      if (clfd[i].fldtype == CL_FIELD_GROUP)
+	continue;
+
+      p = clarion_field_name(&clfd[i], buf);
+
+      if (((strlen(buf) == len) && (strncasecmp(name, buf, len) == 0))
+	  || ((strlen(p) == len) && (strncasecmp(name, p, len) == 0)))
+	return i;
+    }
+
+  return -1;
+}
+
+/* Where the data of a field starts in the record, past the record header */
+int
+clarion_field_offset (ClarionHandle *cl, int field)
+{
+  ClarionFieldDesc *clfd = cl->clm.clfd;
+  int offset = 0;
+  int i;
+
+  for (i = 0; i < field; i++)
+    {
+      if (clfd[i].fldtype != CL_FIELD_GROUP)
+	offset += clfd[i].length;
+    }
+
+  return offset;
+}
+
+/*
+ * --columns: list is a comma-separated list of field names, with or
+ * without their prefix, and MEMO for the memo entry, in any case. Fields
+ * are dumped in file order whatever the order of the list. Leaving MEMO
+ * out is the same as -n.
+ */
+int
+clarion_select_columns (ClarionHandle *cl, const char *list)
+{
+  int numflds = cl->clm.clh->numflds;
+  const char *p = list;
+  size_t len;
+  int memo = 0;
+  int i;
+
+  cl->colsel = (uint8_t *) CL_CALLOC((numflds > 0) ? numflds : 1, 1);
+  cl->colread = (uint8_t *) CL_CALLOC((numflds > 0) ? numflds : 1, 1);
+
+  if ((cl->colsel == NULL) || (cl->colread == NULL))
+    return -1;
+
+  while (*p != '\0')
+    {
+      len = strcspn(p, ",");
+
+      if ((len == 4) && (strncasecmp(p, "memo", 4) == 0))
+	memo = 1;
+      else
+	{
+	  i = clarion_find_field(cl, p, len);
+
+	  if (i < 0)
+	    {
+	      fprintf(stderr, "Unknown column %.*s\n", (int)len, p);
+	      return -1;
+	    }
+
+	  cl->colsel[i] = 1;
+	  cl->colread[i] = 1;
+	}
+
+      p += len;
+      if (*p == ',')
+	p++;
+    }
+
+  if (!memo)
+    cl->opts |= CL_OPT_NO_MEMO;
+
+  return 0;
+}
@@ -0,0 +1,855 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+#include <byteswap.h>
+
+#include "cldump.h"
+
+/*
+ * External sort (--sort-by)
+ *
+ * Each selected record gets a fixed-width binary sort key that compares
+ * with memcmp(): the sort fields, normalized from their type, then the
+ * record number so the sort is stable. Numbers are stored big-endian,
+ * the sign bit of LONGs and REALs flipped (and all bits of negative
+ * REALs), DECIMALs as their BCD bytes, strings without their trailing
+ * spaces, padded with NULs, uppercased with UPPER like a CL_KEYTYPE_UPRSW
+ * key. DESC fields have all of their bits inverted.
+ *
+ * Keys are collected in a buffer of at most --mem-limit bytes. When it's
+ * full, it is sorted and written out to a temporary file as a run; runs
+ * are then merged with a loser tree, fanin at a time over as many passes
+ * as needed for the read buffers to fit in the limit too. The record
+ * driver fetches the records in the final order, see
+ * clarion_dump_records().
+ */
+
+#define CL_SORT_MINBUF           (16 * 1024) /* per run while merging */
+#define CL_SORT_MAXFANIN         256
+
+typedef struct {
+  ClarionFieldDesc *clfd;
+  int offset; /* of the field data in the record */
+  int width; /* in the sort key */
+  int desc;
+  int upper;
+} ClarionSortField;
+
+typedef struct {
+  FILE *fp;
+  uint64_t left; /* keys still in the file */
+  uint8_t *buf;
+  size_t nbuf; /* keys in buf */
+  size_t pos;
+} ClarionRun;
+
+typedef struct {
+  ClarionRun *run;
+  int *tree; /* losers, the winner in tree[0] */
+  int k;
+  size_t keylen;
+  size_t bufkeys; /* per run */
+  uint8_t *last; /* key handed out while its run was refilled */
+} ClarionMerge;
+
+struct ClarionSort {
+  int nfields;
+  ClarionSortField *field;
+  size_t keylen; /* record number included */
+  size_t memlimit;
+
+  uint8_t *keys; /* current run */
+  size_t nkeys;
+  size_t maxkeys; /* allocated */
+
+  FILE **runs; /* spilled runs */
+  uint64_t *runlen;
+  int nruns;
+
+  ClarionMerge merge; /* of the runs, unused if the keys never left memory */
+  size_t next; /* next key in memory otherwise */
+};
+
+
+int
+clarion_sort_parse (ClarionHandle *cl, const char *spec, size_t memlimit)
+{
+  ClarionSort *st;
+  ClarionSortField *sf;
+  ClarionFieldDesc *clfd;
+  const char *p;
+  const char *end;
+  size_t len;
+  int field;
+  int n;
+
+  st = (ClarionSort *) clarion_arena_calloc(&cl->arena, 1, sizeof(ClarionSort));
+
+  for (n = 1, p = spec; *p != '\0'; p++)
+    n += (*p == ',');
+
+  if (st == NULL)
+    return -1;
+
+  st->field = (ClarionSortField *) clarion_arena_calloc(&cl->arena, n, sizeof(ClarionSortField));
+
+  if (st->field == NULL)
+    return -1;
+
+  /* FIELD [ASC|DESC] [UPPER], ... */
+  for (p = spec; *p != '\0'; p = (*end == ',') ? end + 1 : end)
+    {
+      end = p + strcspn(p, ",");
+
+      while ((p < end) && isspace((unsigned char)*p))
+	p++;
+
+      for (len = 0; (p + len < end) && !isspace((unsigned char)p[len]); len++)
+	;
+
+      field = clarion_find_field(cl, p, len);
+
+      if (field < 0)
+	{
+	  fprintf(stderr, "Unknown column %.*s\n", (int)len, p);
+	  return -1;
+	}
+
+      sf = &st->field[st->nfields++];
+      clfd = &cl->clm.clfd[field];
+
+      sf->clfd = clfd;
+      sf->offset = clarion_field_offset(cl, field);
+
+      if (cl->colread != NULL)
+	cl->colread[field] = 1;
+
+      switch (clfd->fldtype)
+	{
+	  case CL_FIELD_LONG:
+	    sf->width = 4;
+	    break;
+	  case CL_FIELD_SHORT:
+	    sf->width = 2;
+	    break;
+	  case CL_FIELD_BYTE:
+	    sf->width = 1;
+	    break;
+	  case CL_FIELD_REAL:
+	    sf->width = 9; /* uninitialized first */
+	    break;
+	  default:
+	    sf->width = clfd->length;
+	    break;
+	}
+
+      st->keylen += sf->width;
+
+      for (p += len; p < end; p += len)
+	{
+	  while ((p < end) && isspace((unsigned char)*p))
+	    p++;
+
+	  for (len = 0; (p + len < end) && !isspace((unsigned char)p[len]); len++)
+	    ;
+
+	  if (len == 0)
+	    break;
+
+	  if ((len == 3) && (strncasecmp(p, "ASC", 3) == 0))
+	    sf->desc = 0;
+	  else if ((len == 4) && (strncasecmp(p, "DESC", 4) == 0))
+	    sf->desc = 1;
+	  else if ((len == 5) && (strncasecmp(p, "UPPER", 5) == 0))
+	    sf->upper = 1;
+	  else
+	    {
+	      fprintf(stderr, "Syntax error in --sort-by at: %.*s\n", (int)(end - p), p);
+	      return -1;
+	    }
+	}
+    }
+
+  st->keylen += 4;
+  st->memlimit = memlimit;
+
+  /* Room for a few read buffers while merging, whatever the limit */
+  if (st->memlimit < 4 * CL_SORT_MINBUF)
+    st->memlimit = 4 * CL_SORT_MINBUF;
+
+  cl->sort = st;
+
+  return 0;
+}
+
+/* Writes the normalized sort key of the record at data to key */
+static void
+clarion_sort_make_key (ClarionSort *st, uint32_t recno, const uint8_t *data, uint8_t *key)
+{
+  /* Uninitialized: BO FF FF FF FF FF EF FF */
+  static const uint8_t uninit[8] = { 0xb0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xff };
+  ClarionSortField *sf;
+  const uint8_t *buf;
+  unsigned int flags;
+  uint32_t lval;
+  uint16_t sval;
+  uint64_t qval;
+  int len;
+  int i;
+  int j;
+
+  for (i = 0; i < st->nfields; i++)
+    {
+      sf = &st->field[i];
+      buf = data + sf->offset;
+
+      switch (sf->clfd->fldtype)
+	{
+	  case CL_FIELD_LONG:
+	    memcpy(&lval, buf, 4);
+	    lval = le32toh(lval);
+
+	    /* Clear the starting uninitialized byte */
+	    if ((lval >> 24) & 0x80)
+	      lval &= 0x00ffffff;
+
+	    lval = htobe32(lval ^ 0x80000000);
+	    memcpy(key, &lval, 4);
+	    break;
+
+	  case CL_FIELD_SHORT:
+	    memcpy(&sval, buf, 2);
+	    sval = htobe16(le16toh(sval));
+	    memcpy(key, &sval, 2);
+	    break;
+
+	  case CL_FIELD_BYTE:
+	    *key = *buf;
+	    break;
+
+	  case CL_FIELD_REAL:
+	    if (memcmp(uninit, buf, 8) == 0)
+	      {
+		memset(key, 0, 9);
+		break;
+	      }
+
+	    memcpy(&qval, buf, 8);
+	    qval = le64toh(qval);
+	    qval = (qval & 0x8000000000000000ULL) ? ~qval : (qval | 0x8000000000000000ULL);
+	    qval = htobe64(qval);
+
+	    key[0] = 1;
+	    memcpy(key + 1, &qval, 8);
+	    break;
+
+	  case CL_FIELD_DECIMAL:
+	    memcpy(key, buf, sf->width);
+
+	    /* Odd number of figures, the first nibble isn't one */
+	    if (sf->clfd->decsig % 2)
+	      key[0] &= 0x0f;
+	    break;
+
+	  default:
+	    len = clarion_scan_string(buf, sf->width, '\0', &flags);
+
+	    if (sf->upper)
+	      {
+		for (j = 0; j < len; j++)
+		  key[j] = toupper(buf[j]);
+	      }
+	    else
+	      memcpy(key, buf, len);
+
+	    memset(key + len, 0, sf->width - len);
+	    break;
+	}
+
+      if (sf->desc)
+	{
+	  for (j = 0; j < sf->width; j++)
+	    key[j] = ~key[j];
+	}
+
+      key += sf->width;
+    }
+
+  recno = htobe32(recno);
+  memcpy(key, &recno, 4);
+}
+
+
+static void
+clarion_sort_swap (uint8_t *a, uint8_t *b, size_t len)
+{
+  uint8_t tmp;
+
+  while (len-- > 0)
+    {
+      tmp = *a;
+      *a++ = *b;
+      *b++ = tmp;
+    }
+}
+
+/*
+ * In place quicksort of n keys of len bytes, no two of them equal
+ * (record numbers differ); the qsort() of the C library may allocate
+ * a copy of the whole array, which would break the limit.
+ */
+static void
+clarion_sort_keys (uint8_t *keys, size_t n, size_t len)
+{
+  uint8_t *pivot;
+  size_t i;
+  size_t j;
+
+  while (n > 16)
+    {
+      /* Median of three goes first, as the pivot */
+      pivot = keys + (n / 2) * len;
+
+      if (memcmp(pivot, keys, len) < 0)
+	clarion_sort_swap(pivot, keys, len);
+      if (memcmp(keys + (n - 1) * len, pivot, len) < 0)
+	{
+	  clarion_sort_swap(keys + (n - 1) * len, pivot, len);
+	  if (memcmp(pivot, keys, len) < 0)
+	    clarion_sort_swap(pivot, keys, len);
+	}
+
+      clarion_sort_swap(keys, pivot, len);
+
+      i = 0;
+      j = n;
+
+      while (1)
+	{
+	  do { i++; } while ((i < n) && (memcmp(keys + i * len, keys, len) < 0));
+	  do { j--; } while (memcmp(keys + j * len, keys, len) > 0);
+
+	  if (i >= j)
+	    break;
+
+	  clarion_sort_swap(keys + i * len, keys + j * len, len);
+	}
+
+      clarion_sort_swap(keys, keys + j * len, len);
+
+      /* Recurse on the smaller side only */
+      if (j < n - j - 1)
+	{
+	  clarion_sort_keys(keys, j, len);
+	  keys += (j + 1) * len;
+	  n -= j + 1;
+	}
+      else
+	{
+	  clarion_sort_keys(keys + (j + 1) * len, n - j - 1, len);
+	  n = j;
+	}
+    }
+
+  /* Insertion sort for the small partitions */
+  for (i = 1; i < n; i++)
+    {
+      for (j = i; (j > 0) && (memcmp(keys + (j - 1) * len, keys + j * len, len) > 0); j--)
+	clarion_sort_swap(keys + (j - 1) * len, keys + j * len, len);
+    }
+}
+
+/* Temporary file in $TMPDIR, gone once closed */
+static FILE *
+clarion_sort_tmpfile (void)
+{
+  const char *dir = getenv("TMPDIR");
+  char *path;
+  FILE *fp;
+  int fd;
+
+  if ((dir == NULL) || (*dir == '\0'))
+    dir = "/tmp";
+
+  path = (char *) CL_MALLOC(strlen(dir) + 32);
+
+  if (path == NULL)
+    return NULL;
+
+  sprintf(path, "%s/cldump-sort.XXXXXX", dir);
+
+  fd = mkstemp(path);
+
+  if (fd < 0)
+    {
+      fprintf(stderr, "Could not create a temporary file in %s: %s\n", dir, strerror(errno));
+      free(path);
+      return NULL;
+    }
+
+  unlink(path);
+  free(path);
+
+  fp = fdopen(fd, "w+b");
+
+  if (fp == NULL)
+    close(fd);
+
+  return fp;
+}
+
+static int
+clarion_sort_add_run (ClarionSort *st, FILE *fp, uint64_t len)
+{
+  FILE **runs;
+  uint64_t *runlen;
+
+  runs = (FILE **) CL_REALLOC(st->runs, (st->nruns + 1) * sizeof(FILE *));
+
+  if (runs == NULL)
+    return -1;
+
+  st->runs = runs;
+
+  runlen = (uint64_t *) CL_REALLOC(st->runlen, (st->nruns + 1) * sizeof(uint64_t));
+
+  if (runlen == NULL)
+    return -1;
+
+  st->runlen = runlen;
+
+  st->runs[st->nruns] = fp;
+  st->runlen[st->nruns] = len;
+  st->nruns++;
+
+  return 0;
+}
+
+/* Sorts the keys in memory and writes them out as a run */
+static int
+clarion_sort_spill (ClarionSort *st)
+{
+  uint64_t t0 = CL_TRACE_BEGIN();
+  FILE *fp;
+
+  clarion_sort_keys(st->keys, st->nkeys, st->keylen);
+
+  fp = clarion_sort_tmpfile();
+
+  if (fp == NULL)
+    return -1;
+
+  if ((fwrite(st->keys, st->keylen, st->nkeys, fp) != st->nkeys) || (fflush(fp) != 0)
+      || (clarion_sort_add_run(st, fp, st->nkeys) < 0))
+    {
+      fprintf(stderr, "Error writing sort run: %s\n", strerror(errno));
+      fclose(fp);
+      return -1;
+    }
+
+  CL_TRACE_END("spill", "io", t0, "keys", st->nkeys);
+
+  st->nkeys = 0;
+
+  return 0;
+}
+
+/* Record function collecting the sort keys */
+void
+clarion_sort_key (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+		  uint8_t *data, ClarionOutput *out, void *ctx)
+{
+  ClarionSort *st = cl->sort;
+  size_t max = st->memlimit / st->keylen;
+  size_t n;
+  uint8_t *keys;
+
+  if (st->nkeys == st->maxkeys)
+    {
+      if (st->maxkeys == max)
+	{
+	  if (clarion_sort_spill(st) < 0)
+	    exit(1);
+	}
+      else
+	{
+	  /* Grows up to the limit, small tables don't take it all */
+	  n = (st->maxkeys > 0) ? st->maxkeys * 2 : 4096;
+	  if (n > max)
+	    n = max;
+
+	  keys = (uint8_t *) CL_REALLOC(st->keys, n * st->keylen);
+
+	  if (keys == NULL)
+	    {
+	      fprintf(stderr, "Out of memory\n");
+	      exit(1);
+	    }
+
+	  st->keys = keys;
+	  st->maxkeys = n;
+	}
+    }
+
+  clarion_sort_make_key(st, recno, data, st->keys + st->nkeys * st->keylen);
+  st->nkeys++;
+}
+
+
+static int
+clarion_run_fill (ClarionMerge *m, ClarionRun *r)
+{
+  size_t n = (r->left < m->bufkeys) ? r->left : m->bufkeys;
+
+  r->pos = 0;
+  r->nbuf = fread(r->buf, m->keylen, n, r->fp);
+  r->left -= n;
+
+  if (r->nbuf != n)
+    {
+      fprintf(stderr, "Error reading sort run: %s\n", strerror(errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Current key of run i, NULL once it's done */
+static uint8_t *
+clarion_run_key (ClarionMerge *m, int i)
+{
+  ClarionRun *r = &m->run[i];
+
+  return (r->pos < r->nbuf) ? r->buf + r->pos * m->keylen : NULL;
+}
+
+/* Whether run a wins over run b, k being the initial sentinel */
+static int
+clarion_run_wins (ClarionMerge *m, int a, int b)
+{
+  uint8_t *ka;
+  uint8_t *kb;
+
+  if (b == m->k)
+    return 0;
+  if (a == m->k)
+    return 1;
+
+  ka = clarion_run_key(m, a);
+  kb = clarion_run_key(m, b);
+
+  if (kb == NULL)
+    return 1;
+  if (ka == NULL)
+    return 0;
+
+  return memcmp(ka, kb, m->keylen) < 0;
+}
+
+/* Plays run s up the loser tree */
+static void
+clarion_run_adjust (ClarionMerge *m, int s)
+{
+  int t;
+  int tmp;
+
+  for (t = (s + m->k) / 2; t > 0; t /= 2)
+    {
+      if (clarion_run_wins(m, m->tree[t], s))
+	{
+	  tmp = m->tree[t];
+	  m->tree[t] = s;
+	  s = tmp;
+	}
+    }
+
+  m->tree[0] = s;
+}
+
+static void
+clarion_merge_end (ClarionMerge *m)
+{
+  int i;
+
+  if (m->run == NULL)
+    return;
+
+  for (i = 0; i < m->k; i++)
+    {
+      fclose(m->run[i].fp);
+      free(m->run[i].buf);
+    }
+
+  free(m->run);
+  free(m->tree);
+  free(m->last);
+  memset(m, 0, sizeof(ClarionMerge));
+}
+
+/* Sets up the merge of k runs, each one read through a buffer of bufsize bytes */
+static int
+clarion_merge_start (ClarionMerge *m, FILE **runs, uint64_t *runlen, int k, size_t keylen, size_t bufsize)
+{
+  int i;
+
+  m->k = k;
+  m->keylen = keylen;
+  m->bufkeys = (bufsize > keylen) ? bufsize / keylen : 1;
+  m->run = (ClarionRun *) CL_CALLOC(k, sizeof(ClarionRun));
+  m->tree = (int *) CL_MALLOC(k * sizeof(int));
+  m->last = (uint8_t *) CL_MALLOC(keylen);
+
+  if ((m->run == NULL) || (m->tree == NULL) || (m->last == NULL))
+    return -1;
+
+  /* The runs are closed with the merge from now on */
+  for (i = 0; i < k; i++)
+    {
+      m->run[i].fp = runs[i];
+      m->run[i].left = runlen[i];
+    }
+
+  for (i = 0; i < k; i++)
+    {
+      m->run[i].buf = (uint8_t *) CL_MALLOC(m->bufkeys * keylen);
+
+      if ((m->run[i].buf == NULL) || (fseeko(m->run[i].fp, 0, SEEK_SET) != 0)
+	  || (clarion_run_fill(m, &m->run[i]) < 0))
+	return -1;
+
+      m->tree[i] = k;
+    }
+
+  for (i = k - 1; i >= 0; i--)
+    clarion_run_adjust(m, i);
+
+  return 0;
+}
+
+/* Next key of the merge, NULL at the end; valid until the next call */
+static uint8_t *
+clarion_merge_next (ClarionMerge *m)
+{
+  ClarionRun *r;
+  uint8_t *key;
+  int w = m->tree[0];
+
+  key = clarion_run_key(m, w);
+
+  if (key == NULL)
+    return NULL;
+
+  r = &m->run[w];
+  r->pos++;
+
+  /* Keep the key aside before its buffer is read into again */
+  if ((r->pos == r->nbuf) && (r->left > 0))
+    {
+      memcpy(m->last, key, m->keylen);
+      key = m->last;
+
+      if (clarion_run_fill(m, r) < 0)
+	exit(1);
+    }
+
+  clarion_run_adjust(m, w);
+
+  return key;
+}
+
+/* Merges k runs into a new one, returns NULL on error */
+static FILE *
+clarion_merge_runs (ClarionSort *st, FILE **runs, uint64_t *runlen, int k, uint64_t *len)
+{
+  ClarionMerge m;
+  uint8_t *key;
+  FILE *fp;
+
+  memset(&m, 0, sizeof(ClarionMerge));
+
+  fp = clarion_sort_tmpfile();
+
+  if (fp == NULL)
+    return NULL;
+
+  /* A buffer for each run and stdio's for the output */
+  if (clarion_merge_start(&m, runs, runlen, k, st->keylen, st->memlimit / (k + 1)) < 0)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+
+  for (*len = 0; (key = clarion_merge_next(&m)) != NULL; (*len)++)
+    {
+      if (fwrite(key, st->keylen, 1, fp) != 1)
+	break;
+    }
+
+  clarion_merge_end(&m);
+
+  if ((key != NULL) || (fflush(fp) != 0))
+    {
+      fprintf(stderr, "Error writing sort run: %s\n", strerror(errno));
+      fclose(fp);
+      return NULL;
+    }
+
+  return fp;
+}
+
+/*
+ * Done with the keys: sorts what is left in memory, or spills it and
+ * merges the runs down to as many as there can be read buffers within
+ * the limit.
+ */
+int
+clarion_sort_finish (ClarionHandle *cl)
+{
+  ClarionSort *st = cl->sort;
+  uint64_t t0 = CL_TRACE_BEGIN();
+  FILE **runs;
+  uint64_t *runlen;
+  uint64_t len;
+  FILE *fp;
+  int fanin;
+  int nruns;
+  int ret;
+  int i;
+  int k;
+
+  st->next = 0;
+
+  /* All in memory */
+  if (st->nruns == 0)
+    {
+      clarion_sort_keys(st->keys, st->nkeys, st->keylen);
+      CL_TRACE_END("sort", "cpu", t0, "keys", st->nkeys);
+      return 0;
+    }
+
+  if ((st->nkeys > 0) && (clarion_sort_spill(st) < 0))
+    return -1;
+
+  /* The read buffers take the memory of the keys */
+  free(st->keys);
+  st->keys = NULL;
+  st->nkeys = 0;
+  st->maxkeys = 0;
+
+  fanin = st->memlimit / CL_SORT_MINBUF - 1;
+  if (fanin > CL_SORT_MAXFANIN)
+    fanin = CL_SORT_MAXFANIN;
+  if (fanin < 2)
+    fanin = 2;
+
+  while (st->nruns > fanin)
+    {
+      runs = st->runs;
+      runlen = st->runlen;
+      nruns = st->nruns;
+
+      st->runs = NULL;
+      st->runlen = NULL;
+      st->nruns = 0;
+
+      for (i = 0; i < nruns; i += k)
+	{
+	  k = (nruns - i < fanin) ? nruns - i : fanin;
+
+	  fp = clarion_merge_runs(st, runs + i, runlen + i, k, &len);
+
+	  if ((fp == NULL) || (clarion_sort_add_run(st, fp, len) < 0))
+	    return -1;
+	}
+
+      free(runs);
+      free(runlen);
+    }
+
+  ret = clarion_merge_start(&st->merge, st->runs, st->runlen, st->nruns, st->keylen,
+			    st->memlimit / (st->nruns + 1));
+
+  /* The runs belong to the merge now */
+  st->nruns = 0;
+
+  if (ret < 0)
+    return -1;
+
+  CL_TRACE_END("sort", "io", t0, "runs", st->merge.k);
+
+  return 0;
+}
+
+/* Index of the next record in sort order, returns 0 at the end */
+int
+clarion_sort_next (ClarionHandle *cl, uint32_t *recno)
+{
+  ClarionSort *st = cl->sort;
+  uint8_t *key;
+
+  if (st->merge.run != NULL)
+    key = clarion_merge_next(&st->merge);
+  else if (st->next < st->nkeys)
+    key = st->keys + st->next++ * st->keylen;
+  else
+    key = NULL;
+
+  if (key == NULL)
+    return 0;
+
+  memcpy(recno, key + st->keylen - 4, 4);
+  *recno = be32toh(*recno);
+
+  return 1;
+}
+
+void
+clarion_sort_free (ClarionHandle *cl)
+{
+  ClarionSort *st = cl->sort;
+  int i;
+
+  if (st == NULL)
+    return;
+
+  clarion_merge_end(&st->merge);
+
+  for (i = 0; i < st->nruns; i++)
+    fclose(st->runs[i]);
+
+  free(st->runs);
+  free(st->runlen);
+  free(st->keys);
+
+  st->runs = NULL;
+  st->runlen = NULL;
+  st->nruns = 0;
+  st->keys = NULL;
+  st->nkeys = 0;
+  st->maxkeys = 0;
+}
@@ -0,0 +1,391 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "cldump.h"
+
+/*
+ * Run statistics for --stats and --progress
+ *
+ * Each thread counts records, bytes and memo chain lengths in its own
+ * ClarionStats and adds them to the totals once done, so counting is a
+ * plain increment. With --stats, the threads also keep a wall and CPU
+ * clock running for the phase they are in: parsing the metadata, reading
+ * and decoding the records, fetching the memo entries, transcoding and
+ * writing the output. The clocks are read on phase switches only, which
+ * happen at most a few times per record.
+ *
+ * With make INSTRUMENT=1, the CL_PREAD(), CL_MALLOC(), CL_ICONV(), ...
+ * wrappers around the I/O, allocation and iconv points also count calls
+ * per phase.
+ */
+
+int cl_stats_on;
+__thread int cl_phase = CL_PHASE_META;
+__thread ClarionStats cl_stats;
+
+#ifdef CL_INSTRUMENT
+ClarionCounters cl_counters[CL_PHASE_MAX];
+#endif
+
+static ClarionStats cl_stats_total;
+static pthread_mutex_t cl_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t cl_stats_t0;
+
+static const char *cl_phase_names[CL_PHASE_MAX] = {
+  "meta",
+  "data",
+  "memo",
+  "transcode",
+  "output"
+};
+
+static const char *cl_memo_hist_names[CL_MEMO_HIST] = {
+  "1",
+  "2",
+  "3-4",
+  "5-8",
+  "9-16",
+  "17-32",
+  "33-64",
+  "65+"
+};
+
+#ifdef CL_INSTRUMENT
+static const char *cl_counter_names[CL_CNT_MAX] = {
+  "allocs",
+  "bytes",
+  "reads",
+  "writes",
+  "seeks",
+  "iconv"
+};
+#endif
+
+
+static uint64_t
+clarion_clock (clockid_t clk)
+{
+  struct timespec ts;
+
+  clock_gettime(clk, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+clarion_stats_start (int timing)
+{
+  cl_stats_t0 = clarion_clock(CLOCK_MONOTONIC);
+  cl_stats_on = timing;
+
+  if (timing)
+    clarion_stats_phase(cl_phase);
+}
+
+/* Charges the time since the last switch to the current phase */
+int
+clarion_stats_phase (int phase)
+{
+  int prev = cl_phase;
+  uint64_t wall;
+  uint64_t cpu;
+
+  wall = clarion_clock(CLOCK_MONOTONIC);
+  cpu = clarion_clock(CLOCK_THREAD_CPUTIME_ID);
+
+  if (cl_stats.last_wall != 0)
+    {
+      cl_stats.wall[prev] += wall - cl_stats.last_wall;
+      cl_stats.cpu[prev] += cpu - cl_stats.last_cpu;
+    }
+
+  cl_stats.last_wall = wall;
+  cl_stats.last_cpu = cpu;
+
+  cl_phase = phase;
+
+  return prev;
+}
+
+void
+clarion_stats_memo (uint32_t blocks)
+{
+  int i = 0;
+
+  if (blocks > 1)
+    i = 32 - __builtin_clz(blocks - 1);
+
+  if (i >= CL_MEMO_HIST)
+    i = CL_MEMO_HIST - 1;
+
+  cl_stats.memohist[i]++;
+}
+
+/* Called by each thread when done */
+void
+clarion_stats_merge (void)
+{
+  int i;
+
+  if (cl_stats_on)
+    clarion_stats_phase(cl_phase);
+
+  pthread_mutex_lock(&cl_stats_lock);
+
+  for (i = 0; i < CL_PHASE_MAX; i++)
+    {
+      cl_stats_total.wall[i] += cl_stats.wall[i];
+      cl_stats_total.cpu[i] += cl_stats.cpu[i];
+    }
+
+  for (i = 0; i < CL_MEMO_HIST; i++)
+    cl_stats_total.memohist[i] += cl_stats.memohist[i];
+
+  cl_stats_total.scanned += cl_stats.scanned;
+  cl_stats_total.emitted += cl_stats.emitted;
+  cl_stats_total.skipped += cl_stats.skipped;
+  cl_stats_total.datbytes += cl_stats.datbytes;
+  cl_stats_total.membytes += cl_stats.membytes;
+  cl_stats_total.outbytes += cl_stats.outbytes;
+
+  pthread_mutex_unlock(&cl_stats_lock);
+
+  memset(&cl_stats, 0, sizeof(ClarionStats));
+}
+
+/*
+ * The record counters of this thread and of the threads done so far,
+ * for a pass over the records that shouldn't count, such as the one
+ * collecting the --sort-by keys: they are put back by
+ * clarion_stats_restore() once its threads are done. Time spent and
+ * deleted records skipped, only counted by that pass, stay.
+ */
+void
+clarion_stats_save (ClarionStats saved[2])
+{
+  saved[0] = cl_stats;
+
+  pthread_mutex_lock(&cl_stats_lock);
+  saved[1] = cl_stats_total;
+  pthread_mutex_unlock(&cl_stats_lock);
+}
+
+void
+clarion_stats_restore (const ClarionStats saved[2])
+{
+  cl_stats.scanned = saved[0].scanned;
+  cl_stats.emitted = saved[0].emitted;
+  cl_stats.datbytes = saved[0].datbytes;
+
+  pthread_mutex_lock(&cl_stats_lock);
+  cl_stats_total.scanned = saved[1].scanned;
+  cl_stats_total.emitted = saved[1].emitted;
+  cl_stats_total.datbytes = saved[1].datbytes;
+  pthread_mutex_unlock(&cl_stats_lock);
+}
+
+/* Called by the decoding thread after each block of records */
+void
+clarion_stats_progress (uint64_t done, uint64_t total, int interval)
+{
+  static uint64_t next;
+  uint64_t now;
+  double elapsed;
+
+  now = clarion_clock(CLOCK_MONOTONIC);
+
+  if (next == 0)
+    next = cl_stats_t0 + (uint64_t)interval * 1000000000ULL;
+
+  if (now < next)
+    return;
+
+  next = now + (uint64_t)interval * 1000000000ULL;
+  elapsed = (now - cl_stats_t0) / 1e9;
+
+  fprintf(stderr, "Progress: %llu/%llu records (%.1f%%), %.0f records/s\n",
+	  (unsigned long long)done, (unsigned long long)total,
+	  (total > 0) ? done * 100.0 / total : 100.0,
+	  (elapsed > 0) ? done / elapsed : 0.0);
+}
+
+
+static void
+clarion_stats_text (FILE *fp, const ClarionStats *st, double wall, double cpu)
+{
+  int i;
+#ifdef CL_INSTRUMENT
+  int j;
+#endif
+
+  fprintf(fp, "===== STATS =====\n\n");
+
+  fprintf(fp, "wall time      : %.3f s\n", wall);
+  fprintf(fp, "cpu time       : %.3f s\n", cpu);
+  fprintf(fp, "records        : %llu scanned, %llu emitted, %llu deleted skipped\n",
+	  (unsigned long long)st->scanned, (unsigned long long)st->emitted,
+	  (unsigned long long)st->skipped);
+  fprintf(fp, "throughput     : %.0f records/s\n", (wall > 0) ? st->scanned / wall : 0.0);
+  fprintf(fp, "DAT bytes read : %llu\n", (unsigned long long)st->datbytes);
+  fprintf(fp, "MEM bytes read : %llu\n", (unsigned long long)st->membytes);
+  fprintf(fp, "output bytes   : %llu\n", (unsigned long long)st->outbytes);
+
+  fprintf(fp, "\nphase          %12s %12s\n", "wall (s)", "cpu (s)");
+
+  for (i = 0; i < CL_PHASE_MAX; i++)
+    fprintf(fp, "%-14s %12.3f %12.3f\n", cl_phase_names[i], st->wall[i] / 1e9, st->cpu[i] / 1e9);
+
+  fprintf(fp, "\nmemo chain (blocks) %12s\n", "entries");
+
+  for (i = 0; i < CL_MEMO_HIST; i++)
+    fprintf(fp, "%-19s %12llu\n", cl_memo_hist_names[i], (unsigned long long)st->memohist[i]);
+
+  fprintf(fp, "\n");
+
+#ifdef CL_INSTRUMENT
+  fprintf(fp, "phase     ");
+  for (j = 0; j < CL_CNT_MAX; j++)
+    fprintf(fp, " %12s", cl_counter_names[j]);
+  fprintf(fp, "\n");
+
+  for (i = 0; i < CL_PHASE_MAX; i++)
+    {
+      fprintf(fp, "%-10s", cl_phase_names[i]);
+
+      for (j = 0; j < CL_CNT_MAX; j++)
+	fprintf(fp, " %12llu", (unsigned long long)cl_counters[i].cnt[j]);
+
+      fprintf(fp, "\n");
+    }
+
+  if (st->scanned > 0)
+    {
+      fprintf(fp, "\nper 1M records:\n");
+
+      for (i = 0; i < CL_PHASE_MAX; i++)
+	{
+	  fprintf(fp, "%-10s", cl_phase_names[i]);
+
+	  for (j = 0; j < CL_CNT_MAX; j++)
+	    fprintf(fp, " %12.0f", cl_counters[i].cnt[j] * 1e6 / st->scanned);
+
+	  fprintf(fp, "\n");
+	}
+    }
+#else
+  fprintf(fp, "Counters not built in, rebuild with make INSTRUMENT=1\n");
+#endif
+
+  fprintf(fp, "\n===== END OF STATS =====\n");
+}
+
+static void
+clarion_stats_json (FILE *fp, const ClarionStats *st, double wall, double cpu)
+{
+  int i;
+#ifdef CL_INSTRUMENT
+  int j;
+#endif
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"wall_s\": %.6f,\n", wall);
+  fprintf(fp, "  \"cpu_s\": %.6f,\n", cpu);
+  fprintf(fp, "  \"records\": { \"scanned\": %llu, \"emitted\": %llu, \"deleted_skipped\": %llu },\n",
+	  (unsigned long long)st->scanned, (unsigned long long)st->emitted,
+	  (unsigned long long)st->skipped);
+  fprintf(fp, "  \"records_per_s\": %.1f,\n", (wall > 0) ? st->scanned / wall : 0.0);
+  fprintf(fp, "  \"bytes\": { \"dat_read\": %llu, \"mem_read\": %llu, \"output\": %llu },\n",
+	  (unsigned long long)st->datbytes, (unsigned long long)st->membytes,
+	  (unsigned long long)st->outbytes);
+
+  fprintf(fp, "  \"phases\": {\n");
+  for (i = 0; i < CL_PHASE_MAX; i++)
+    fprintf(fp, "    \"%s\": { \"wall_s\": %.6f, \"cpu_s\": %.6f }%s\n", cl_phase_names[i],
+	    st->wall[i] / 1e9, st->cpu[i] / 1e9, (i < CL_PHASE_MAX - 1) ? "," : "");
+  fprintf(fp, "  },\n");
+
+  fprintf(fp, "  \"memo_chain_blocks\": {");
+  for (i = 0; i < CL_MEMO_HIST; i++)
+    fprintf(fp, "%s \"%s\": %llu", (i > 0) ? "," : "", cl_memo_hist_names[i],
+	    (unsigned long long)st->memohist[i]);
+  fprintf(fp, " }");
+
+#ifdef CL_INSTRUMENT
+  fprintf(fp, ",\n  \"counters\": {\n");
+  for (i = 0; i < CL_PHASE_MAX; i++)
+    {
+      fprintf(fp, "    \"%s\": {", cl_phase_names[i]);
+
+      for (j = 0; j < CL_CNT_MAX; j++)
+	fprintf(fp, "%s \"%s\": %llu", (j > 0) ? "," : "", cl_counter_names[j],
+		(unsigned long long)cl_counters[i].cnt[j]);
+
+      fprintf(fp, " }%s\n", (i < CL_PHASE_MAX - 1) ? "," : "");
+    }
+  fprintf(fp, "  }");
+#endif
+
+  fprintf(fp, "\n}\n");
+}
+
+/* Prints the report to stderr, or writes it to jsonfile in JSON */
+int
+clarion_stats_print (const char *jsonfile)
+{
+  FILE *fp;
+  double wall;
+  double cpu;
+
+  clarion_stats_merge();
+
+  wall = (clarion_clock(CLOCK_MONOTONIC) - cl_stats_t0) / 1e9;
+  cpu = clarion_clock(CLOCK_PROCESS_CPUTIME_ID) / 1e9;
+
+  if (jsonfile == NULL)
+    {
+      clarion_stats_text(stderr, &cl_stats_total, wall, cpu);
+      return 0;
+    }
+
+  fp = fopen(jsonfile, "w");
+
+  if (fp == NULL)
+    {
+      fprintf(stderr, "Could not open stats file %s: %s\n", jsonfile, strerror(errno));
+      return -1;
+    }
+
+  clarion_stats_json(fp, &cl_stats_total, wall, cpu);
+
+  if (fclose(fp) != 0)
+    {
+      fprintf(stderr, "Error writing stats file %s: %s\n", jsonfile, strerror(errno));
+      return -1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "cldump.h"
+
+/*
+ * Timeline for --trace, in the Chrome trace event format (chrome://tracing,
+ * Perfetto)
+ *
+ * Each thread records complete events ("ph":"X") into its own buffer, a
+ * list of fixed-size chunks only ever touched by that thread; the buffers
+ * are linked into a global list with a compare-and-swap when a thread
+ * records its first event, and written out once the dump is done. Spans
+ * are categorized as "cpu" (decoding), "io" (reads and writes) and "wait"
+ * (pipeline stages waiting on each other).
+ */
+
+#define CL_TRACE_CHUNK           4096 /* events */
+
+typedef struct {
+  const char *name;
+  const char *cat;
+  const char *argname;
+  uint64_t ts; /* ns */
+  uint64_t dur;
+  int64_t arg;
+} ClarionTraceEvent;
+
+typedef struct cl_trace_chunk {
+  struct cl_trace_chunk *next;
+  uint32_t count;
+  ClarionTraceEvent ev[CL_TRACE_CHUNK];
+} ClarionTraceChunk;
+
+typedef struct cl_trace_buf {
+  struct cl_trace_buf *next;
+  int tid;
+  const char *name;
+  ClarionTraceChunk *head;
+  ClarionTraceChunk *cur;
+} ClarionTraceBuf;
+
+int cl_trace_on;
+
+static ClarionTraceBuf *cl_trace_bufs;
+static int cl_trace_tids;
+static uint64_t cl_trace_t0;
+
+static __thread ClarionTraceBuf *cl_trace_buf;
+
+
+uint64_t
+clarion_trace_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+clarion_trace_start (void)
+{
+  cl_trace_t0 = clarion_trace_now();
+  cl_trace_on = 1;
+
+  clarion_trace_thread("main");
+}
+
+static ClarionTraceBuf *
+clarion_trace_buf (void)
+{
+  ClarionTraceBuf *tb;
+
+  if (cl_trace_buf != NULL)
+    return cl_trace_buf;
+
+  tb = (ClarionTraceBuf *) calloc(1, sizeof(ClarionTraceBuf));
+
+  if (tb == NULL)
+    return NULL;
+
+  tb->tid = __atomic_add_fetch(&cl_trace_tids, 1, __ATOMIC_RELAXED);
+  tb->name = "thread";
+
+  tb->next = __atomic_load_n(&cl_trace_bufs, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&cl_trace_bufs, &tb->next, tb, 1,
+				      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+
+  cl_trace_buf = tb;
+
+  return tb;
+}
+
+/* Names the track of the calling thread */
+void
+clarion_trace_thread (const char *name)
+{
+  ClarionTraceBuf *tb;
+
+  if (!cl_trace_on)
+    return;
+
+  tb = clarion_trace_buf();
+
+  if (tb != NULL)
+    tb->name = name;
+}
+
+/* Records a span that started at t0, from CL_TRACE_BEGIN() */
+void
+clarion_trace_event (const char *name, const char *cat, uint64_t t0, const char *argname, int64_t arg)
+{
+  ClarionTraceBuf *tb;
+  ClarionTraceChunk *c;
+  ClarionTraceEvent *ev;
+  uint64_t now;
+
+  now = clarion_trace_now();
+
+  tb = clarion_trace_buf();
+
+  if (tb == NULL)
+    return;
+
+  c = tb->cur;
+
+  if ((c == NULL) || (c->count == CL_TRACE_CHUNK))
+    {
+      c = (ClarionTraceChunk *) malloc(sizeof(ClarionTraceChunk));
+
+      /* Out of memory, the timeline will have a gap */
+      if (c == NULL)
+	return;
+
+      c->next = NULL;
+      c->count = 0;
+
+      if (tb->cur != NULL)
+	tb->cur->next = c;
+      else
+	tb->head = c;
+
+      tb->cur = c;
+    }
+
+  ev = &c->ev[c->count++];
+
+  ev->name = name;
+  ev->cat = cat;
+  ev->argname = argname;
+  ev->ts = t0;
+  ev->dur = now - t0;
+  ev->arg = arg;
+}
+
+/*
+ * Writes the events of all threads to tracefile and frees the buffers;
+ * the other threads must be done recording.
+ */
+int
+clarion_trace_write (const char *tracefile)
+{
+  ClarionTraceBuf *tb;
+  ClarionTraceBuf *tbnext;
+  ClarionTraceChunk *c;
+  ClarionTraceChunk *cnext;
+  ClarionTraceEvent *ev;
+  FILE *fp;
+  const char *sep = "";
+  uint32_t i;
+  int ret = 0;
+
+  cl_trace_on = 0;
+
+  fp = fopen(tracefile, "w");
+
+  if (fp == NULL)
+    {
+      fprintf(stderr, "Could not open trace file %s: %s\n", tracefile, strerror(errno));
+      ret = -1;
+    }
+  else
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  for (tb = __atomic_load_n(&cl_trace_bufs, __ATOMIC_ACQUIRE); tb != NULL; tb = tbnext)
+    {
+      if (fp != NULL)
+	{
+	  fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		  sep, tb->tid, tb->name);
+	  sep = ",\n";
+	}
+
+      for (c = tb->head; c != NULL; c = cnext)
+	{
+	  for (i = 0; (fp != NULL) && (i < c->count); i++)
+	    {
+	      ev = &c->ev[i];
+
+	      fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+		      "\"ts\":%.3f,\"dur\":%.3f",
+		      ev->name, ev->cat, tb->tid,
+		      (ev->ts - cl_trace_t0) / 1e3, ev->dur / 1e3);
+
+	      if (ev->argname != NULL)
+		fprintf(fp, ",\"args\":{\"%s\":%lld}", ev->argname, (long long)ev->arg);
+
+	      fprintf(fp, "}");
+	    }
+
+	  cnext = c->next;
+	  free(c);
+	}
+
+      tbnext = tb->next;
+      free(tb);
+    }
+
+  cl_trace_bufs = NULL;
+  cl_trace_buf = NULL;
+
+  if (fp != NULL)
+    {
+      fprintf(fp, "\n]}\n");
+
+      if (fclose(fp) != 0)
+	{
+	  fprintf(stderr, "Error writing trace file %s: %s\n", tracefile, strerror(errno));
+	  ret = -1;
+	}
+    }
+
+  return ret;
+}
@@ -26,6 +26,10 @@
 #include <endian.h>
 #include <byteswap.h>
 #include <iconv.h>
+#include <errno.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #if BYTE_ORDER == BIG_ENDIAN
 size_t cl_fread (void *ptr, size_t size, size_t nmemb, FILE *stream)
@@ -65,89 +69,393 @@ size_t cl_fread (void *ptr, size_t size, size_t nmemb, FILE *stream)
  */
 #include "cldump.h"
 
-void
+int
 clarion_trim (uint8_t *data, int length)
 {
-  int i;
+  unsigned int flags;
 
-  for (i = (length - 1); i >= 0; i--)
-    {
-      if (data[i] == 0x20)
-	continue;
-      else
-	{
-	  data[i + 1] = '\0';
-	  return;
-	}
-    }
-  data[0] = '\0';
+  return clarion_trim_scan(data, length, '\0', &flags);
 }
 
+/*
+ * Collapses runs of spaces into a single space, in place, in one pass
+ */
 void
 clarion_singlespace (char *data)
 {
-  char *p = NULL;
-  uint32_t offset;
+  char *out = data;
+  int space = 0;
 
-  while (*data != '\0')
+  for (; *data != '\0'; data++)
     {
       if (*data == 0x20)
 	{
-	  if (p == NULL)
-	    p = data;
+	  if (space)
+	    continue;
+	  space = 1;
 	}
       else
+	space = 0;
+
+      *out++ = *data;
+    }
+
+  *out = '\0';
+}
+
+/*
+ * Per-thread iconv state: the conversion descriptor is opened once per
+ * charset and the output buffer is reused from one call to the next.
+ */
+static __thread iconv_t cl_iconv_cd = (iconv_t)(-1);
+static __thread char *cl_iconv_charset;
+static __thread char *cl_iconv_buf;
+static __thread size_t cl_iconv_buflen;
+
+static char *
+clarion_iconv_convert (const char *charset, const char *data, size_t len, size_t *outlen)
+{
+  char *in, *out;
+  size_t inleft, outleft;
+  size_t ret;
+
+  if ((cl_iconv_charset == NULL) || (strcmp(cl_iconv_charset, charset) != 0))
+    {
+      if (cl_iconv_cd != (iconv_t)(-1))
+	iconv_close(cl_iconv_cd);
+      free(cl_iconv_charset);
+      cl_iconv_charset = NULL;
+
+      cl_iconv_cd = iconv_open("UTF-8", charset);
+
+      if (cl_iconv_cd == (iconv_t)(-1))
+	return NULL;
+
+      cl_iconv_charset = strdup(charset);
+    }
+
+  /* Single-byte charsets need at most 3 UTF-8 bytes per character */
+  if (cl_iconv_buflen < (3 * len + 1))
+    {
+      free(cl_iconv_buf);
+      cl_iconv_buflen = 3 * len + 256;
+      cl_iconv_buf = (char *) CL_MALLOC(cl_iconv_buflen);
+
+      if (cl_iconv_buf == NULL)
 	{
-	  if (p != NULL)
-	    {
-	      p++;
-	      offset = data - p;
-	      memmove(p, data, strlen(data)+1);
+	  cl_iconv_buflen = 0;
+	  return NULL;
+	}
+    }
 
-	      data = data - offset;
+  do
+    {
+      CL_ICONV(cl_iconv_cd, NULL, NULL, NULL, NULL);
+
+      in = (char *)data;
+      inleft = len;
+      out = cl_iconv_buf;
+      outleft = cl_iconv_buflen - 1;
 
-	      p = NULL;
+      ret = CL_ICONV(cl_iconv_cd, &in, &inleft, &out, &outleft);
+
+      if ((ret == (size_t)(-1)) && (errno == E2BIG))
+	{
+	  free(cl_iconv_buf);
+	  cl_iconv_buflen *= 2;
+	  cl_iconv_buf = (char *) CL_MALLOC(cl_iconv_buflen);
+
+	  if (cl_iconv_buf == NULL)
+	    {
+	      cl_iconv_buflen = 0;
+	      return NULL;
 	    }
+
+	  continue;
 	}
 
-      data++;
-    }
+      break;
+    } while (1);
+
+  if (ret == (size_t)(-1))
+    return NULL;
+
+  *out = '\0';
+  *outlen = out - cl_iconv_buf;
+
+  return cl_iconv_buf;
 }
 
+/*
+ * Converts len bytes of data from charset to UTF-8 into a per-thread
+ * scratch buffer. The result is NUL-terminated and only valid until the
+ * next call from the same thread. Returns NULL if the conversion fails.
+ */
 char *
-clarion_iconv (const char *charset, char *data)
+clarion_iconv_scratch (const char *charset, const char *data, size_t len, size_t *outlen)
+{
+  char *ret;
+  int phase;
+
+  phase = CL_SET_PHASE(CL_PHASE_ICONV);
+
+  ret = clarion_iconv_convert(charset, data, len, outlen);
+
+  CL_SET_PHASE(phase);
+
+  return ret;
+}
+
+/*
+ * UTF-8 lookup table for single-byte charsets, built once per thread and
+ * charset from iconv itself: entry [b] holds the length and bytes of the
+ * UTF-8 sequence for byte b. Charsets where a byte doesn't convert on its
+ * own or where ASCII doesn't map to itself get no table.
+ */
+static __thread char *cl_map_charset;
+static __thread int cl_map_ok;
+static __thread uint8_t cl_map[256][4];
+
+static int
+clarion_charmap_load (const char *charset)
 {
   iconv_t cd;
-  char *buf, *tmp;
-  size_t len;
-  size_t buflen;
-  size_t ret;
+  char in[1];
+  char *pin, *pout;
+  size_t inleft, outleft;
+  int i;
 
-  len = strlen(data);
+  if ((cl_map_charset != NULL) && (strcmp(cl_map_charset, charset) == 0))
+    return cl_map_ok;
 
-  if (len == 0)
-    return NULL;
+  free(cl_map_charset);
+  cl_map_charset = strdup(charset);
+  cl_map_ok = 0;
 
   cd = iconv_open("UTF-8", charset);
 
   if (cd == (iconv_t)(-1))
-    return NULL;
+    return 0;
 
-  buflen = 2 * len;
-  buf = (char *) malloc(buflen + 1);
+  for (i = 0; i < 256; i++)
+    {
+      iconv(cd, NULL, NULL, NULL, NULL);
 
-  tmp = buf;
-  ret = iconv(cd, &data, &len, &tmp, &buflen);
+      in[0] = i;
+      pin = in;
+      inleft = 1;
+      pout = (char *)&cl_map[i][1];
+      outleft = 3;
 
-  if (ret == (size_t)(-1))
+      if ((iconv(cd, &pin, &inleft, &pout, &outleft) == (size_t)(-1)) || (inleft != 0))
+	break;
+
+      cl_map[i][0] = 3 - outleft;
+
+      if ((i < 0x80) && ((cl_map[i][0] != 1) || (cl_map[i][1] != i)))
+	break;
+    }
+
+  iconv_close(cd);
+
+  cl_map_ok = (i == 256);
+
+  return cl_map_ok;
+}
+
+/* Per-thread output buffer of clarion_memo_normalize() */
+static __thread uint8_t *cl_norm_buf;
+static __thread size_t cl_norm_buflen;
+
+/*
+ * Normalizes a memo entry for SQL output in a single pass: runs of spaces
+ * are collapsed, carriage returns dropped, single quotes doubled and line
+ * feeds written as \n (MySQL, where backslashes get doubled too) or kept
+ * as is (ANSI). Trailing spaces are expected to be gone already. If
+ * charset is set, bytes are transcoded to UTF-8 along the way for single-
+ * byte charsets, or the whole entry is run through iconv first otherwise.
+ * The result lives in a per-thread buffer until the next call. Returns
+ * its length, or -1 if out of memory.
+ */
+int
+clarion_memo_normalize (const uint8_t *memo, int len, const char *charset, int mysql, uint8_t **result)
+{
+  const uint8_t *end;
+  uint8_t *out;
+  uint8_t *tmp;
+  char *utf;
+  size_t utflen;
+  unsigned int flags;
+  int map = 0;
+  int space = 0;
+  uint8_t c;
+
+  if ((charset != NULL) && (clarion_scan(memo, len, '\0', &flags), (flags & CL_SCAN_NONASCII)))
     {
-      free(buf);
-      return NULL;
+      map = clarion_charmap_load(charset);
+
+      if (!map)
+	{
+	  /* Multi-byte charset: ASCII never shows up inside UTF-8 sequences */
+	  utf = clarion_iconv_scratch(charset, (const char *)memo, len, &utflen);
+
+	  if (utf != NULL)
+	    {
+	      memo = (const uint8_t *)utf;
+	      len = utflen;
+	    }
+	}
     }
 
-  *tmp = '\0';
+  /* Worst case, every byte takes 3 bytes of UTF-8 */
+  if (cl_norm_buflen < (size_t)len * 3 + 1)
+    {
+      tmp = (uint8_t *) CL_REALLOC(cl_norm_buf, (size_t)len * 3 + 256);
 
-  iconv_close(cd);
+      if (tmp == NULL)
+	return -1;
+
+      cl_norm_buf = tmp;
+      cl_norm_buflen = (size_t)len * 3 + 256;
+    }
+
+  out = cl_norm_buf;
+  end = memo + len;
+
+  for (; memo < end; memo++)
+    {
+      c = *memo;
+
+      if (c == 0x20)
+	{
+	  if (space)
+	    continue;
+	  space = 1;
+	}
+      else
+	space = 0;
+
+      switch (c)
+	{
+	  case '\r':
+	    break;
+	  case '\n':
+	    if (mysql)
+	      {
+		*out++ = '\\';
+		*out++ = 'n';
+	      }
+	    else
+	      *out++ = '\n';
+	    break;
+	  case '\'':
+	    *out++ = '\'';
+	    *out++ = '\'';
+	    break;
+	  case '\\':
+	    *out++ = '\\';
+	    if (mysql)
+	      *out++ = '\\';
+	    break;
+	  default:
+	    if ((c & 0x80) && map)
+	      {
+		memcpy(out, &cl_map[c][1], 3);
+		out += cl_map[c][0];
+	      }
+	    else
+	      *out++ = c;
+	    break;
+	}
+    }
+
+  *out = '\0';
+  *result = cl_norm_buf;
+
+  return out - cl_norm_buf;
+}
+
+/* Adds path, or the .DAT files in it if it's a directory, to the list */
+int
+clarion_collect_files (const char *path, char ***files, int *nfiles)
+{
+  struct dirent *de;
+  struct stat st;
+  char **tmp;
+  char *file;
+  size_t len;
+  DIR *d;
+
+  if ((stat(path, &st) == 0) && S_ISDIR(st.st_mode))
+    {
+      d = opendir(path);
+      if (d == NULL)
+	{
+	  fprintf(stderr, "Could not open directory %s: %s\n", path, strerror(errno));
+	  return -1;
+	}
+
+      while ((de = readdir(d)) != NULL)
+	{
+	  len = strlen(de->d_name);
+
+	  if ((len < 5) || (strcasecmp(de->d_name + len - 4, ".dat") != 0))
+	    continue;
+
+	  file = (char *) malloc(strlen(path) + len + 2);
+	  if (file == NULL)
+	    break;
+
+	  sprintf(file, "%s/%s", path, de->d_name);
+
+	  tmp = (char **) realloc(*files, (*nfiles + 1) * sizeof(char *));
+	  if (tmp == NULL)
+	    {
+	      free(file);
+	      break;
+	    }
+
+	  *files = tmp;
+	  (*files)[(*nfiles)++] = file;
+	}
+
+      closedir(d);
+
+      return 0;
+    }
+
+  tmp = (char **) realloc(*files, (*nfiles + 1) * sizeof(char *));
+  if (tmp == NULL)
+    return -1;
+
+  *files = tmp;
+  (*files)[(*nfiles)++] = strdup(path);
+
+  return 0;
+}
+
+/* Copies the name of a field into buf (17 bytes), returns it without its prefix */
+char *
+clarion_field_name (ClarionFieldDesc *clfd, char *buf)
+{
+  char *p;
+
+  memcpy(buf, clfd->fldname, 17);
+  clarion_trim((uint8_t *)buf, 16);
+
+  p = strchr(buf, ':');
+
+  return (p != NULL) ? p + 1 : buf;
+}
+
+/* 64-bit FNV-1a, h is CL_FNV_OFFSET or the hash of the previous data */
+uint64_t
+clarion_fnv (uint64_t h, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+
+  while (len-- > 0)
+    h = (h ^ *p++) * 0x100000001b3ULL;
 
-  return buf;
+  return h;
 }
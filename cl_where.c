@@ -0,0 +1,547 @@
+/*
+ * cldump - Dumps Clarion databases to text, SQL and CSV formats
+ *
+ * Copyright (C) 2026 cldump contributors
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; version 2 of the License.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <endian.h>
+#include <byteswap.h>
+
+#include "cldump.h"
+
+/*
+ * Record filter
+ *
+ * --where is a list of comparisons joined by AND, each one a field name,
+ * an operator (=, !=, <>, <, <=, >, >=) and a literal:
+ *
+ *   BRANCH = 'PARIS' AND AMOUNT >= 100.50
+ *
+ * Fields are decoded to the value the dumpers print and compared by
+ * value: LONG, SHORT, BYTE and DECIMAL fields exactly, as integers scaled
+ * by a power of ten, REALs as doubles and strings bytewise, in the
+ * charset of the file and without their trailing spaces. Literals are
+ * quoted with ' or ", doubling the quote to embed it, or left bare if
+ * they hold no spaces. An uninitialized REAL matches nothing.
+ */
+
+#define CL_WHERE_MAX             32
+
+#define CL_OP_EQ                 0
+#define CL_OP_NE                 1
+#define CL_OP_LT                 2
+#define CL_OP_LE                 3
+#define CL_OP_GT                 4
+#define CL_OP_GE                 5
+
+typedef struct {
+  ClarionFieldDesc *clfd;
+  int offset; /* of the field data in the record */
+  int op;
+  ClarionValue val;
+} ClarionWhereTerm;
+
+struct ClarionWhere {
+  int nterms;
+  ClarionWhereTerm term[];
+};
+
+
+/* Decodes the field at buf the same way the clarion_dump_field_*() functions print it */
+void
+clarion_field_value (ClarionFieldDesc *clfd, const uint8_t *buf, ClarionValue *v)
+{
+  /* Uninitialized: BO FF FF FF FF FF EF FF */
+  static const uint8_t uninit[8] = { 0xb0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xff };
+  uint32_t lval;
+  uint16_t sval;
+  uint64_t qval;
+  unsigned int flags;
+  int digits;
+  int point;
+  int i;
+
+  v->type = CL_VALUE_NUMBER;
+  v->scale = 0;
+
+  switch (clfd->fldtype)
+    {
+      case CL_FIELD_LONG:
+	memcpy(&lval, buf, 4);
+	lval = le32toh(lval);
+
+	/* Clear the starting uninitialized byte */
+	if ((lval >> 24) & 0x80)
+	  lval &= 0x00ffffff;
+
+	v->num = (int32_t)lval;
+	break;
+
+      case CL_FIELD_SHORT:
+	memcpy(&sval, buf, 2);
+	v->num = le16toh(sval);
+	break;
+
+      case CL_FIELD_BYTE:
+	v->num = *buf;
+	break;
+
+      case CL_FIELD_DECIMAL:
+	/* BCD, the first nibble is left out for an odd number of figures */
+	digits = clfd->length * 2 - (clfd->decsig % 2);
+	point = clfd->decsig - clfd->decdec;
+
+	v->num = 0;
+	for (i = clfd->length * 2 - digits; i < clfd->length * 2; i++)
+	  v->num = v->num * 10 + ((i % 2) ? (buf[i / 2] & 0x0f) : (buf[i / 2] >> 4));
+
+	if ((point >= 0) && (point < digits))
+	  v->scale = digits - point;
+	break;
+
+      case CL_FIELD_REAL:
+	if (memcmp(uninit, buf, 8) == 0)
+	  {
+	    v->type = CL_VALUE_NULL;
+	    break;
+	  }
+
+	memcpy(&qval, buf, 8);
+	qval = le64toh(qval);
+	memcpy(&v->real, &qval, 8);
+
+	v->type = CL_VALUE_REAL;
+	break;
+
+      case CL_FIELD_STRING:
+      case CL_FIELD_STRING_PIC_TOK:
+	v->type = CL_VALUE_STRING;
+	v->str = buf;
+	v->len = clarion_scan_string(buf, clfd->length, '\0', &flags);
+	break;
+
+      default:
+	v->type = CL_VALUE_NULL;
+	break;
+    }
+}
+
+static __int128
+clarion_pow10 (int n)
+{
+  __int128 p = 1;
+
+  while (n-- > 0)
+    p *= 10;
+
+  return p;
+}
+
+static double
+clarion_value_real (const ClarionValue *v)
+{
+  if (v->type == CL_VALUE_REAL)
+    return v->real;
+
+  return (double)v->num / (double)clarion_pow10(v->scale);
+}
+
+/* Compares two non-NULL values, both strings or both numbers */
+int
+clarion_value_cmp (const ClarionValue *a, const ClarionValue *b)
+{
+  __int128 x;
+  __int128 y;
+  double dx;
+  double dy;
+  int ret;
+
+  if (a->type == CL_VALUE_STRING)
+    {
+      ret = memcmp(a->str, b->str, (a->len < b->len) ? a->len : b->len);
+
+      if (ret != 0)
+	return (ret > 0) - (ret < 0);
+
+      return (a->len > b->len) - (a->len < b->len);
+    }
+
+  if ((a->type == CL_VALUE_NUMBER) && (b->type == CL_VALUE_NUMBER))
+    {
+      x = a->num;
+      y = b->num;
+
+      if (a->scale < b->scale)
+	x *= clarion_pow10(b->scale - a->scale);
+      else if (a->scale > b->scale)
+	y *= clarion_pow10(a->scale - b->scale);
+
+      return (x > y) - (x < y);
+    }
+
+  dx = clarion_value_real(a);
+  dy = clarion_value_real(b);
+
+  return (dx > dy) - (dx < dy);
+}
+
+/*
+ * Hashes a value of the field, or a literal read for it, so that values
+ * that compare equal hash the same: numbers whatever their scale.
+ */
+uint64_t
+clarion_value_hash (ClarionFieldDesc *clfd, const ClarionValue *v)
+{
+  __int128 num = v->num;
+  double real = v->real;
+  int scale = v->scale;
+  uint64_t h = CL_FNV_OFFSET;
+
+  switch (v->type)
+    {
+      case CL_VALUE_STRING:
+	h = clarion_fnv(h, v->str, v->len);
+	break;
+
+      case CL_VALUE_NUMBER:
+	if (clfd->fldtype != CL_FIELD_REAL)
+	  {
+	    while ((scale > 0) && (num % 10 == 0))
+	      {
+		num /= 10;
+		scale--;
+	      }
+
+	    h = clarion_fnv(h, &num, sizeof(__int128));
+	    h = clarion_fnv(h, &scale, sizeof(int));
+	    break;
+	  }
+
+	/* Compared with REALs as a double, see clarion_value_cmp() */
+	real = clarion_value_real(v);
+	/* Falls through */
+
+      default:
+	if (real == 0)
+	  real = 0; /* -0 */
+
+	h = clarion_fnv(h, &real, sizeof(double));
+	break;
+    }
+
+  return (h != 0) ? h : 1;
+}
+
+
+/* Parses an exact decimal number, returns -1 if that's not one */
+static int
+clarion_parse_number (const char *s, ClarionValue *v)
+{
+  int neg = 0;
+  int digits = 0;
+
+  v->type = CL_VALUE_NUMBER;
+  v->num = 0;
+  v->scale = 0;
+
+  if ((*s == '-') || (*s == '+'))
+    neg = (*s++ == '-');
+
+  for (; isdigit((unsigned char)*s); s++, digits++)
+    v->num = v->num * 10 + (*s - '0');
+
+  if (*s == '.')
+    {
+      for (s++; isdigit((unsigned char)*s); s++, digits++, v->scale++)
+	v->num = v->num * 10 + (*s - '0');
+    }
+
+  /* 38 figures still fit */
+  if ((*s != '\0') || (digits == 0) || (digits > 38))
+    return -1;
+
+  if (neg)
+    v->num = -v->num;
+
+  return 0;
+}
+
+/*
+ * Reads the literal at *p into a NUL-terminated copy allocated from the
+ * arena, moves *p past it. Returns NULL on a missing or unterminated
+ * literal.
+ */
+static char *
+clarion_parse_literal (ClarionHandle *cl, const char **p)
+{
+  const char *s = *p;
+  char *lit;
+  char *d;
+  char q;
+
+  lit = (char *) clarion_arena_alloc(&cl->arena, strlen(s) + 1);
+
+  if (lit == NULL)
+    return NULL;
+
+  d = lit;
+
+  if ((*s == '\'') || (*s == '"'))
+    {
+      q = *s++;
+
+      while (1)
+	{
+	  if (*s == '\0')
+	    return NULL;
+
+	  if (*s == q)
+	    {
+	      if (s[1] != q)
+		break;
+	      s++;
+	    }
+
+	  *d++ = *s++;
+	}
+
+      s++;
+    }
+  else
+    {
+      while ((*s != '\0') && !isspace((unsigned char)*s))
+	*d++ = *s++;
+
+      if (d == lit)
+	return NULL;
+    }
+
+  *d = '\0';
+  *p = s;
+
+  return lit;
+}
+
+/* Reads lit as a value to compare the field with, returns -1 if a number was expected */
+int
+clarion_value_parse (ClarionFieldDesc *clfd, char *lit, ClarionValue *v)
+{
+  switch (clfd->fldtype)
+    {
+      case CL_FIELD_STRING:
+      case CL_FIELD_STRING_PIC_TOK:
+	v->type = CL_VALUE_STRING;
+	v->str = (uint8_t *)lit;
+	v->len = clarion_trim((uint8_t *)lit, strlen(lit));
+	return 0;
+
+      default:
+	return clarion_parse_number(lit, v);
+    }
+}
+
+int
+clarion_where_parse (ClarionHandle *cl, const char *expr)
+{
+  static const struct {
+    const char *s;
+    int op;
+  } ops[] = {
+    { "<=", CL_OP_LE }, { ">=", CL_OP_GE }, { "!=", CL_OP_NE }, { "<>", CL_OP_NE },
+    { "=", CL_OP_EQ }, { "<", CL_OP_LT }, { ">", CL_OP_GT }
+  };
+  ClarionWhereTerm term[CL_WHERE_MAX];
+  ClarionWhereTerm *t;
+  const char *p = expr;
+  char *lit;
+  size_t len;
+  int nterms = 0;
+  int field;
+  unsigned int i;
+
+  while (1)
+    {
+      while (isspace((unsigned char)*p))
+	p++;
+
+      if (nterms == CL_WHERE_MAX)
+	{
+	  fprintf(stderr, "Too many comparisons in --where, %d at most\n", CL_WHERE_MAX);
+	  return -1;
+	}
+
+      t = &term[nterms];
+
+      for (len = 0; isalnum((unsigned char)p[len]) || (p[len] == '_') || (p[len] == ':'); len++)
+	;
+
+      if (len == 0)
+	goto syntax;
+
+      field = clarion_find_field(cl, p, len);
+
+      if (field < 0)
+	{
+	  fprintf(stderr, "Unknown column %.*s\n", (int)len, p);
+	  return -1;
+	}
+
+      t->clfd = &cl->clm.clfd[field];
+      t->offset = clarion_field_offset(cl, field);
+
+      if (cl->colread != NULL)
+	cl->colread[field] = 1;
+
+      for (p += len; isspace((unsigned char)*p); p++)
+	;
+
+      for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+	{
+	  if (strncmp(p, ops[i].s, strlen(ops[i].s)) == 0)
+	    break;
+	}
+
+      if (i == sizeof(ops) / sizeof(ops[0]))
+	goto syntax;
+
+      t->op = ops[i].op;
+
+      for (p += strlen(ops[i].s); isspace((unsigned char)*p); p++)
+	;
+
+      lit = clarion_parse_literal(cl, &p);
+
+      if (lit == NULL)
+	goto syntax;
+
+      if (clarion_value_parse(t->clfd, lit, &t->val) < 0)
+	{
+	  fprintf(stderr, "Not a number in --where: %s\n", lit);
+	  return -1;
+	}
+
+      nterms++;
+
+      while (isspace((unsigned char)*p))
+	p++;
+
+      if (*p == '\0')
+	break;
+
+      if ((strncasecmp(p, "AND", 3) != 0) || !isspace((unsigned char)p[3]))
+	goto syntax;
+
+      p += 3;
+    }
+
+  cl->where = (ClarionWhere *) clarion_arena_alloc(&cl->arena, sizeof(ClarionWhere) + nterms * sizeof(ClarionWhereTerm));
+
+  if (cl->where == NULL)
+    return -1;
+
+  cl->where->nterms = nterms;
+  memcpy(cl->where->term, term, nterms * sizeof(ClarionWhereTerm));
+
+  return 0;
+
+ syntax:
+  fprintf(stderr, "Syntax error in --where at: %s\n", (*p != '\0') ? p : "end of expression");
+  return -1;
+}
+
+/* Adds field = v to the comparisons, v has to stay around */
+int
+clarion_where_equal (ClarionHandle *cl, int field, const ClarionValue *v)
+{
+  ClarionWhere *w;
+  int nterms = (cl->where != NULL) ? cl->where->nterms : 0;
+
+  w = (ClarionWhere *) clarion_arena_alloc(&cl->arena, sizeof(ClarionWhere) + (nterms + 1) * sizeof(ClarionWhereTerm));
+
+  if (w == NULL)
+    return -1;
+
+  if (nterms > 0)
+    memcpy(w->term, cl->where->term, nterms * sizeof(ClarionWhereTerm));
+
+  w->term[nterms].clfd = &cl->clm.clfd[field];
+  w->term[nterms].offset = clarion_field_offset(cl, field);
+  w->term[nterms].op = CL_OP_EQ;
+  w->term[nterms].val = *v;
+  w->nterms = nterms + 1;
+
+  if (cl->colread != NULL)
+    cl->colread[field] = 1;
+
+  cl->where = w;
+
+  return 0;
+}
+
+/* Whether the record data matches all of the comparisons */
+int
+clarion_where_match (ClarionWhere *w, const uint8_t *data)
+{
+  ClarionWhereTerm *t;
+  ClarionValue v;
+  int ret;
+  int i;
+
+  for (i = 0; i < w->nterms; i++)
+    {
+      t = &w->term[i];
+
+      clarion_field_value(t->clfd, data + t->offset, &v);
+
+      if (v.type == CL_VALUE_NULL)
+	return 0;
+
+      ret = clarion_value_cmp(&v, &t->val);
+
+      switch (t->op)
+	{
+	  case CL_OP_EQ:
+	    ret = (ret == 0);
+	    break;
+	  case CL_OP_NE:
+	    ret = (ret != 0);
+	    break;
+	  case CL_OP_LT:
+	    ret = (ret < 0);
+	    break;
+	  case CL_OP_LE:
+	    ret = (ret <= 0);
+	    break;
+	  case CL_OP_GT:
+	    ret = (ret > 0);
+	    break;
+	  default:
+	    ret = (ret >= 0);
+	    break;
+	}
+
+      if (!ret)
+	return 0;
+    }
+
+  return 1;
+}
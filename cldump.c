@@ -22,14 +22,47 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <endian.h>
 #include <byteswap.h>
 #include <errno.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "cldump.h"
 
+/* Long options without a short equivalent */
+#define CL_LOPT_CRLF             256
+#define CL_LOPT_PIPELINE         257
+#define CL_LOPT_DECRYPT_TO       258
+#define CL_LOPT_STATS            259
+#define CL_LOPT_PROGRESS         260
+#define CL_LOPT_TRACE            261
+#define CL_LOPT_DELETED_ONLY     262
+#define CL_LOPT_STATUS           263
+#define CL_LOPT_PRESCAN          264
+#define CL_LOPT_RECORDS          265
+#define CL_LOPT_LIMIT            266
+#define CL_LOPT_OFFSET           267
+#define CL_LOPT_SAMPLE           268
+#define CL_LOPT_INVENTORY        269
+#define CL_LOPT_INVENTORY_JSON   270
+#define CL_LOPT_COLUMNS          271
+#define CL_LOPT_CACHE            272
+#define CL_LOPT_WHERE            273
+#define CL_LOPT_AGGREGATE        274
+#define CL_LOPT_SORT_BY          275
+#define CL_LOPT_MEM_LIMIT        276
+#define CL_LOPT_CHECK_KEYS       277
+#define CL_LOPT_BUILD_INDEX      278
+#define CL_LOPT_LOOKUP           279
+#define CL_LOPT_BLOOM_BUILD      280
+#define CL_LOPT_BLOOM_QUERY      281
+
+/* Default --mem-limit */
+#define CL_SORT_MEMLIMIT         (256 * 1024 * 1024)
+
 
 int
 clarion_open_memo (ClarionHandle *cl)
@@ -88,55 +121,184 @@ clarion_open_memo (ClarionHandle *cl)
 void
 clarion_free_handle (ClarionHandle *cl)
 {
-  int i, j;
-  ClarionPicDesc *clp = cl->clm.clp;
-  ClarionKeyDesc *clk = cl->clm.clk;
-  ClarionFieldDesc *clfd = cl->clm.clfd;
+  /* All of the metadata lives in the arena */
+  clarion_arena_free(&cl->arena);
+  cl->clm.clh = NULL;
+
+  clarion_cache_close(cl);
+  clarion_index_close(cl);
+
+  free(cl->meta);
+  free(cl->sel);
+  free(cl->colsel);
+  free(cl->colread);
+
+  free(cl->datfile);
+
+  if (cl->memfile != NULL)
+    free(cl->memfile);
+
+  if (cl->charset != NULL)
+    free(cl->charset);
+}
+
+
+/* Parses a comma-separated list of record flags into a CL_RECORD_* mask */
+static int
+cl_parse_status (const char *list, uint8_t *mask)
+{
+  static const struct {
+    const char *name;
+    uint8_t flag;
+  } flags[] = {
+    { "new", CL_RECORD_NEW },
+    { "old", CL_RECORD_OLD },
+    { "revised", CL_RECORD_REVISED },
+    { "deleted", CL_RECORD_DELETED },
+    { "held", CL_RECORD_HELD }
+  };
+  const char *p = list;
+  size_t len;
+  unsigned int i;
+
+  *mask = 0;
 
-  for (i = 0; i < cl->clm.clh->numbkeys; i++)
+  while (*p != '\0')
     {
-      for (j = 0; j < clk[i].numcomps; j++)
+      len = strcspn(p, ",");
+
+      for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
 	{
-	  if (clk[i].keypart[j].subpart != NULL)
-	    free(clk[i].keypart[j].subpart);
+	  if ((strlen(flags[i].name) == len) && (strncasecmp(p, flags[i].name, len) == 0))
+	    break;
 	}
 
-      free(clk[i].keypart);
+      if (i == sizeof(flags) / sizeof(flags[0]))
+	return -1;
+
+      *mask |= flags[i].flag;
+
+      p += len;
+      if (*p == ',')
+	p++;
     }
-  free(clk);
 
-  if (cl->clm.clh->numpics > 0)
+  return (*mask != 0) ? 0 : -1;
+}
+
+/* Parses a record count, digits only */
+static int
+cl_parse_count (const char *arg, uint64_t *val)
+{
+  char *end;
+
+  if ((*arg < '0') || (*arg > '9'))
+    return -1;
+
+  errno = 0;
+  *val = strtoull(arg, &end, 10);
+
+  return ((errno == 0) && (*end == '\0')) ? 0 : -1;
+}
+
+/* Parses a size in bytes, with an optional K, M or G suffix */
+static int
+cl_parse_size (const char *arg, uint64_t *val)
+{
+  char *end;
+
+  if ((*arg < '0') || (*arg > '9'))
+    return -1;
+
+  errno = 0;
+  *val = strtoull(arg, &end, 10);
+
+  if (errno != 0)
+    return -1;
+
+  switch (*end)
     {
-      for (i = 0; i < cl->clm.clh->numpics; i++)
-	{
-	  if (clp[i].picstr)
-	    free(clp[i].picstr);
-	}
-      free(clp);
+      case 'g':
+      case 'G':
+	*val <<= 10;
+	/* fall through */
+      case 'm':
+      case 'M':
+	*val <<= 10;
+	/* fall through */
+      case 'k':
+      case 'K':
+	*val <<= 10;
+	end++;
+	break;
+      default:
+	break;
     }
 
-  for (i = 0; i < cl->clm.clh->numflds; i++)
+  return (*end == '\0') ? 0 : -1;
+}
+
+/* The directory given to an option followed by the operands, NULL-terminated */
+static char **
+cl_path_list (char *dir, char **operands, int count)
+{
+  char **paths;
+
+  paths = (char **) malloc((count + 2) * sizeof(char *));
+
+  if (paths == NULL)
     {
-      if (clfd[i].arr != NULL)
-	{
-	  for (j = 0; j < clfd[i].nbarrs; j++)
-	    {
-	      free(clfd[i].arr[j].part);
-	    }
-	  free(clfd[i].arr);
-	}
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
     }
-  free(clfd);
 
-  free(cl->clm.clh);
+  paths[0] = dir;
+  memcpy(paths + 1, operands, count * sizeof(char *));
+  paths[count + 1] = NULL;
 
-  free(cl->datfile);
+  return paths;
+}
 
-  if (cl->memfile != NULL)
-    free(cl->memfile);
+/*
+ * Parses a 1-based, inclusive record range (A-B, A-, -B or A) into the
+ * [first, end) record indexes, end being 0 up to the last record.
+ */
+static int
+cl_parse_range (const char *arg, uint32_t *first, uint32_t *end)
+{
+  const char *dash = strchr(arg, '-');
+  char buf[24];
+  uint64_t a = 1;
+  uint64_t b = 0;
 
-  if (cl->charset != NULL)
-    free(cl->charset);
+  if ((dash == NULL) && (cl_parse_count(arg, &a) < 0))
+    return -1;
+  if (dash == NULL)
+    b = a;
+
+  if ((dash != NULL) && (dash > arg))
+    {
+      if ((size_t)(dash - arg) >= sizeof(buf))
+	return -1;
+
+      memcpy(buf, arg, dash - arg);
+      buf[dash - arg] = '\0';
+
+      if (cl_parse_count(buf, &a) < 0)
+	return -1;
+    }
+
+  if ((dash != NULL) && (dash[1] != '\0')
+      && ((cl_parse_count(dash + 1, &b) < 0) || (b == 0)))
+    return -1;
+
+  if ((a == 0) || (a > UINT32_MAX) || (b > UINT32_MAX) || ((b != 0) && (b < a)))
+    return -1;
+
+  *first = a - 1;
+  *end = b;
+
+  return 0;
 }
 
 
@@ -149,16 +311,46 @@ cl_usage(void)
   fprintf(stdout, "Options:\n");
   fprintf(stdout, "   -d/--dump-active        Dump active entries only\n");
   fprintf(stdout, "*  -D/--dump-data          Dump the actual data (active+deleted)\n");
+  fprintf(stdout, "     --deleted-only        Dump deleted entries only, following the deleted entry chain\n");
+  fprintf(stdout, "     --status LIST         Dump entries with any of these flags (new,old,revised,deleted,held)\n");
+  fprintf(stdout, "     --prescan             Select the entries to dump before reading them\n");
+  fprintf(stdout, "     --records A-B         Dump entries A to B only (1-based, A- and -B accepted)\n");
+  fprintf(stdout, "     --offset N            Skip the first N entries to dump\n");
+  fprintf(stdout, "     --limit N             Stop after N entries\n");
+  fprintf(stdout, "     --sample N            Dump N entries spread evenly over the file\n");
+  fprintf(stdout, "     --where EXPR          Dump entries matching EXPR only (FIELD op VALUE [AND ...])\n");
+  fprintf(stdout, "     --aggregate SPEC      COUNT/SUM/MIN/MAX(FIELD), ... [GROUP BY FIELD, ...] in CSV\n");
+  fprintf(stdout, "     --sort-by LIST        Dump entries sorted by FIELD [DESC] [UPPER], ...\n");
+  fprintf(stdout, "     --mem-limit SIZE      Memory for --sort-by, spilling to $TMPDIR past it (default: 256M)\n");
+  fprintf(stdout, "     --check-keys          Report duplicates in the unique keys of the entries dumped\n");
+  fprintf(stdout, "     --build-index COL     Write a hash index of COL next to the data file\n");
+  fprintf(stdout, "     --lookup COL=VALUE    Dump entries where COL is VALUE, through the index of COL\n");
   fprintf(stdout, "*  -m/--dump-meta          Dump meta information\n");
   fprintf(stdout, "   -f/--field-separator    Field separator for CSV output (1 character, defaults to ';')\n");
   fprintf(stdout, "   -c/--csv                Dump data or schema in CSV format\n");
+  fprintf(stdout, "   -H/--header             Start CSV data with a header row\n");
+  fprintf(stdout, "     --crlf                End CSV rows with CRLF instead of LF\n");
   fprintf(stdout, "   -S/--sql                Dump data or schema in SQL format\n");
   fprintf(stdout, "*  -s/--schema             Dump database schema\n");
-  fprintf(stdout, "   -M/--mysql              Use MySQL specific options (backticks, ...)\n");
+  fprintf(stdout, "   -M/--mysql              Use MySQL specific options (backticks, backslash escapes, ...)\n");
   fprintf(stdout, "   -n/--no-memo            Do not dump memo entries\n");
+  fprintf(stdout, "     --columns LIST        Dump these fields only (comma-separated, MEMO for the memo)\n");
+  fprintf(stdout, "     --cache DIR           Read the records from a columnar cache kept in DIR\n");
   fprintf(stdout, "   -U[charset]            Convert strings from charset to UTF-8\n");
   fprintf(stdout, "     --utf8[=charset]        Default charset: iso8859-1\n");
-  fprintf(stdout, "   -x/--decrypt            Decrypt database, key location 1-4\n");
+  fprintf(stdout, "   -x/--decrypt            Decrypt database, key location 1-4 or auto\n");
+  fprintf(stdout, "   -X/--decrypt-read       Dump an encrypted database as is, key location 1-4 or auto\n");
+  fprintf(stdout, "     --decrypt-to DIR      Write decrypted copies to DIR, originals are left alone\n");
+  fprintf(stdout, "     --inventory DIR       List the tables in DIR from their headers, in CSV\n");
+  fprintf(stdout, "     --inventory-json DIR  Same, in JSON\n");
+  fprintf(stdout, "     --bloom-build DIR     Write Bloom filters of the --columns of the tables in DIR to DIR/CATALOG.BLM\n");
+  fprintf(stdout, "     --bloom-query VALUE   List the tables and fields of a catalog that may hold VALUE, in CSV\n");
+  fprintf(stdout, "   -j/--jobs               Number of threads for decryption, inventory, aggregation,\n");
+  fprintf(stdout, "                           indexing and Bloom filters (defaults to the CPU count)\n");
+  fprintf(stdout, "     --pipeline            Overlap reading, decoding and writing in threads\n");
+  fprintf(stdout, "     --stats[=FILE]        Print run statistics to stderr, or to FILE in JSON\n");
+  fprintf(stdout, "     --progress[=SECONDS]  Report progress on stderr every SECONDS (default: 1)\n");
+  fprintf(stdout, "     --trace FILE          Write a timeline of the run to FILE (Chrome trace format)\n");
   fprintf(stdout, "\n");
   fprintf(stdout, "By default, cldump uses a human-friendly format to dump the database.\n");
   fprintf(stdout, "Options marked with a * are the default.\n");
@@ -179,6 +371,27 @@ int
 main (int argc, char **argv)
 {
   ClarionHandle cl;
+  char *decrypt_to = NULL;
+  char *inventory = NULL;
+  char **paths;
+  char *columns = NULL;
+  char *cachedir = NULL;
+  char *where = NULL;
+  char *aggspec = NULL;
+  char *sortby = NULL;
+  uint64_t memlimit = CL_SORT_MEMLIMIT;
+  ClarionAggregate *agg = NULL;
+  int check_keys = 0;
+  char *buildindex = NULL;
+  char *lookup = NULL;
+  char *bloombuild = NULL;
+  char *bloomquery = NULL;
+  int inventory_json = 0;
+  char *statsfile = NULL;
+  char *tracefile = NULL;
+  uint64_t t0;
+  uint64_t val;
+  uint64_t dups;
   int cloptind;
   int clopt;
   int ret;
@@ -186,15 +399,44 @@ main (int argc, char **argv)
   static struct option clargs[] = {
     {"dump-active", 0, NULL, 'd'},
     {"dump-data", 0, NULL, 'D'},
+    {"deleted-only", 0, NULL, CL_LOPT_DELETED_ONLY},
+    {"status", 1, NULL, CL_LOPT_STATUS},
+    {"prescan", 0, NULL, CL_LOPT_PRESCAN},
+    {"records", 1, NULL, CL_LOPT_RECORDS},
+    {"offset", 1, NULL, CL_LOPT_OFFSET},
+    {"limit", 1, NULL, CL_LOPT_LIMIT},
+    {"sample", 1, NULL, CL_LOPT_SAMPLE},
+    {"where", 1, NULL, CL_LOPT_WHERE},
+    {"aggregate", 1, NULL, CL_LOPT_AGGREGATE},
+    {"sort-by", 1, NULL, CL_LOPT_SORT_BY},
+    {"mem-limit", 1, NULL, CL_LOPT_MEM_LIMIT},
+    {"check-keys", 0, NULL, CL_LOPT_CHECK_KEYS},
+    {"build-index", 1, NULL, CL_LOPT_BUILD_INDEX},
+    {"lookup", 1, NULL, CL_LOPT_LOOKUP},
     {"dump-meta", 0, NULL, 'm'},
     {"field-separator", 1, NULL, 'f'},
     {"csv", 0, NULL, 'c'},
+    {"header", 0, NULL, 'H'},
+    {"crlf", 0, NULL, CL_LOPT_CRLF},
+    {"pipeline", 0, NULL, CL_LOPT_PIPELINE},
     {"sql", 0, NULL, 'S'},
     {"schema", 0, NULL, 's'},
     {"mysql", 0, NULL, 'M'},
     {"no-memo", 0, NULL, 'n'},
+    {"columns", 1, NULL, CL_LOPT_COLUMNS},
+    {"cache", 1, NULL, CL_LOPT_CACHE},
     {"utf8", 2, NULL, 'U'},
     {"decrypt", 1, NULL, 'x'},
+    {"decrypt-read", 1, NULL, 'X'},
+    {"decrypt-to", 1, NULL, CL_LOPT_DECRYPT_TO},
+    {"inventory", 1, NULL, CL_LOPT_INVENTORY},
+    {"inventory-json", 1, NULL, CL_LOPT_INVENTORY_JSON},
+    {"bloom-build", 1, NULL, CL_LOPT_BLOOM_BUILD},
+    {"bloom-query", 1, NULL, CL_LOPT_BLOOM_QUERY},
+    {"jobs", 1, NULL, 'j'},
+    {"stats", 2, NULL, CL_LOPT_STATS},
+    {"progress", 2, NULL, CL_LOPT_PROGRESS},
+    {"trace", 1, NULL, CL_LOPT_TRACE},
     {"help", 0, NULL, 'h'},
     {"version", 0, NULL, 'v'},
     {NULL, 0, NULL, 0}
@@ -207,7 +449,7 @@ main (int argc, char **argv)
   cl.sql_quote_begin = '"';
   cl.sql_quote_end = '"';
 
-  while ((clopt = getopt_long(argc, argv, "dDmf:cSsMnU::x:hv", clargs, &cloptind)) != -1)
+  while ((clopt = getopt_long(argc, argv, "dDmf:cHSsMnU::x:X:j:hv", clargs, &cloptind)) != -1)
     {
       switch (clopt)
 	{
@@ -238,6 +480,15 @@ main (int argc, char **argv)
 
 	    cl.opts |= CL_OPT_CSV_OUTPUT;
 	    break;
+	  case 'H':
+	    cl.opts |= CL_OPT_CSV_HEADER;
+	    break;
+	  case CL_LOPT_CRLF:
+	    cl.opts |= CL_OPT_CSV_CRLF;
+	    break;
+	  case CL_LOPT_PIPELINE:
+	    cl.opts |= CL_OPT_PIPELINE;
+	    break;
 	  case 'S':
 	    if (cl.opts & CL_OPT_CSV_OUTPUT)
 	      {
@@ -251,12 +502,44 @@ main (int argc, char **argv)
 	    cl.opts |= CL_OPT_SCHEMA;
 	    break;
 	  case 'M':
+	    cl.opts |= CL_OPT_MYSQL;
 	    cl.sql_quote_end = '`';
 	    cl.sql_quote_begin = '`';
 	    break;
 	  case 'n':
 	    cl.opts |= CL_OPT_NO_MEMO;
 	    break;
+	  case CL_LOPT_COLUMNS:
+	    columns = optarg;
+	    break;
+	  case CL_LOPT_CACHE:
+	    cachedir = optarg;
+	    break;
+	  case CL_LOPT_WHERE:
+	    where = optarg;
+	    break;
+	  case CL_LOPT_AGGREGATE:
+	    aggspec = optarg;
+	    break;
+	  case CL_LOPT_SORT_BY:
+	    sortby = optarg;
+	    break;
+	  case CL_LOPT_MEM_LIMIT:
+	    if ((cl_parse_size(optarg, &memlimit) < 0) || (memlimit == 0) || (memlimit > SIZE_MAX / 2))
+	      {
+		fprintf(stderr, "cldump: Error: invalid memory limit %s.\n", optarg);
+		exit(1);
+	      }
+	    break;
+	  case CL_LOPT_CHECK_KEYS:
+	    check_keys = 1;
+	    break;
+	  case CL_LOPT_BUILD_INDEX:
+	    buildindex = optarg;
+	    break;
+	  case CL_LOPT_LOOKUP:
+	    lookup = optarg;
+	    break;
 	  case 'U':
 	    cl.opts |= CL_OPT_UTF8;
 
@@ -266,15 +549,117 @@ main (int argc, char **argv)
 	      cl.charset = strdup("ISO8859-1");
 	    break;
 	  case 'x':
-	    cl.decmode = atoi(optarg);
+	  case 'X':
+	    if (cl.opts & (CL_OPT_DECRYPT | CL_OPT_DECRYPT_READ))
+	      {
+		fprintf(stderr, "cldump: Error: -x/--decrypt and -X/--decrypt-read are mutually exclusive.\n");
+		exit(1);
+	      }
+
+	    /* 0: find it out */
+	    if (strcmp(optarg, "auto") == 0)
+	      cl.decmode = 0;
+	    else
+	      {
+		cl.decmode = atoi(optarg);
+
+		if ((cl.decmode < 1) || (cl.decmode > 4))
+		  {
+		    fprintf(stderr, "cldump: Error: key location argument is 1-4 or auto.\n");
+		    exit(1);
+		  }
+	      }
+
+	    cl.opts |= (clopt == 'x') ? CL_OPT_DECRYPT : CL_OPT_DECRYPT_READ;
+	    break;
+	  case CL_LOPT_DECRYPT_TO:
+	    decrypt_to = optarg;
+	    break;
+	  case CL_LOPT_INVENTORY:
+	  case CL_LOPT_INVENTORY_JSON:
+	    inventory = optarg;
+	    inventory_json = (clopt == CL_LOPT_INVENTORY_JSON);
+	    break;
+	  case CL_LOPT_BLOOM_BUILD:
+	    bloombuild = optarg;
+	    break;
+	  case CL_LOPT_BLOOM_QUERY:
+	    bloomquery = optarg;
+	    break;
+	  case 'j':
+	    cl.jobs = atoi(optarg);
+
+	    if (cl.jobs < 1)
+	      {
+		fprintf(stderr, "cldump: Error: number of jobs must be at least 1.\n");
+		exit(1);
+	      }
+	    break;
+	  case CL_LOPT_STATS:
+	    cl.opts |= CL_OPT_STATS;
+	    statsfile = optarg;
+	    break;
+	  case CL_LOPT_DELETED_ONLY:
+	    cl.opts |= CL_OPT_DELETED_ONLY;
+	    break;
+	  case CL_LOPT_STATUS:
+	    if (cl_parse_status(optarg, &cl.status) < 0)
+	      {
+		fprintf(stderr, "cldump: Error: invalid record status list %s (new, old, revised, deleted, held).\n", optarg);
+		exit(1);
+	      }
+	    break;
+	  case CL_LOPT_PRESCAN:
+	    cl.opts |= CL_OPT_PRESCAN;
+	    break;
+	  case CL_LOPT_RECORDS:
+	    if (cl_parse_range(optarg, &cl.recfirst, &cl.recend) < 0)
+	      {
+		fprintf(stderr, "cldump: Error: invalid record range %s (A-B, A-, -B or A, from 1).\n", optarg);
+		exit(1);
+	      }
 
-	    if ((cl.decmode < 1) || (cl.decmode > 4))
+	    cl.opts |= CL_OPT_RECORD_RANGE;
+	    break;
+	  case CL_LOPT_OFFSET:
+	    if (cl_parse_count(optarg, &cl.skip) < 0)
+	      {
+		fprintf(stderr, "cldump: Error: invalid offset %s.\n", optarg);
+		exit(1);
+	      }
+
+	    cl.opts |= CL_OPT_RECORD_RANGE;
+	    break;
+	  case CL_LOPT_LIMIT:
+	    if ((cl_parse_count(optarg, &cl.limit) < 0) || (cl.limit == 0))
+	      {
+		fprintf(stderr, "cldump: Error: limit must be at least 1.\n");
+		exit(1);
+	      }
+
+	    cl.opts |= CL_OPT_RECORD_RANGE;
+	    break;
+	  case CL_LOPT_SAMPLE:
+	    if ((cl_parse_count(optarg, &val) < 0) || (val == 0) || (val > UINT32_MAX))
 	      {
-		fprintf(stderr, "cldump: Error: key location argument is 1-4.\n");
+		fprintf(stderr, "cldump: Error: sample size must be at least 1.\n");
 		exit(1);
 	      }
 
-	    cl.opts |= CL_OPT_DECRYPT;
+	    cl.sample = val;
+	    cl.opts |= CL_OPT_RECORD_RANGE;
+	    break;
+	  case CL_LOPT_TRACE:
+	    tracefile = optarg;
+	    break;
+	  case CL_LOPT_PROGRESS:
+	    cl.progress = (optarg != NULL) ? atoi(optarg) : 1;
+
+	    if (cl.progress < 1)
+	      {
+		fprintf(stderr, "cldump: Error: progress interval must be at least 1 second.\n");
+		exit(1);
+	      }
 	    break;
 	  case 'h':
 	    cl_version();
@@ -301,21 +686,104 @@ main (int argc, char **argv)
 	}
     }
 
-  /* No options specified on the command line */
-  if (cl.opts == 0)
-    cl.opts = CL_OPT_DEFAULT;
+  if (cl.jobs == 0)
+    {
+      cl.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+      if (cl.jobs < 1)
+	cl.jobs = 1;
+    }
+
+  /* -H and --crlf shape CSV output, they imply -c */
+  if ((cl.opts & (CL_OPT_CSV_HEADER | CL_OPT_CSV_CRLF)) && !(cl.opts & CL_OPT_CSV_OUTPUT))
+    {
+      if (cl.opts & CL_OPT_SQL_OUTPUT)
+	{
+	  fprintf(stderr, "cldump: Error: -H/--header and --crlf only apply to CSV output.\n");
+	  exit(1);
+	}
+
+      cl.opts |= CL_OPT_CSV_OUTPUT;
+    }
+
+  /* No options specified on the command line (-M, --pipeline, -X, --stats, --prescan and --cache don't count) */
+  if (((cl.opts & ~(CL_OPT_MYSQL | CL_OPT_PIPELINE | CL_OPT_DECRYPT_READ | CL_OPT_STATS | CL_OPT_PRESCAN)) == 0)
+      && (cl.status == 0) && (columns == NULL) && (where == NULL) && (aggspec == NULL) && (sortby == NULL)
+      && !check_keys && (buildindex == NULL) && (lookup == NULL))
+    cl.opts |= CL_OPT_DEFAULT;
 
   /* Force data dump if only output modifiers have been specified */
   if (!(cl.opts & CL_OPT_DUMP_ACTIVE) && !(cl.opts & CL_OPT_DUMP_DATA))
     {
       if ((cl.opts & CL_OPT_NO_MEMO) || (cl.opts & CL_OPT_CSV_OUTPUT) ||
-	  (cl.opts & CL_OPT_SQL_OUTPUT))
+	  (cl.opts & CL_OPT_SQL_OUTPUT) || (cl.opts & CL_OPT_CSV_HEADER) ||
+	  (cl.opts & CL_OPT_CSV_CRLF) || (columns != NULL))
 	{
 	  if (!(cl.opts & CL_OPT_DUMP_META) && !(cl.opts & CL_OPT_SCHEMA))
 	    cl.opts |= CL_OPT_DUMP_DATA;
 	}
     }
 
+  /* --status, record ranges, --where, --lookup, --aggregate, --sort-by and --deleted-only are data dumps of their own */
+  if ((cl.status != 0) || (cl.opts & CL_OPT_RECORD_RANGE) || (where != NULL) || (lookup != NULL)
+      || (aggspec != NULL) || (sortby != NULL))
+    cl.opts |= CL_OPT_DUMP_DATA;
+
+  if ((lookup != NULL) && (cl.sample != 0))
+    {
+      fprintf(stderr, "cldump: Error: --lookup and --sample are mutually exclusive.\n");
+      exit(1);
+    }
+
+  if ((aggspec != NULL) && (sortby != NULL))
+    {
+      fprintf(stderr, "cldump: Error: --sort-by and --aggregate are mutually exclusive.\n");
+      exit(1);
+    }
+
+  if ((aggspec != NULL) && (columns != NULL))
+    {
+      fprintf(stderr, "cldump: Error: --columns and --aggregate are mutually exclusive.\n");
+      exit(1);
+    }
+
+  if (cl.opts & CL_OPT_DELETED_ONLY)
+    {
+      if (cl.opts & CL_OPT_DUMP_ACTIVE)
+	{
+	  fprintf(stderr, "cldump: Error: -d and --deleted-only are mutually exclusive.\n");
+	  exit(1);
+	}
+
+      cl.opts |= CL_OPT_DUMP_DATA;
+    }
+
+  /* Header-only listing of DIR and of any other files or directories given */
+  if (inventory != NULL)
+    {
+      paths = cl_path_list(inventory, argv + optind, argc - optind);
+
+      ret = clarion_inventory(&cl, paths, argc - optind + 1, inventory_json);
+
+      free(paths);
+      free(cl.charset);
+
+      exit((ret == 0) ? 0 : 1);
+    }
+
+  /* Bloom filters of the tables in DIR and in any other files or directories given */
+  if (bloombuild != NULL)
+    {
+      paths = cl_path_list(bloombuild, argv + optind, argc - optind);
+
+      ret = clarion_bloom_build(&cl, paths, argc - optind + 1, columns);
+
+      free(paths);
+      free(cl.charset);
+
+      exit((ret == 0) ? 0 : 1);
+    }
+
   if (optind >= argc)
     {
       cl_version();
@@ -324,6 +792,38 @@ main (int argc, char **argv)
       exit(3);
     }
 
+  /* Candidate tables from a catalog, like grep: 1 if there are none */
+  if (bloomquery != NULL)
+    {
+      ret = clarion_bloom_query(&cl, argv[optind], bloomquery);
+
+      free(cl.charset);
+
+      exit((ret > 0) ? 0 : (ret == 0) ? 1 : 2);
+    }
+
+  /* Out-of-place decryption, -x or its default of auto only picks the key location */
+  if (decrypt_to != NULL)
+    {
+      if (cl.opts & CL_OPT_DECRYPT_READ)
+	{
+	  fprintf(stderr, "cldump: Error: --decrypt-to uses -x, not -X.\n");
+	  exit(1);
+	}
+
+      ret = clarion_decrypt_to(&cl, argv + optind, argc - optind, decrypt_to);
+
+      free(cl.charset);
+
+      exit((ret == 0) ? 0 : 1);
+    }
+
+  if ((cl.opts & CL_OPT_STATS) || (cl.progress > 0))
+    clarion_stats_start(cl.opts & CL_OPT_STATS);
+
+  if (tracefile != NULL)
+    clarion_trace_start();
+
   cl.data = fopen(argv[optind], "rb");
 
   if (cl.data == NULL)
@@ -334,6 +834,8 @@ main (int argc, char **argv)
 
   cl.datfile = strdup(argv[optind]);
 
+  t0 = CL_TRACE_BEGIN();
+
   ret = clarion_read_header(&cl);
 
   if (ret != 0)
@@ -343,6 +845,22 @@ main (int argc, char **argv)
       exit(2);
     }
 
+  if ((cl.clm.clh->sfatr & CL_RECORDS_ENCRYPTED)
+      && (cl.opts & (CL_OPT_DECRYPT | CL_OPT_DECRYPT_READ)) && (cl.decmode == 0))
+    {
+      ret = clarion_find_key(&cl);
+
+      if (ret < 0)
+	{
+	  fclose(cl.data);
+	  fprintf(stderr, "Couldn't find out the key location, use -x/-X 1-4\n");
+	  exit(1);
+	}
+
+      fprintf(stderr, "Using key location %d\n", ret);
+      cl.decmode = ret;
+    }
+
   if (cl.clm.clh->sfatr & CL_RECORDS_ENCRYPTED)
     {
       if (cl.opts & CL_OPT_DECRYPT)
@@ -352,26 +870,55 @@ main (int argc, char **argv)
 	  /* NOT REACHED */
 	  exit(42);
 	}
+      else if (cl.opts & CL_OPT_DECRYPT_READ)
+	{
+	  /* Descriptors are decrypted in memory */
+	  if (clarion_decrypt_meta_load(&cl) != 0)
+	    {
+	      fclose(cl.data);
+	      fprintf(stderr, "Couldn't decrypt descriptors !\n");
+	      exit(2);
+	    }
+	}
       else
 	{
-	  fprintf(stderr, "Database is encrypted, make backups and re-run with -x\n");
+	  fprintf(stderr, "Database is encrypted, re-run with -X, or make backups and re-run with -x\n");
 	  exit(1);
 	}
     }
+  else if (cl.opts & CL_OPT_DECRYPT_READ)
+    {
+      fprintf(stderr, "Database is not encrypted, ignoring -X\n");
+      cl.opts &= ~CL_OPT_DECRYPT_READ;
+    }
   else if (cl.opts & CL_OPT_DECRYPT)
     {
       fprintf(stderr, "Database is not encrypted; re-run without -x\n");
       exit(0);
     }
 
+  /* All the descriptors in one read, unless decrypted already */
+  if (cl.metalen < cl.clm.clh->offset)
+    {
+      ret = clarion_load_meta(&cl, cl.clm.clh->offset);
+
+      if (ret != 0)
+	{
+	  fclose(cl.data);
+	  clarion_free_handle(&cl);
+	  fprintf(stderr, "Couldn't read descriptors !\n");
+	  exit(2);
+	}
+    }
+
   if (!(cl.opts & CL_OPT_NO_MEMO))
     {
       ret = clarion_open_memo(&cl);
 
       if (ret != 0)
 	{
-	  free(cl.clm.clh);
 	  fclose(cl.data);
+	  clarion_free_handle(&cl);
 	  fprintf(stderr, "Couldn't open memo file !\n");
 	  exit(3);
 	}
@@ -381,10 +928,10 @@ main (int argc, char **argv)
 
   if (ret != 0)
     {
-      free(cl.clm.clh);
       fclose(cl.data);
       if (cl.memo != NULL)
 	fclose(cl.memo);
+      clarion_free_handle(&cl);
       fprintf(stderr, "Couldn't read field descriptors !\n");
       exit(4);
     }
@@ -393,11 +940,10 @@ main (int argc, char **argv)
 
   if (ret != 0)
     {
-      free(cl.clm.clh);
-      free(cl.clm.clfd);
       fclose(cl.data);
       if (cl.memo != NULL)
 	fclose(cl.memo);
+      clarion_free_handle(&cl);
       fprintf(stderr, "Couldn't read key descriptors !\n");
       exit(5);
     }
@@ -415,6 +961,42 @@ main (int argc, char **argv)
 
   clarion_read_arr_desc(&cl);
 
+  if (((columns != NULL) && (clarion_select_columns(&cl, columns) < 0))
+      || ((aggspec != NULL) && ((agg = clarion_aggregate_parse(&cl, aggspec)) == NULL))
+      || ((where != NULL) && (clarion_where_parse(&cl, where) < 0))
+      || ((lookup != NULL) && (clarion_index_open(&cl, lookup) < 0))
+      || ((sortby != NULL) && (clarion_sort_parse(&cl, sortby, memlimit) < 0))
+      || (check_keys && (clarion_check_init(&cl) < 0)))
+    {
+      fclose(cl.data);
+      if (cl.memo != NULL)
+	fclose(cl.memo);
+      clarion_free_handle(&cl);
+      exit(1);
+    }
+
+  free(cl.meta);
+  cl.meta = NULL;
+  cl.metalen = 0;
+
+  CL_TRACE_END("meta", "phase", t0, NULL, 0);
+
+  if ((cachedir != NULL) && ((cl.opts & (CL_OPT_DUMP_DATA | CL_OPT_DUMP_ACTIVE)) || check_keys || (buildindex != NULL)))
+    clarion_cache_open(&cl, cachedir);
+
+  if (buildindex != NULL)
+    {
+      ret = clarion_index_build(&cl, buildindex);
+
+      fclose(cl.data);
+      if (cl.memo != NULL)
+	fclose(cl.memo);
+      clarion_free_handle(&cl);
+      exit((ret == 0) ? 0 : 1);
+    }
+
+  t0 = CL_TRACE_BEGIN();
+
   if (cl.opts & CL_OPT_DUMP_META)
     {
       clarion_dump_meta(&cl);
@@ -430,15 +1012,30 @@ main (int argc, char **argv)
 	clarion_dump_schema(&cl);
     }
 
-  if ((cl.opts & CL_OPT_DUMP_DATA) || (cl.opts & CL_OPT_DUMP_ACTIVE))
+  if (cl.opts & (CL_OPT_DUMP_META | CL_OPT_SCHEMA))
+    CL_TRACE_END("schema", "phase", t0, NULL, 0);
+
+  if (agg != NULL)
+    clarion_aggregate_dump(&cl, agg);
+  else if ((cl.opts & CL_OPT_DUMP_DATA) || (cl.opts & CL_OPT_DUMP_ACTIVE))
     {
       if (cl.opts & CL_OPT_CSV_OUTPUT)
-	clarion_dump_data_csv(&cl);
+	{
+	  /* The CSV schema is the header row, don't print it twice */
+	  if ((cl.opts & CL_OPT_CSV_HEADER) && !(cl.opts & CL_OPT_SCHEMA))
+	    clarion_dump_schema_csv(&cl);
+
+	  clarion_dump_data_csv(&cl);
+	}
       else if (cl.opts & CL_OPT_SQL_OUTPUT)
       	clarion_dump_data_sql(&cl);
       else
 	clarion_dump_data(&cl);
     }
+  else if (cl.check != NULL)
+    clarion_check_scan(&cl);
+
+  dups = clarion_check_report(&cl);
 
   fclose(cl.data);
 
@@ -447,5 +1044,13 @@ main (int argc, char **argv)
 
   clarion_free_handle(&cl);
 
-  return 0;
+  ret = (dups > 0) ? 1 : 0;
+
+  if ((cl.opts & CL_OPT_STATS) && (clarion_stats_print(statsfile) < 0))
+    ret = 1;
+
+  if ((tracefile != NULL) && (clarion_trace_write(tracefile) < 0))
+    ret = 1;
+
+  return ret;
 }
@@ -76,6 +76,15 @@
 #define CL_OPT_NO_MEMO           (1 << 6) /* do not output memo entries */
 #define CL_OPT_UTF8              (1 << 7) /* convert strings to UTF-8 */
 #define CL_OPT_DECRYPT           (1 << 8)
+#define CL_OPT_MYSQL             (1 << 9) /* MySQL quoting and escaping rules */
+#define CL_OPT_CSV_HEADER        (1 << 10) /* header row before CSV data */
+#define CL_OPT_CSV_CRLF          (1 << 11) /* end CSV rows with \r\n */
+#define CL_OPT_PIPELINE          (1 << 12) /* threaded read/decode/write pipeline */
+#define CL_OPT_DECRYPT_READ      (1 << 13) /* decrypt on the fly, read-only */
+#define CL_OPT_STATS             (1 << 14) /* report counters on exit */
+#define CL_OPT_DELETED_ONLY      (1 << 15) /* dump deleted records only, from the freerec chain */
+#define CL_OPT_PRESCAN           (1 << 16) /* select records from their rhd before dumping */
+#define CL_OPT_RECORD_RANGE      (1 << 17) /* dump a range, a slice or a sample of the records */
 #define CL_OPT_DEFAULT           (CL_OPT_DUMP_DATA | CL_OPT_DUMP_META | CL_OPT_SCHEMA) /* default: dump everything */
 
 /* Encryption key location */
@@ -166,9 +175,96 @@ typedef struct {
   ClarionKeyDesc *clk;
 } ClarionMeta;
 
+/* Run phases, statistics and instrumentation counters, see cl_stats.c */
+#define CL_PHASE_META            0
+#define CL_PHASE_DATA            1
+#define CL_PHASE_MEMO            2
+#define CL_PHASE_ICONV           3
+#define CL_PHASE_OUTPUT          4
+#define CL_PHASE_MAX             5
+
+#define CL_CNT_ALLOCS            0
+#define CL_CNT_ALLOC_BYTES       1
+#define CL_CNT_READS             2
+#define CL_CNT_WRITES            3
+#define CL_CNT_SEEKS             4
+#define CL_CNT_ICONV             5
+#define CL_CNT_MAX               6
+
+/* One cache line per phase, phases are mostly counted from different threads */
 typedef struct {
-  unsigned short opts;
+  uint64_t cnt[CL_CNT_MAX];
+} __attribute__ ((aligned (64))) ClarionCounters;
+
+/* Initial hash for clarion_fnv() */
+#define CL_FNV_OFFSET            0xcbf29ce484222325ULL
+
+/* Memo chain length buckets: 1, 2, 3-4, 5-8, ..., 33-64, 65+ blocks */
+#define CL_MEMO_HIST             8
+
+/* Per-thread run statistics, merged when the thread is done */
+typedef struct {
+  uint64_t wall[CL_PHASE_MAX]; /* ns */
+  uint64_t cpu[CL_PHASE_MAX]; /* ns */
+  uint64_t scanned; /* records read */
+  uint64_t emitted; /* records handed to the output format */
+  uint64_t skipped; /* deleted records skipped */
+  uint64_t datbytes;
+  uint64_t membytes;
+  uint64_t outbytes;
+  uint64_t memohist[CL_MEMO_HIST];
+  uint64_t last_wall; /* phase clock, 0 until the first phase switch */
+  uint64_t last_cpu;
+} ClarionStats;
+
+/* Bump allocator, see cl_arena.c */
+typedef struct cl_arena_chunk {
+  struct cl_arena_chunk *next;
+  size_t size;
+  size_t used;
+  uint8_t data[] __attribute__ ((aligned (16)));
+} ClarionArenaChunk;
+
+typedef struct {
+  ClarionArenaChunk *head; /* chunk being filled */
+} ClarionArena;
+
+/* Columnar cache of a table, see cl_cache.c */
+typedef struct ClarionCache ClarionCache;
+
+/* Record filter and aggregation, see cl_where.c and cl_aggregate.c */
+typedef struct ClarionWhere ClarionWhere;
+typedef struct ClarionAggregate ClarionAggregate;
+
+/* External sort, see cl_sort.c */
+typedef struct ClarionSort ClarionSort;
+
+/* Unique key check, see cl_check.c */
+typedef struct ClarionCheck ClarionCheck;
+
+/* Secondary hash index, see cl_index.c */
+typedef struct ClarionIndex ClarionIndex;
+
+/* Decoded field values and literals */
+#define CL_VALUE_NULL            0 /* uninitialized REAL */
+#define CL_VALUE_NUMBER          1 /* LONG, SHORT, BYTE, DECIMAL: num / 10^scale */
+#define CL_VALUE_REAL            2
+#define CL_VALUE_STRING          3 /* trailing spaces trimmed */
+
+typedef struct {
+  int type;
+  int scale;
+  __int128 num;
+  double real;
+  const uint8_t *str; /* not NUL-terminated */
+  int len;
+} ClarionValue;
+
+typedef struct {
+  unsigned int opts;
   unsigned char decmode;
+  uint8_t key[2]; /* decryption key, from the key location */
+  int jobs; /* worker threads */
   unsigned char fsep;
   unsigned char sql_quote_begin;
   unsigned char sql_quote_end;
@@ -178,11 +274,35 @@ typedef struct {
   char *memfile;
   FILE *memo;
   char *charset;
+  uint8_t *meta; /* [0, clh->offset) of the data file, while parsing it */
+  uint32_t metalen;
+  uint32_t metapos;
+  int keys_probed; /* key types read from the key files */
+  int progress; /* seconds between progress reports, 0 for none */
+  uint8_t status; /* --status rhd flags, 0 for any */
+  uint8_t rhdsel[256]; /* whether to dump a record, by rhd, see cl_select.c */
+  uint64_t *sel; /* records to dump, from --prescan */
+  uint32_t nsel;
+  uint32_t recfirst; /* --records, dump records [recfirst, recend) */
+  uint32_t recend; /* 0 up to the last record */
+  uint64_t skip; /* --offset, selected records left to skip */
+  uint64_t limit; /* --limit, 0 for no limit */
+  uint64_t dumped; /* records dumped so far, against limit */
+  uint32_t sample; /* --sample size, 0 for none */
+  uint8_t *colsel; /* --columns, whether to dump a field, NULL for all */
+  uint8_t *colread; /* fields the records are read with from the cache, NULL for all */
+  ClarionWhere *where; /* --where, records to dump, NULL for all */
+  ClarionSort *sort; /* --sort-by, NULL for file order */
+  ClarionCheck *check; /* --check-keys, NULL for none */
+  ClarionIndex *index; /* --lookup, records to dump are looked up there if set */
+  ClarionCache *cache; /* --cache, records are read from there if set */
+  ClarionArena arena; /* holds the metadata */
 } ClarionHandle;
 
 typedef struct {
   uint8_t rhd;
   uint32_t rptr;
+  uint32_t recno; /* record index, set by the record driver */
 } ClarionRecordHeader;
 
 typedef struct {
@@ -195,6 +315,111 @@ typedef struct {
   uint8_t memo[252+1];
 } ClarionMemoEntry;
 
+/* Output sink, see cl_output.c */
+typedef struct cl_output {
+  uint8_t *buf;
+  size_t len;
+  size_t size;
+  int fd;
+  void (*drain) (struct cl_output *out); /* called when the buffer is full */
+  void *priv;
+} ClarionOutput;
+
+/* Bounded single-producer/single-consumer ring between two threads, see cl_pipeline.c */
+#define CL_RING_SIZE             4 /* power of 2 */
+
+typedef struct {
+  void *slot[CL_RING_SIZE];
+  unsigned int head; /* written by the producer only */
+  unsigned int tail; /* written by the consumer only */
+} ClarionRing;
+
+/* Called for each record to output; data points past the record header */
+typedef void (*ClarionRecordFn) (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+				 uint8_t *data, ClarionOutput *out, void *ctx);
+
+
+/*
+ * Phase tracking and statistics. CL_SET_PHASE() returns the phase the
+ * thread was in so it can be restored; the phase clocks only run with
+ * --stats. The CL_STAT() counters are plain thread-local increments.
+ */
+extern int cl_stats_on;
+extern __thread int cl_phase;
+extern __thread ClarionStats cl_stats;
+
+#define CL_SET_PHASE(p)						\
+  (cl_stats_on ? clarion_stats_phase(p) : ({ int _prev = cl_phase; cl_phase = (p); _prev; }))
+#define CL_STAT(field, n)        (cl_stats.field += (n))
+
+/*
+ * USDT probes, provider "cldump", for bpftrace or SystemTap; a NOP in
+ * the code until attached. Without <sys/sdt.h> (or with make SDT=0)
+ * they compile to nothing.
+ *
+ *   record__start, record__end   (recno, rhd)
+ *   field__decode                (fldtype, fldnum)
+ *   memo__fetch                  (rptr, blocks)
+ *   output__flush                (bytes)
+ *   decrypt__chunk               (units, bytes)
+ */
+#if !defined(CL_NO_SDT) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define CL_HAVE_SDT
+# endif
+#endif
+
+#ifdef CL_HAVE_SDT
+# define CL_PROBE1(name, a)       DTRACE_PROBE1(cldump, name, a)
+# define CL_PROBE2(name, a, b)    DTRACE_PROBE2(cldump, name, a, b)
+#else
+# define CL_PROBE1(name, a)       ((void) 0)
+# define CL_PROBE2(name, a, b)    ((void) 0)
+#endif
+
+/* Timeline spans for --trace, see cl_trace.c */
+extern int cl_trace_on;
+
+#define CL_TRACE_BEGIN()         (cl_trace_on ? clarion_trace_now() : 0)
+#define CL_TRACE_END(name, cat, t0, argname, arg)				\
+  do {									\
+    if (cl_trace_on)							\
+      clarion_trace_event((name), (cat), (t0), (argname), (arg));	\
+  } while (0)
+
+/*
+ * Counted I/O, allocation and iconv points; the counters are only
+ * compiled in with make INSTRUMENT=1. Allocations and iconv calls are
+ * accounted to the phase the calling thread is in.
+ */
+#ifdef CL_INSTRUMENT
+extern ClarionCounters cl_counters[CL_PHASE_MAX];
+
+# define CL_CUR_PHASE             cl_phase
+# define CL_COUNT(phase, c, n)    ((void) __atomic_fetch_add(&cl_counters[(phase)].cnt[(c)], (uint64_t)(n), __ATOMIC_RELAXED))
+#else
+# define CL_CUR_PHASE             0
+# define CL_COUNT(phase, c, n)    ((void) 0)
+#endif
+
+#define CL_PREAD(phase, fd, buf, len, pos)	\
+  (CL_COUNT(phase, CL_CNT_READS, 1), pread((fd), (buf), (len), (pos)))
+#define CL_FREAD(phase, ptr, size, nmemb, fp)	\
+  (CL_COUNT(phase, CL_CNT_READS, 1), fread((ptr), (size), (nmemb), (fp)))
+#define CL_FSEEK(phase, fp, off, whence)	\
+  (CL_COUNT(phase, CL_CNT_SEEKS, 1), fseek((fp), (off), (whence)))
+#define CL_WRITE(phase, fd, buf, len)		\
+  (CL_COUNT(phase, CL_CNT_WRITES, 1), write((fd), (buf), (len)))
+#define CL_MALLOC(size)							\
+  (CL_COUNT(CL_CUR_PHASE, CL_CNT_ALLOCS, 1), CL_COUNT(CL_CUR_PHASE, CL_CNT_ALLOC_BYTES, (size)), malloc(size))
+#define CL_CALLOC(nmemb, size)						\
+  (CL_COUNT(CL_CUR_PHASE, CL_CNT_ALLOCS, 1), CL_COUNT(CL_CUR_PHASE, CL_CNT_ALLOC_BYTES, (nmemb) * (size)), calloc((nmemb), (size)))
+#define CL_REALLOC(ptr, size)						\
+  (CL_COUNT(CL_CUR_PHASE, CL_CNT_ALLOCS, 1), CL_COUNT(CL_CUR_PHASE, CL_CNT_ALLOC_BYTES, (size)), realloc((ptr), (size)))
+#define CL_ICONV(cd, in, inleft, out, outleft)				\
+  (CL_COUNT(CL_CUR_PHASE, CL_CNT_ICONV, 1), iconv((cd), (in), (inleft), (out), (outleft)))
+
 
 /* In cldump.c */
 void
@@ -204,10 +429,221 @@ int
 clarion_open_memo (ClarionHandle *cl);
 
 
+/* In cl_arena.c */
+void *
+clarion_arena_alloc (ClarionArena *a, size_t size);
+
+void *
+clarion_arena_calloc (ClarionArena *a, size_t nmemb, size_t size);
+
+void
+clarion_arena_free (ClarionArena *a);
+
+void
+clarion_arena_reset (ClarionArena *a);
+
+void *
+clarion_scratch_alloc (size_t size);
+
+void
+clarion_scratch_reset (void);
+
+
+/* In cl_select.c */
+void
+clarion_select_init (ClarionHandle *cl);
+
+int
+clarion_prescan (ClarionHandle *cl);
+
+uint32_t
+clarion_select_next (ClarionHandle *cl, uint32_t from);
+
+void
+clarion_select_split (ClarionHandle *cl, int n, uint32_t *bounds);
+
+uint32_t *
+clarion_sample (ClarionHandle *cl, uint32_t *count);
+
+int
+clarion_find_field (ClarionHandle *cl, const char *name, size_t len);
+
+int
+clarion_field_offset (ClarionHandle *cl, int field);
+
+int
+clarion_select_columns (ClarionHandle *cl, const char *list);
+
+
+/* In cl_where.c */
+void
+clarion_field_value (ClarionFieldDesc *clfd, const uint8_t *buf, ClarionValue *v);
+
+int
+clarion_value_cmp (const ClarionValue *a, const ClarionValue *b);
+
+uint64_t
+clarion_value_hash (ClarionFieldDesc *clfd, const ClarionValue *v);
+
+int
+clarion_value_parse (ClarionFieldDesc *clfd, char *lit, ClarionValue *v);
+
+int
+clarion_where_parse (ClarionHandle *cl, const char *expr);
+
+int
+clarion_where_equal (ClarionHandle *cl, int field, const ClarionValue *v);
+
+int
+clarion_where_match (ClarionWhere *w, const uint8_t *data);
+
+
+/* In cl_aggregate.c */
+ClarionAggregate *
+clarion_aggregate_parse (ClarionHandle *cl, const char *spec);
+
+void
+clarion_aggregate_dump (ClarionHandle *cl, ClarionAggregate *agg);
+
+
+/* In cl_sort.c */
+int
+clarion_sort_parse (ClarionHandle *cl, const char *spec, size_t memlimit);
+
+void
+clarion_sort_key (ClarionHandle *cl, uint32_t recno, ClarionRecordHeader *clrh,
+		  uint8_t *data, ClarionOutput *out, void *ctx);
+
+int
+clarion_sort_finish (ClarionHandle *cl);
+
+int
+clarion_sort_next (ClarionHandle *cl, uint32_t *recno);
+
+void
+clarion_sort_free (ClarionHandle *cl);
+
+
+/* In cl_check.c */
+int
+clarion_check_init (ClarionHandle *cl);
+
+void
+clarion_check_record (ClarionHandle *cl, uint32_t recno, const uint8_t *data);
+
+void
+clarion_check_scan (ClarionHandle *cl);
+
+uint64_t
+clarion_check_report (ClarionHandle *cl);
+
+
+/* In cl_index.c */
+int
+clarion_index_build (ClarionHandle *cl, const char *col);
+
+int
+clarion_index_open (ClarionHandle *cl, const char *spec);
+
+uint32_t *
+clarion_index_records (ClarionHandle *cl, uint32_t *count);
+
+void
+clarion_index_close (ClarionHandle *cl);
+
+
+/* In cl_bloom.c */
+int
+clarion_bloom_build (ClarionHandle *cl, char **paths, int npaths, const char *columns);
+
+int
+clarion_bloom_query (ClarionHandle *cl, const char *path, const char *value);
+
+
+/* In cl_stats.c */
+void
+clarion_stats_start (int timing);
+
+int
+clarion_stats_phase (int phase);
+
+void
+clarion_stats_memo (uint32_t blocks);
+
+void
+clarion_stats_merge (void);
+
+void
+clarion_stats_save (ClarionStats saved[2]);
+
+void
+clarion_stats_restore (const ClarionStats saved[2]);
+
+void
+clarion_stats_progress (uint64_t done, uint64_t total, int interval);
+
+int
+clarion_stats_print (const char *jsonfile);
+
+
+/* In cl_trace.c */
+uint64_t
+clarion_trace_now (void);
+
+void
+clarion_trace_start (void);
+
+void
+clarion_trace_thread (const char *name);
+
+void
+clarion_trace_event (const char *name, const char *cat, uint64_t t0, const char *argname, int64_t arg);
+
+int
+clarion_trace_write (const char *tracefile);
+
+
 /* In cl_decrypt.c */
+void
+clarion_xor (uint8_t *buf, size_t len, const uint8_t *key);
+
+void
+clarion_get_key (ClarionHeader *clh, int mode, uint8_t *key);
+
+int
+clarion_decrypt_meta (uint8_t *buf, size_t size, const uint8_t *key);
+
+int
+clarion_find_key (ClarionHandle *cl);
+
+int
+clarion_decrypt_meta_load (ClarionHandle *cl);
+
 void
 clarion_decrypt_all(ClarionHandle *cl);
 
+int
+clarion_decrypt_to (ClarionHandle *cl, char **paths, int npaths, const char *dir);
+
+
+/* In cl_cache.c */
+int
+clarion_cache_open (ClarionHandle *cl, const char *dir);
+
+uint32_t
+clarion_cache_read (ClarionHandle *cl, uint8_t *buf, uint32_t first, uint32_t count);
+
+int
+clarion_cache_memo (ClarionHandle *cl, uint32_t recno, uint8_t **memo);
+
+void
+clarion_cache_close (ClarionHandle *cl);
+
+
+/* In cl_inventory.c */
+int
+clarion_inventory (ClarionHandle *cl, char **paths, int npaths, int json);
+
 
 /* In cl_utils.c */
 #if BYTE_ORDER == BIG_ENDIAN
@@ -215,17 +651,54 @@ size_t cl_fread (void *ptr, size_t size, size_t nmemb, FILE *stream);
 #define fread cl_fread
 #endif
 
-void
+int
 clarion_trim (uint8_t *data, int length);
 
+int
+clarion_collect_files (const char *path, char ***files, int *nfiles);
+
+char *
+clarion_field_name (ClarionFieldDesc *clfd, char *buf);
+
+uint64_t
+clarion_fnv (uint64_t h, const void *data, size_t len);
+
 void
 clarion_singlespace (char *data);
 
 char *
-clarion_iconv (const char *charset, char *data);
+clarion_iconv_scratch (const char *charset, const char *data, size_t len, size_t *outlen);
+
+int
+clarion_memo_normalize (const uint8_t *memo, int len, const char *charset, int mysql, uint8_t **result);
+
+
+/* In cl_scan.c */
+#define CL_SCAN_SQUOTE           (1 << 0) /* ' */
+#define CL_SCAN_DQUOTE           (1 << 1) /* " */
+#define CL_SCAN_BACKSLASH        (1 << 2)
+#define CL_SCAN_SEPARATOR        (1 << 3) /* separator given to the scan */
+#define CL_SCAN_NEWLINE          (1 << 4) /* \r or \n */
+#define CL_SCAN_NUL              (1 << 5)
+#define CL_SCAN_NONASCII         (1 << 6) /* 8th bit set, needs transcoding */
+
+int
+clarion_scan (const uint8_t *data, int length, uint8_t sep, unsigned int *flags);
+
+int
+clarion_scan_find (const uint8_t *data, int length, uint8_t a, uint8_t b);
+
+int
+clarion_trim_scan (uint8_t *data, int length, uint8_t sep, unsigned int *flags);
+
+int
+clarion_scan_string (const uint8_t *data, int length, uint8_t sep, unsigned int *flags);
 
 
 /* In cl_meta.c */
+int
+clarion_load_meta (ClarionHandle *cl, uint32_t size);
+
 int
 clarion_read_header (ClarionHandle *cl);
 
@@ -241,8 +714,17 @@ clarion_read_pic_desc (ClarionHandle *cl);
 void
 clarion_read_arr_desc (ClarionHandle *cl);
 
+void
+clarion_probe_keys (ClarionHandle *cl);
+
 
 /* In cl_dump_meta.c */
+int
+clarion_decode_time (uint32_t chgtime, int *hour, int *min, int *sec, int *cs);
+
+int
+clarion_decode_date (uint32_t chgdate, int *year, int *month, int *day);
+
 void
 clarion_dump_meta (ClarionHandle *cl);
 
@@ -261,26 +743,75 @@ clarion_dump_schema_csv (ClarionHandle *cl);
 
 
 /* In cl_dump_field.c */
+int
+clarion_read_memo (ClarionHandle *cl, ClarionRecordHeader *clrh, uint8_t **memo);
+
 void
-clarion_dump_memo_entry (ClarionRecordHeader *clrh, FILE *fp, char *plchold, char *charset);
+clarion_dump_memo_entry (ClarionHandle *cl, ClarionRecordHeader *clrh, ClarionOutput *out, char *plchold);
 
 void
-clarion_dump_field_long (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold);
+clarion_dump_field_long (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold);
 
 void
-clarion_dump_field_real (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold);
+clarion_dump_field_real (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold);
 
 void
-clarion_dump_field_string (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold, char *charset);
+clarion_dump_field_string (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold, char *charset);
 
 void
-clarion_dump_field_byte (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold);
+clarion_dump_field_byte (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold);
 
 void
-clarion_dump_field_short (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold);
+clarion_dump_field_short (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold);
 
 void
-clarion_dump_field_decimal (uint8_t *buf, ClarionFieldDesc *clfd, FILE *fp, char *plchold);
+clarion_dump_field_decimal (uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out, char *plchold);
+
+
+/* In cl_output.c */
+int
+clarion_write_all (int fd, const uint8_t *buf, size_t len);
+
+int
+clarion_out_init (ClarionOutput *out, int fd, size_t size);
+
+void
+clarion_out_flush (ClarionOutput *out);
+
+void
+clarion_out_free (ClarionOutput *out);
+
+void
+clarion_out_write (ClarionOutput *out, const void *data, size_t len);
+
+void
+clarion_out_putc (ClarionOutput *out, int c);
+
+void
+clarion_out_puts (ClarionOutput *out, const char *s);
+
+void
+clarion_out_int (ClarionOutput *out, long long val);
+
+void
+clarion_out_printf (ClarionOutput *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+
+/* In cl_pipeline.c */
+void
+clarion_ring_push (ClarionRing *r, void *p);
+
+void *
+clarion_ring_pop (ClarionRing *r);
+
+uint32_t
+clarion_read_batch (ClarionHandle *cl, uint8_t *buf, uint32_t first, uint32_t count);
+
+void
+clarion_dump_records (ClarionHandle *cl, ClarionRecordFn fn, void *ctx);
+
+int
+clarion_scan_records (ClarionHandle *cl, ClarionRecordFn fn, void **ctx, int nctx);
 
 
 /* In cl_dump_data.c */
@@ -289,6 +820,15 @@ clarion_dump_data (ClarionHandle *cl);
 
 
 /* In cl_dump_data_csv.c */
+void
+clarion_csv_write (ClarionOutput *out, const uint8_t *data, int len, unsigned int flags);
+
+void
+clarion_csv_eol (ClarionHandle *cl, ClarionOutput *out);
+
+void
+clarion_dump_field_string_csv (ClarionHandle *cl, uint8_t *buf, ClarionFieldDesc *clfd, ClarionOutput *out);
+
 void
 clarion_dump_data_csv (ClarionHandle *cl);
 